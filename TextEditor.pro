@@ -5,16 +5,71 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += printsupport
 TARGET = TextEditor
 TEMPLATE = app
 
+win32: LIBS += -lpsapi
+
 SOURCES += \
+    backgroundhighlighter.cpp \
+    batchexporter.cpp \
+    blockdata.cpp \
+    bulktransform.cpp \
+    codeedit.cpp \
+    completionindex.cpp \
+    digitatlas.cpp \
+    documentcompletion.cpp \
+    editjournal.cpp \
+    editordocument.cpp \
+    filefollower.cpp \
+    fileloader.cpp \
+    filesaver.cpp \
+    findpanel.cpp \
+    highlightlexer.cpp \
+    languages.cpp \
+    largefileviewer.cpp \
+    lineindex.cpp \
+    literalsearch.cpp \
     main.cpp \
-    mainwindow.cpp \
+    memoryusage.cpp \
+    piecetable.cpp \
+    regexdfa.cpp \
+    searchengine.cpp \
+    startuptime.cpp \
+    structureindex.cpp \
     syntaxhighlighter.cpp \
-    texteditor.cpp
+    texteditor.cpp \
+    traceoverlay.cpp \
+    tracing.cpp \
+    utf8decoder.cpp
 
 HEADERS += \
-    mainwindow.h \
+    backgroundhighlighter.h \
+    batchexporter.h \
+    blockdata.h \
+    bulktransform.h \
+    codeedit.h \
+    completionindex.h \
+    digitatlas.h \
+    documentcompletion.h \
+    editjournal.h \
+    editordocument.h \
+    filefollower.h \
+    fileloader.h \
+    filesaver.h \
+    findpanel.h \
+    highlightlexer.h \
+    languages.h \
+    largefileviewer.h \
+    lineindex.h \
+    literalsearch.h \
+    memoryusage.h \
+    piecetable.h \
+    regexdfa.h \
+    searchengine.h \
+    startuptime.h \
+    structureindex.h \
     syntaxhighlighter.h \
-    texteditor.h
+    texteditor.h \
+    traceoverlay.h \
+    tracing.h \
+    utf8decoder.h
 
-FORMS += \
-    mainwindow.ui
+RESOURCES += languages.qrc
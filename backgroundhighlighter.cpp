@@ -0,0 +1,240 @@
+#include "backgroundhighlighter.h"
+#include "structureindex.h"
+#include "syntaxhighlighter.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextLayout>
+#include <QScrollBar>
+
+// Lines tokenized per batch, and batches queued for the GUI thread at once.
+static const int batchSize = 1000;
+static const int maxBatchesInFlight = 2;
+
+BackgroundHighlighter::BackgroundHighlighter(QTextEdit *editor, SyntaxHighlighter *highlighter)
+    : QObject(editor), editor(editor), inFlight(maxBatchesInFlight), generation(0) {
+    pool.setMaxThreadCount(1);
+
+    restartTimer.setSingleShot(true);
+    restartTimer.setInterval(50);
+    connect(&restartTimer, &QTimer::timeout, this, &BackgroundHighlighter::startPass);
+
+    connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &BackgroundHighlighter::updateViewport);
+    connect(editor->verticalScrollBar(), &QScrollBar::rangeChanged, this, &BackgroundHighlighter::updateViewport);
+    setHighlighter(highlighter);
+}
+
+BackgroundHighlighter::~BackgroundHighlighter() {
+    cancelPass();
+    pool.waitForDone();
+}
+
+void BackgroundHighlighter::setEnabled(bool enabled) {
+    if (this->enabled == enabled)
+        return;
+    this->enabled = enabled;
+    cancelPass();
+    pendingFrom = -1;
+    restartTimer.stop();
+    if (!highlighter)
+        return;
+    highlighter->setDeferred(enabled);
+    if (enabled) {
+        scheduleFrom(0);
+        updateViewport();
+    }
+}
+
+bool BackgroundHighlighter::isEnabled() const {
+    return enabled;
+}
+
+void BackgroundHighlighter::setHighlighter(SyntaxHighlighter *highlighter) {
+    if (this->highlighter)
+        disconnect(this->highlighter, nullptr, this, nullptr);
+    if (document)
+        disconnect(document, nullptr, this, nullptr);
+    cancelPass();
+    pendingFrom = -1;
+    restartTimer.stop();
+
+    this->highlighter = highlighter;
+    document = highlighter ? highlighter->document() : nullptr;
+    if (!highlighter)
+        return;
+    connect(highlighter, &SyntaxHighlighter::highlightingDeferred, this, &BackgroundHighlighter::scheduleFrom);
+    connect(document, &QTextDocument::contentsChange, this, &BackgroundHighlighter::onContentsChange);
+    highlighter->setDeferred(enabled);
+    if (enabled) {
+        // Blocks deferred while the document was in the background may never
+        // have been styled.
+        scheduleFrom(0);
+        updateViewport();
+    }
+}
+
+void BackgroundHighlighter::updateViewport() {
+    if (!enabled || !highlighter || editor->document() != document)
+        return;
+
+    QTextCursor top = editor->cursorForPosition(QPoint(0, 0));
+    QTextCursor bottom = editor->cursorForPosition(QPoint(0, editor->viewport()->height() - 1));
+    const int first = top.blockNumber();
+    // Before the document is laid out both cursors sit on block 0, so also
+    // cover a screenful of lines.
+    const int screenLines = editor->viewport()->height() / qMax(1, editor->fontMetrics().lineSpacing()) + 1;
+    const int last = qMax(bottom.blockNumber(), first + screenLines);
+    highlighter->setPriorityRange(first, last);
+
+    // Style visible blocks that have never been highlighted. The start state
+    // is a best guess from the block above; the background pass corrects it.
+    applying = true;
+    QTextBlock block = top.block();
+    for (int number = first; block.isValid() && number <= last; ++number) {
+        if (block.userState() == -1)
+            highlighter->rehighlightBlock(block);
+        block = block.next();
+    }
+    applying = false;
+}
+
+void BackgroundHighlighter::scheduleFrom(int blockNumber) {
+    if (!enabled)
+        return;
+    if (pendingFrom < 0 || blockNumber < pendingFrom)
+        pendingFrom = blockNumber;
+    restartTimer.start();
+}
+
+void BackgroundHighlighter::onContentsChange(int position, int charsRemoved, int charsAdded) {
+    Q_UNUSED(charsRemoved);
+    Q_UNUSED(charsAdded);
+    if (!enabled || applying || passNextBlock < 0)
+        return;
+
+    // Appending past the snapshot (e.g. while FileLoader streams a file in)
+    // leaves the running pass valid; the new blocks get a pass of their own.
+    const int editedBlock = document->findBlock(position).blockNumber();
+    if (editedBlock >= passLastBlock) {
+        scheduleFrom(editedBlock);
+        return;
+    }
+
+    // Otherwise the snapshot no longer matches the document, so drop the
+    // pass and resume from whichever point comes first.
+    const int resumeFrom = qMin(editedBlock, passNextBlock);
+    cancelPass();
+    scheduleFrom(resumeFrom);
+}
+
+void BackgroundHighlighter::startPass() {
+    // A running pass picks up pending work when it finishes.
+    if (!enabled || pendingFrom < 0 || passNextBlock >= 0 || !highlighter)
+        return;
+
+    const QTextBlock firstBlock = document->findBlockByNumber(pendingFrom);
+    pendingFrom = -1;
+    highlighter->clearDeferred();
+    if (!firstBlock.isValid())
+        return;
+
+    const QTextBlock previous = firstBlock.previous();
+    const int startState = previous.isValid() ? qMax(0, previous.userState()) : 0;
+
+    QTextCursor cursor(document);
+    cursor.setPosition(firstBlock.position());
+    cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+    const QString snapshot = cursor.selectedText();
+
+    const std::shared_ptr<const HighlightLexer> lexer = highlighter->lexer();
+    const int passGeneration = generation.load();
+    const int firstBlockNumber = firstBlock.blockNumber();
+    passNextBlock = firstBlockNumber;
+    passLastBlock = document->blockCount() - 1;
+    pool.start([this, lexer, snapshot, firstBlockNumber, startState, passGeneration]() {
+        runPass(lexer, snapshot, firstBlockNumber, startState, passGeneration);
+    });
+}
+
+void BackgroundHighlighter::runPass(const std::shared_ptr<const HighlightLexer> &lexer, const QString &snapshot,
+                                    int firstBlock, int startState, int passGeneration) {
+    const QStringView text(snapshot);
+    int state = startState;
+    qsizetype lineStart = 0;
+
+    Batch batch{passGeneration, firstBlock, false, {}, {}, {}};
+    for (;;) {
+        if (generation.load(std::memory_order_relaxed) != passGeneration)
+            return;
+
+        // selectedText() separates blocks with U+2029.
+        qsizetype lineEnd = snapshot.indexOf(QChar::ParagraphSeparator, lineStart);
+        const bool last = lineEnd < 0;
+        if (last)
+            lineEnd = snapshot.size();
+
+        const QStringView line = text.mid(lineStart, lineEnd - lineStart);
+        QVector<HighlightLexer::Token> tokens;
+        state = lexer->tokenize(line, state, tokens);
+        QVector<BlockData::Bracket> brackets;
+        StructureIndex::scan(line, tokens, brackets);
+        batch.tokens.append(tokens);
+        batch.states.append(state);
+        batch.brackets.append(brackets);
+
+        if (batch.states.size() == batchSize || last) {
+            batch.last = last;
+            while (!inFlight.tryAcquire(1, 50)) {
+                if (generation.load(std::memory_order_relaxed) != passGeneration)
+                    return;
+            }
+            QMetaObject::invokeMethod(this, [this, batch]() { applyBatch(batch); }, Qt::QueuedConnection);
+            batch = Batch{passGeneration, batch.firstBlock + int(batch.states.size()), false, {}, {}, {}};
+        }
+        if (last)
+            return;
+        lineStart = lineEnd + 1;
+    }
+}
+
+void BackgroundHighlighter::applyBatch(const Batch &batch) {
+    inFlight.release();
+    if (batch.generation != generation.load() || !document)
+        return;
+
+    QTextBlock block = document->findBlockByNumber(batch.firstBlock);
+    int dirtyFrom = -1;
+    int dirtyTo = -1;
+
+    applying = true;
+    for (int i = 0; i < batch.states.size() && block.isValid(); ++i) {
+        const QList<QTextLayout::FormatRange> ranges = SyntaxHighlighter::formatRanges(batch.tokens.at(i));
+        QTextLayout *layout = block.layout();
+        if (block.userState() != batch.states.at(i) || layout->formats() != ranges) {
+            layout->setFormats(ranges);
+            block.setUserState(batch.states.at(i));
+            if (dirtyFrom < 0)
+                dirtyFrom = block.position();
+            dirtyTo = block.position() + block.length();
+        }
+        StructureIndex::setBrackets(block, batch.brackets.at(i));
+        block = block.next();
+    }
+    if (dirtyFrom >= 0)
+        document->markContentsDirty(dirtyFrom, dirtyTo - dirtyFrom);
+    applying = false;
+
+    if (batch.last) {
+        passNextBlock = -1;
+        if (pendingFrom >= 0)
+            restartTimer.start();
+    } else {
+        passNextBlock = batch.firstBlock + int(batch.states.size());
+    }
+}
+
+void BackgroundHighlighter::cancelPass() {
+    ++generation;
+    passNextBlock = -1;
+}
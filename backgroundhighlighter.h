@@ -0,0 +1,70 @@
+#ifndef BACKGROUNDHIGHLIGHTER_H
+#define BACKGROUNDHIGHLIGHTER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include "blockdata.h"
+#include "highlightlexer.h"
+
+class QTextDocument;
+class QTextEdit;
+class SyntaxHighlighter;
+
+// Viewport-first highlighting for large documents. Visible blocks are styled
+// synchronously by SyntaxHighlighter; everything else is tokenized on a worker
+// thread in chunks and applied back in batches.
+class BackgroundHighlighter : public QObject {
+    Q_OBJECT
+public:
+    BackgroundHighlighter(QTextEdit *editor, SyntaxHighlighter *highlighter);
+    ~BackgroundHighlighter();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    // Follows the editor to the document highlighter belongs to; call it
+    // after QTextEdit::setDocument().
+    void setHighlighter(SyntaxHighlighter *highlighter);
+
+public slots:
+    void updateViewport();
+
+private slots:
+    void scheduleFrom(int blockNumber);
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void startPass();
+
+private:
+    struct Batch {
+        int generation;
+        int firstBlock;
+        bool last;
+        QVector<QVector<HighlightLexer::Token>> tokens;
+        QVector<int> states;
+        QVector<QVector<BlockData::Bracket>> brackets;
+    };
+
+    void runPass(const std::shared_ptr<const HighlightLexer> &lexer, const QString &snapshot, int firstBlock,
+                 int startState, int passGeneration);
+    void applyBatch(const Batch &batch);
+    void cancelPass();
+
+    QTextEdit *editor;
+    QPointer<SyntaxHighlighter> highlighter;
+    QPointer<QTextDocument> document;
+    QTimer restartTimer;
+    QThreadPool pool;
+    QSemaphore inFlight;
+    std::atomic<int> generation;
+    int pendingFrom = -1;
+    int passNextBlock = -1;
+    int passLastBlock = -1;
+    bool enabled = false;
+    bool applying = false;
+};
+
+#endif // BACKGROUNDHIGHLIGHTER_H
@@ -0,0 +1,229 @@
+#include "batchexporter.h"
+#include "languages.h"
+#include "syntaxhighlighter.h"
+#include "tracing.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QThreadPool>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+// Output is handed to the file in pieces of about this size.
+static const int outputBufferSize = 64 * 1024;
+
+BatchExporter::BatchExporter(Format format, const QString &outputDirectory)
+    : format(format), outputDirectory(outputDirectory) {
+    // Built once up front; the workers only read them.
+    for (int kind = 0; kind < HighlightLexer::tokenKindCount; ++kind) {
+        const QTextCharFormat charFormat = SyntaxHighlighter::defaultFormat(HighlightLexer::TokenKind(kind));
+        const QColor color = charFormat.foreground().color();
+        const bool bold = charFormat.fontWeight() >= QFont::Bold;
+        const bool italic = charFormat.fontItalic();
+        Style &style = styles[kind];
+        if (format == Html) {
+            style.open = "<span style=\"color:" + color.name().toLatin1() + (bold ? ";font-weight:bold" : "")
+                         + (italic ? ";font-style:italic" : "") + "\">";
+            style.close = "</span>";
+        } else {
+            style.open = "\x1b[38;2;" + QByteArray::number(color.red()) + ';' + QByteArray::number(color.green()) + ';'
+                         + QByteArray::number(color.blue()) + 'm' + (bold ? "\x1b[1m" : "") + (italic ? "\x1b[3m" : "");
+            style.close = "\x1b[0m";
+        }
+    }
+}
+
+bool BatchExporter::isBatchCommandLine(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--export") == 0 || std::strncmp(argv[i], "--export=", 9) == 0)
+            return true;
+    }
+    return false;
+}
+
+int BatchExporter::run(const QStringList &arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Exports syntax-highlighted source files.");
+    parser.addHelpOption();
+    QCommandLineOption exportOption("export", "Output format: html or ansi.", "format");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs", "Files exported at once.", "n",
+                                  QString::number(QThread::idealThreadCount()));
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Directory for the output; by default it goes next to each file.", "directory");
+    parser.addOption(exportOption);
+    parser.addOption(jobsOption);
+    parser.addOption(outputOption);
+    parser.addPositionalArgument("files", "Files to export.", "files...");
+    parser.process(arguments);
+
+    const QString formatName = parser.value(exportOption);
+    if (formatName != "html" && formatName != "ansi") {
+        std::fprintf(stderr, "Unknown export format \"%s\"; use html or ansi\n", qPrintable(formatName));
+        return 2;
+    }
+    bool ok = false;
+    const int jobs = parser.value(jobsOption).toInt(&ok);
+    if (!ok || jobs < 1) {
+        std::fprintf(stderr, "Invalid job count \"%s\"\n", qPrintable(parser.value(jobsOption)));
+        return 2;
+    }
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty()) {
+        std::fprintf(stderr, "No files to export\n");
+        return 2;
+    }
+
+    BatchExporter exporter(formatName == "html" ? Html : Ansi, parser.value(outputOption));
+    return exporter.exportFiles(files, jobs) == 0 ? 0 : 1;
+}
+
+int BatchExporter::exportFiles(const QStringList &files, int jobs) {
+    // Every worker claims the next unexported file when it is done with its
+    // last one, so a few huge files cannot leave the other threads idle.
+    std::atomic<int> nextFile(0);
+    std::atomic<int> failures(0);
+    std::atomic<qint64> totalBytes(0);
+    QMutex reportMutex;
+    QElapsedTimer timer;
+    timer.start();
+
+    const int threads = qMin(jobs, int(files.size()));
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; ++i) {
+        pool.start([&]() {
+            for (int index = nextFile++; index < files.size(); index = nextFile++) {
+                qint64 bytes = 0;
+                QString error;
+                if (exportFile(files.at(index), &bytes, &error)) {
+                    totalBytes += bytes;
+                } else {
+                    ++failures;
+                    QMutexLocker locker(&reportMutex);
+                    std::fprintf(stderr, "%s: %s\n", qPrintable(files.at(index)), qPrintable(error));
+                }
+            }
+        });
+    }
+    pool.waitForDone();
+
+    const qint64 ms = qMax<qint64>(1, timer.elapsed());
+    std::fprintf(stderr, "Exported %d of %d files (%lld MB) in %lld ms, %lld MB/s on %d threads\n",
+                 int(files.size()) - failures, int(files.size()), totalBytes / (1024 * 1024), ms,
+                 totalBytes * 1000 / ms / (1024 * 1024), threads);
+    return failures;
+}
+
+QString BatchExporter::outputFileName(const QString &fileName) const {
+    const QString name = fileName + (format == Html ? ".html" : ".ansi");
+    if (outputDirectory.isEmpty())
+        return name;
+    // Relative inputs keep their layout under the output directory.
+    return QDir(outputDirectory).filePath(QDir::isRelativePath(name) ? QDir::cleanPath(name) : QFileInfo(name).fileName());
+}
+
+void BatchExporter::appendText(QByteArray &out, QStringView text) const {
+    if (format == Ansi) {
+        out += text.toUtf8();
+        return;
+    }
+    qsizetype from = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const char *entity = nullptr;
+        switch (text[i].unicode()) {
+        case '&':
+            entity = "&amp;";
+            break;
+        case '<':
+            entity = "&lt;";
+            break;
+        case '>':
+            entity = "&gt;";
+            break;
+        default:
+            continue;
+        }
+        out += text.mid(from, i - from).toUtf8();
+        out += entity;
+        from = i + 1;
+    }
+    out += text.mid(from).toUtf8();
+}
+
+bool BatchExporter::exportFile(const QString &fileName, qint64 *bytesRead, QString *error) const {
+    TRACE_SCOPE("exportFile");
+    QFile input(fileName);
+    if (!input.open(QIODevice::ReadOnly)) {
+        *error = input.errorString();
+        return false;
+    }
+    const QString target = outputFileName(fileName);
+    QDir().mkpath(QFileInfo(target).absolutePath());
+    QSaveFile output(target);
+    if (!output.open(QIODevice::WriteOnly)) {
+        *error = output.errorString();
+        return false;
+    }
+
+    QByteArray out;
+    out.reserve(outputBufferSize * 2);
+    if (format == Html) {
+        out += "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>";
+        appendText(out, QFileInfo(fileName).fileName());
+        out += "</title></head>\n<body><pre>";
+    }
+
+    const std::shared_ptr<const HighlightLexer> lexer = Languages::forFile(fileName);
+    QVector<HighlightLexer::Token> tokens;
+    int state = HighlightLexer::NormalState;
+    while (!input.atEnd()) {
+        const QByteArray rawLine = input.readLine();
+        *bytesRead += rawLine.size();
+        qsizetype length = rawLine.size();
+        if (length > 0 && rawLine.at(length - 1) == '\n')
+            --length;
+        if (length > 0 && rawLine.at(length - 1) == '\r')
+            --length;
+        const QString line = QString::fromUtf8(rawLine.constData(), length);
+
+        tokens.clear();
+        state = lexer->tokenize(line, state, tokens);
+        qsizetype position = 0;
+        for (const HighlightLexer::Token &token : std::as_const(tokens)) {
+            appendText(out, QStringView(line).mid(position, token.start - position));
+            const Style &style = styles[token.kind];
+            out += style.open;
+            appendText(out, QStringView(line).mid(token.start, token.length));
+            out += style.close;
+            position = token.start + token.length;
+        }
+        appendText(out, QStringView(line).mid(position));
+        out += '\n';
+
+        if (out.size() >= outputBufferSize) {
+            if (output.write(out) != out.size()) {
+                *error = output.errorString();
+                return false;
+            }
+            out.clear();
+        }
+    }
+    if (input.error() != QFileDevice::NoError) {
+        *error = input.errorString();
+        return false;
+    }
+
+    if (format == Html)
+        out += "</pre></body></html>\n";
+    if (output.write(out) != out.size() || !output.commit()) {
+        *error = output.errorString();
+        return false;
+    }
+    return true;
+}
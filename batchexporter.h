@@ -0,0 +1,47 @@
+#ifndef BATCHEXPORTER_H
+#define BATCHEXPORTER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include "highlightlexer.h"
+
+// Renders source files to highlighted HTML or ANSI text without a window,
+// for "TextEditor --export html|ansi [-j N] [-o DIR] files...". Files are
+// lexed line by line with the HighlightLexer of their language and written
+// out as they go, with the colours of SyntaxHighlighter, on as many threads
+// as requested.
+class BatchExporter {
+public:
+    enum Format {
+        Html,
+        Ansi
+    };
+
+    BatchExporter(Format format, const QString &outputDirectory);
+
+    // Exports files on jobs threads and returns how many failed.
+    int exportFiles(const QStringList &files, int jobs);
+
+    // True if the command line asks for an export rather than the editor.
+    static bool isBatchCommandLine(int argc, char *argv[]);
+    // Parses the command line, exports and returns the process exit code.
+    static int run(const QStringList &arguments);
+
+private:
+    struct Style {
+        QByteArray open;
+        QByteArray close;
+    };
+
+    bool exportFile(const QString &fileName, qint64 *bytesRead, QString *error) const;
+    QString outputFileName(const QString &fileName) const;
+    void appendText(QByteArray &out, QStringView text) const;
+
+    Format format;
+    QString outputDirectory;
+    // Indexed by HighlightLexer::TokenKind.
+    Style styles[HighlightLexer::tokenKindCount];
+};
+
+#endif // BATCHEXPORTER_H
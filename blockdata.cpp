@@ -0,0 +1,50 @@
+#include "blockdata.h"
+#include "completionindex.h"
+
+BlockData::~BlockData() {
+    for (quint32 id : std::as_const(ids))
+        index->release(id);
+}
+
+BlockData *BlockData::of(QTextBlock block) {
+    BlockData *data = static_cast<BlockData *>(block.userData());
+    if (!data) {
+        data = new BlockData;
+        block.setUserData(data);
+    }
+    return data;
+}
+
+const BlockData *BlockData::find(const QTextBlock &block) {
+    return static_cast<const BlockData *>(block.userData());
+}
+
+void BlockData::setWords(std::shared_ptr<CompletionIndex> index, QVector<quint32> ids) {
+    std::shared_ptr<CompletionIndex> oldIndex = std::move(this->index);
+    QVector<quint32> oldIds = std::move(this->ids);
+    this->index = std::move(index);
+    this->ids = std::move(ids);
+    for (quint32 id : std::as_const(oldIds))
+        oldIndex->release(id);
+}
+
+const CompletionIndex *BlockData::wordOwner() const {
+    return index.get();
+}
+
+const QVector<quint32> &BlockData::wordIds() const {
+    return ids;
+}
+
+void BlockData::setBrackets(QVector<Bracket> brackets, const Balances &balances) {
+    bracketList = std::move(brackets);
+    bracketBalances = balances;
+}
+
+const QVector<BlockData::Bracket> &BlockData::brackets() const {
+    return bracketList;
+}
+
+const BlockData::Balance &BlockData::balance(int pair) const {
+    return bracketBalances[pair];
+}
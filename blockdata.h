@@ -0,0 +1,62 @@
+#ifndef BLOCKDATA_H
+#define BLOCKDATA_H
+
+#include <QTextBlock>
+#include <QVector>
+#include <array>
+#include <memory>
+
+class CompletionIndex;
+
+// The one QTextBlockUserData a block can hold, shared by everything that
+// keeps per-block state: the word ids DocumentCompletion counted and the
+// brackets StructureIndex reads. Each side only replaces its own part.
+class BlockData : public QTextBlockUserData {
+public:
+    struct Bracket {
+        int column;
+        char16_t character;
+    };
+
+    // For one pair of brackets: the depth change over the line, counting
+    // openers up, and the lowest the depth goes below where it started
+    // when the line is read forwards, or backwards with closers counting
+    // up. A line that cannot reach zero from a depth can be stepped over.
+    struct Balance {
+        int net = 0;
+        int forwardLow = 0;
+        int backwardLow = 0;
+    };
+    typedef std::array<Balance, 3> Balances;
+
+    ~BlockData() override;
+
+    // The block's data, created when it has none yet.
+    static BlockData *of(QTextBlock block);
+    // The block's data, or nullptr.
+    static const BlockData *find(const QTextBlock &block);
+
+    // The ids this block contributed to index. The old ids are released
+    // after the new ones are stored, so words that stay on the line never
+    // drop out of the index.
+    void setWords(std::shared_ptr<CompletionIndex> index, QVector<quint32> ids);
+    const CompletionIndex *wordOwner() const;
+    const QVector<quint32> &wordIds() const;
+
+    // Brackets outside strings and comments, in column order, and their
+    // balance per pair as StructureIndex numbers the pairs.
+    void setBrackets(QVector<Bracket> brackets, const Balances &balances);
+    const QVector<Bracket> &brackets() const;
+    const Balance &balance(int pair) const;
+
+    // How many blocks after this one a fold hides; 0 when not folded.
+    int foldedBlocks = 0;
+
+private:
+    std::shared_ptr<CompletionIndex> index;
+    QVector<quint32> ids;
+    QVector<Bracket> bracketList;
+    Balances bracketBalances;
+};
+
+#endif // BLOCKDATA_H
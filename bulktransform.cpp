@@ -0,0 +1,201 @@
+#include "bulktransform.h"
+#include <QThread>
+
+// Characters per chunk handed to a worker.
+static const qint64 chunkSize = 1024 * 1024;
+
+namespace {
+
+bool isBlank(QChar c) {
+    return c == QLatin1Char(' ') || c == QLatin1Char('\t');
+}
+
+// Width in columns of leading whitespace, with tabs reaching the next stop.
+int indentWidth(QStringView indent, int tabWidth) {
+    int column = 0;
+    for (QChar c : indent)
+        column = c == QLatin1Char('\t') ? (column / tabWidth + 1) * tabWidth : column + 1;
+    return column;
+}
+
+} // namespace
+
+BulkTransform::BulkTransform(QObject *parent) : QObject(parent), generation(0) {
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+}
+
+BulkTransform::~BulkTransform() {
+    ++generation;
+    pool.clear();
+    pool.waitForDone();
+}
+
+bool BulkTransform::isRunning() const {
+    return running;
+}
+
+QVector<BulkTransform::Change> BulkTransform::changes() const {
+    return changeList;
+}
+
+int BulkTransform::changedLines() const {
+    return lineCount;
+}
+
+qint64 BulkTransform::elapsed() const {
+    return running ? timer.elapsed() : computeTime;
+}
+
+void BulkTransform::cancel() {
+    ++generation;
+    pool.clear();
+    if (!running)
+        return;
+    running = false;
+    results.clear();
+    emit finished(false);
+}
+
+bool BulkTransform::transformLine(QStringView line, Operation operation, int tabWidth, QString &result) {
+    switch (operation) {
+    case IndentWithSpaces:
+    case IndentWithTabs: {
+        qsizetype indentEnd = 0;
+        while (indentEnd < line.size() && isBlank(line.at(indentEnd)))
+            ++indentEnd;
+        // Trailing blanks on an otherwise empty line are not indentation.
+        if (indentEnd == 0 || indentEnd == line.size())
+            return false;
+        const int width = indentWidth(line.left(indentEnd), tabWidth);
+        const int tabs = operation == IndentWithTabs ? width / tabWidth : 0;
+        const QString indent = QString(tabs, QLatin1Char('\t')) + QString(width - tabs * tabWidth, QLatin1Char(' '));
+        if (line.left(indentEnd) == indent)
+            return false;
+        result = indent;
+        result.append(line.mid(indentEnd));
+        return true;
+    }
+    case TabsToSpaces: {
+        if (!line.contains(QLatin1Char('\t')))
+            return false;
+        result.clear();
+        result.reserve(line.size() + line.size() / 2);
+        int column = 0;
+        for (QChar c : line) {
+            if (c == QLatin1Char('\t')) {
+                const int spaces = tabWidth - column % tabWidth;
+                result.append(QString(spaces, QLatin1Char(' ')));
+                column += spaces;
+            } else {
+                result.append(c);
+                // A soft line break starts the columns again.
+                column = c == QChar::LineSeparator ? 0 : column + 1;
+            }
+        }
+        return true;
+    }
+    case TrimTrailingWhitespace: {
+        qsizetype end = line.size();
+        while (end > 0 && isBlank(line.at(end - 1)))
+            --end;
+        if (end == line.size())
+            return false;
+        result = line.left(end).toString();
+        return true;
+    }
+    }
+    return false;
+}
+
+BulkTransform::ChunkResult BulkTransform::transformChunk(QStringView text, Operation operation, int tabWidth) {
+    ChunkResult chunk;
+    QString line;
+    qsizetype start = 0;
+    for (int block = 0;; ++block) {
+        qsizetype end = text.indexOf(QChar::ParagraphSeparator, start);
+        if (end < 0)
+            end = text.size();
+
+        if (transformLine(text.mid(start, end - start), operation, tabWidth, line)) {
+            // Neighbouring lines share one change, so applying it is one
+            // replacement rather than one per line.
+            if (!chunk.changes.isEmpty()
+                && chunk.changes.last().firstBlock + chunk.changes.last().blockCount == block) {
+                Change &last = chunk.changes.last();
+                last.text += QLatin1Char('\n');
+                last.text += line;
+                ++last.blockCount;
+            } else {
+                chunk.changes.append({block, 1, line});
+            }
+        }
+
+        if (end == text.size()) {
+            chunk.blockCount = block + 1;
+            return chunk;
+        }
+        start = end + 1;
+    }
+}
+
+void BulkTransform::start(const QString &text, Operation operation, int tabWidth) {
+    cancel();
+
+    // Chunk ends are moved forward past the next block separator.
+    QVector<qint64> bounds = {0};
+    const QStringView view(text);
+    while (bounds.last() < text.size()) {
+        const qint64 nominal = bounds.last() + chunkSize;
+        const qint64 end = nominal < text.size() ? view.indexOf(QChar::ParagraphSeparator, nominal) : -1;
+        bounds.append(end < 0 ? text.size() : end + 1);
+    }
+    // An empty document is still one empty block.
+    if (bounds.size() == 1)
+        bounds.append(0);
+
+    const int count = int(bounds.size()) - 1;
+    results = QVector<ChunkResult>(count);
+    pendingChunks = count;
+    changeList.clear();
+    lineCount = 0;
+    computeTime = 0;
+    running = true;
+    timer.start();
+
+    const int transformGeneration = generation;
+    for (int chunk = 0; chunk < count; ++chunk) {
+        // The separator closing a chunk belongs to neither side.
+        const qint64 from = bounds.at(chunk);
+        const qint64 to = chunk + 1 < count ? bounds.at(chunk + 1) - 1 : text.size();
+        pool.start([this, text, from, to, chunk, operation, tabWidth, transformGeneration]() {
+            if (generation != transformGeneration)
+                return;
+            const ChunkResult result = transformChunk(QStringView(text).mid(from, to - from), operation, tabWidth);
+            QMetaObject::invokeMethod(this, [this, chunk, result, transformGeneration]() {
+                chunkFinished(chunk, result, transformGeneration);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void BulkTransform::chunkFinished(int chunk, const ChunkResult &result, int transformGeneration) {
+    if (transformGeneration != generation || !running)
+        return;
+    results[chunk] = result;
+    if (--pendingChunks > 0)
+        return;
+
+    int firstBlock = 0;
+    for (const ChunkResult &chunkResult : std::as_const(results)) {
+        for (Change change : chunkResult.changes) {
+            change.firstBlock += firstBlock;
+            lineCount += change.blockCount;
+            changeList.append(change);
+        }
+        firstBlock += chunkResult.blockCount;
+    }
+    results.clear();
+    running = false;
+    computeTime = timer.elapsed();
+    emit finished(true);
+}
@@ -0,0 +1,77 @@
+#ifndef BULKTRANSFORM_H
+#define BULKTRANSFORM_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QStringView>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+
+// Whole-document edits such as re-indenting or trimming trailing
+// whitespace, computed on a thread pool. The text is cut into chunks at
+// block boundaries and every line is rewritten independently. The result
+// lists only the runs of lines that changed, so applying it rewrites those
+// lines and nothing else.
+class BulkTransform : public QObject {
+    Q_OBJECT
+public:
+    enum Operation {
+        // Leading whitespace becomes spaces, or as many tabs as fit.
+        IndentWithSpaces,
+        IndentWithTabs,
+        // Every tab becomes spaces up to the next tab stop.
+        TabsToSpaces,
+        TrimTrailingWhitespace
+    };
+
+    // Consecutive changed blocks and their new text, joined by '\n'.
+    struct Change {
+        int firstBlock;
+        int blockCount;
+        QString text;
+    };
+
+    explicit BulkTransform(QObject *parent = nullptr);
+    ~BulkTransform();
+
+    // text is QTextDocument::toRawText(), with blocks separated by U+2029.
+    void start(const QString &text, Operation operation, int tabWidth);
+    bool isRunning() const;
+    // Valid once finished(true) has been emitted.
+    QVector<Change> changes() const;
+    int changedLines() const;
+    // Milliseconds spent computing the changes, so far or in total.
+    qint64 elapsed() const;
+
+    // Returns true and sets result when operation changes line.
+    static bool transformLine(QStringView line, Operation operation, int tabWidth, QString &result);
+
+public slots:
+    void cancel();
+
+signals:
+    void finished(bool completed);
+
+private:
+    // Block numbers are relative to the chunk until all chunks are in.
+    struct ChunkResult {
+        int blockCount = 0;
+        QVector<Change> changes;
+    };
+
+    static ChunkResult transformChunk(QStringView text, Operation operation, int tabWidth);
+    void chunkFinished(int chunk, const ChunkResult &result, int transformGeneration);
+
+    QThreadPool pool;
+    std::atomic<int> generation;
+    QVector<ChunkResult> results;
+    int pendingChunks = 0;
+    QVector<Change> changeList;
+    int lineCount = 0;
+    bool running = false;
+    QElapsedTimer timer;
+    qint64 computeTime = 0;
+};
+
+#endif // BULKTRANSFORM_H
@@ -0,0 +1,24 @@
+#include "codeedit.h"
+#include "texteditor.h"
+#include "tracing.h"
+#include <QKeyEvent>
+
+CodeEdit::CodeEdit(TextEditor *editor, QWidget *parent) : QTextEdit(parent), textEditor(editor) {}
+
+void CodeEdit::keyPressEvent(QKeyEvent *event) {
+    TRACE_SCOPE("keyPressEvent");
+    Tracing::inputReceived();
+    if (textEditor->isCompletionKey(event)) {
+        event->ignore(); // Let the completer do default behavior
+        return;
+    }
+    if (!TextEditor::isCompletionShortcut(event))
+        QTextEdit::keyPressEvent(event);
+    textEditor->updateCompletion(event);
+}
+
+void CodeEdit::paintEvent(QPaintEvent *event) {
+    TRACE_SCOPE("paintEvent");
+    QTextEdit::paintEvent(event);
+    Tracing::inputPainted();
+}
@@ -0,0 +1,23 @@
+#ifndef CODEEDIT_H
+#define CODEEDIT_H
+
+#include <QTextEdit>
+
+class TextEditor;
+
+// QTextEdit that lets TextEditor drive the completer. QCompleter hands keys
+// typed into its popup straight to the widget's event(), past any event
+// filter, so the hook has to live in keyPressEvent.
+class CodeEdit : public QTextEdit {
+public:
+    CodeEdit(TextEditor *editor, QWidget *parent = nullptr);
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    TextEditor *textEditor;
+};
+
+#endif // CODEEDIT_H
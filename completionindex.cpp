@@ -0,0 +1,138 @@
+#include "completionindex.h"
+#include <algorithm>
+
+// Shorter words are never worth completing to.
+static const int minWordLength = 3;
+// Upper bound on the matches ranked per lookup, which keeps short prefixes
+// over a very large index in the sub-millisecond range.
+static const int maxRankedMatches = 8192;
+
+static bool isIdentifierStart(QChar c) {
+    return c.isLetter() || c == QLatin1Char('_');
+}
+
+static bool isIdentifierPart(QChar c) {
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+void CompletionIndex::identifiers(QStringView text, QVector<QStringView> &words) {
+    const int length = int(text.size());
+    int i = 0;
+    while (i < length) {
+        if (!isIdentifierPart(text[i])) {
+            ++i;
+            continue;
+        }
+        const int start = i;
+        while (i < length && isIdentifierPart(text[i]))
+            ++i;
+        if (i - start >= minWordLength && isIdentifierStart(text[start]))
+            words.append(text.mid(start, i - start));
+    }
+}
+
+QString CompletionIndex::sortKey(const QString &word) {
+    // Folded spelling first so a prefix range is contiguous; the original
+    // spelling after a NUL keeps "Foo" and "foo" apart.
+    return word.toCaseFolded() + QChar(0) + word;
+}
+
+quint32 CompletionIndex::acquire(QStringView word) {
+    const QString text = word.toString();
+    const auto found = ids.constFind(text);
+    if (found != ids.constEnd()) {
+        ++entries[found.value()].count;
+        return found.value();
+    }
+
+    quint32 id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+        entries[id] = {text, 1, false};
+    } else {
+        id = quint32(entries.size());
+        entries.push_back({text, 1, false});
+    }
+    ids.insert(text, id);
+    sorted.emplace(sortKey(text), id);
+    return id;
+}
+
+void CompletionIndex::release(quint32 id) {
+    Entry &entry = entries[id];
+    if (--entry.count > 0 || entry.pinned)
+        return;
+    ids.remove(entry.text);
+    sorted.erase(sortKey(entry.text));
+    entry.text.clear();
+    freeIds.push_back(id);
+}
+
+void CompletionIndex::addPinned(const QStringList &words) {
+    for (const QString &word : words) {
+        const quint32 id = acquire(word);
+        entries[id].pinned = true;
+        --entries[id].count;
+    }
+}
+
+int CompletionIndex::wordCount() const {
+    return int(ids.size());
+}
+
+QStringList CompletionIndex::complete(QStringView prefix, const QHash<quint32, int> &nearby, int nearbyRadius, int limit) const {
+    struct Match {
+        qint64 score;
+        quint32 id;
+    };
+
+    const QString folded = prefix.toString().toCaseFolded();
+    std::vector<Match> matches;
+    const auto rank = [&](quint32 id) {
+        const Entry &entry = entries[id];
+        if (entry.text == prefix)
+            return;
+
+        // Frequency counts logarithmically so that a word used on the line
+        // above beats one that is merely common elsewhere in the file.
+        qint64 score = 0;
+        for (qint64 count = entry.count; count > 0; count >>= 1)
+            ++score;
+        const auto near = nearby.constFind(id);
+        if (near != nearby.constEnd())
+            score += 2 * (nearbyRadius - near.value()) + 64;
+        matches.push_back({score, id});
+    };
+
+    auto it = sorted.lower_bound(folded);
+    for (; it != sorted.end() && it->first.startsWith(folded); ++it) {
+        if (int(matches.size()) >= maxRankedMatches)
+            break;
+        rank(it->second);
+    }
+    // A walk cut short in alphabetical order would leave out nearby words
+    // that sort later, which rank highest of all, so those are added.
+    if (it != sorted.end() && it->first.startsWith(folded)) {
+        for (auto near = nearby.constBegin(); near != nearby.constEnd(); ++near) {
+            const Entry &entry = entries[near.key()];
+            if (!entry.text.isEmpty() && entry.text.toCaseFolded().startsWith(folded)
+                && sortKey(entry.text) >= it->first)
+                rank(near.key());
+        }
+    }
+
+    const auto better = [this](const Match &a, const Match &b) {
+        if (a.score != b.score)
+            return a.score > b.score;
+        return entries[a.id].text < entries[b.id].text;
+    };
+    const int count = qMin(limit, int(matches.size()));
+    std::partial_sort(matches.begin(), matches.begin() + count, matches.end(), better);
+
+    QStringList result;
+    result.reserve(count);
+    for (int i = 0; i < count; ++i)
+        result.append(entries[matches[i].id].text);
+    return result;
+}
@@ -0,0 +1,49 @@
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+#include <map>
+#include <vector>
+
+// Reference-counted set of the identifiers in a document. Every distinct word
+// is interned once and kept in a map ordered by its case-folded spelling, so
+// a prefix lookup is one lower_bound plus a walk over the matches.
+class CompletionIndex {
+public:
+    // Appends the identifiers found in text to words.
+    static void identifiers(QStringView text, QVector<QStringView> &words);
+
+    // Counts one more occurrence of word and returns its id.
+    quint32 acquire(QStringView word);
+    // Drops one occurrence; the word leaves the index when none are left.
+    void release(quint32 id);
+    // Words that stay in the index whatever the document contains.
+    void addPinned(const QStringList &words);
+
+    int wordCount() const;
+
+    // Words starting with prefix, case-insensitively, best first. Words in
+    // nearby map to their distance in lines from the cursor and rank higher
+    // the closer they are; otherwise more frequent words come first.
+    QStringList complete(QStringView prefix, const QHash<quint32, int> &nearby, int nearbyRadius, int limit) const;
+
+private:
+    struct Entry {
+        QString text;
+        qint64 count;
+        bool pinned;
+    };
+
+    static QString sortKey(const QString &word);
+
+    std::vector<Entry> entries;
+    std::vector<quint32> freeIds;
+    QHash<QString, quint32> ids;
+    std::map<QString, quint32> sorted;
+};
+
+#endif // COMPLETIONINDEX_H
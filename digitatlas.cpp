@@ -0,0 +1,65 @@
+#include "digitatlas.h"
+#include <QFontMetrics>
+#include <QPainter>
+#include <QPaintDevice>
+#include <QtMath>
+
+void DigitAtlas::setFont(const QFont &font) {
+    if (font == this->font)
+        return;
+    this->font = font;
+    atlas = QPixmap();
+}
+
+void DigitAtlas::setColor(const QColor &color) {
+    if (color == this->color)
+        return;
+    this->color = color;
+    atlas = QPixmap();
+}
+
+int DigitAtlas::digitWidth() const {
+    return cellWidth;
+}
+
+int DigitAtlas::digitHeight() const {
+    return cellHeight;
+}
+
+void DigitAtlas::ensureAtlas(qreal devicePixelRatio) {
+    if (!atlas.isNull() && atlas.devicePixelRatio() == devicePixelRatio)
+        return;
+
+    // Every digit gets a cell as wide as the widest one so numbers line up
+    // even in fonts without tabular figures.
+    const QFontMetrics metrics(font);
+    cellWidth = 0;
+    for (char digit = '0'; digit <= '9'; ++digit)
+        cellWidth = qMax(cellWidth, metrics.horizontalAdvance(QLatin1Char(digit)));
+    cellHeight = metrics.height();
+
+    atlas = QPixmap(qCeil(10 * cellWidth * devicePixelRatio), qCeil(cellHeight * devicePixelRatio));
+    atlas.setDevicePixelRatio(devicePixelRatio);
+    atlas.fill(Qt::transparent);
+
+    QPainter painter(&atlas);
+    painter.setFont(font);
+    painter.setPen(color);
+    for (int digit = 0; digit < 10; ++digit)
+        painter.drawText(QRect(digit * cellWidth, 0, cellWidth, cellHeight), Qt::AlignCenter,
+                         QString(QLatin1Char(char('0' + digit))));
+}
+
+void DigitAtlas::drawNumber(QPainter *painter, int right, int top, qint64 number) {
+    ensureAtlas(painter->device()->devicePixelRatioF());
+
+    const qreal ratio = atlas.devicePixelRatio();
+    int x = right;
+    do {
+        x -= cellWidth;
+        const int digit = int(number % 10);
+        painter->drawPixmap(QRectF(x, top, cellWidth, cellHeight), atlas,
+                            QRectF(digit * cellWidth * ratio, 0, cellWidth * ratio, cellHeight * ratio));
+        number /= 10;
+    } while (number > 0);
+}
@@ -0,0 +1,32 @@
+#ifndef DIGITATLAS_H
+#define DIGITATLAS_H
+
+#include <QColor>
+#include <QFont>
+#include <QPixmap>
+
+class QPainter;
+
+// The ten digits rendered once into a pixmap. Line numbers are drawn by
+// blitting cells from it instead of shaping a QString for every line.
+class DigitAtlas {
+public:
+    // Draws number right-aligned so that its last digit ends at right.
+    void drawNumber(QPainter *painter, int right, int top, qint64 number);
+    int digitWidth() const;
+    int digitHeight() const;
+
+    void setFont(const QFont &font);
+    void setColor(const QColor &color);
+
+private:
+    void ensureAtlas(qreal devicePixelRatio);
+
+    QFont font;
+    QColor color = Qt::black;
+    QPixmap atlas;
+    int cellWidth = 0;
+    int cellHeight = 0;
+};
+
+#endif // DIGITATLAS_H
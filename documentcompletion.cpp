@@ -0,0 +1,158 @@
+#include "documentcompletion.h"
+#include "blockdata.h"
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+
+// Lines above and below the cursor whose words rank as nearby.
+static const int proximityRadius = 50;
+
+DocumentCompletion::DocumentCompletion(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document), index(createIndex({})), generation(0) {
+    pool.setMaxThreadCount(1);
+    connect(document, &QTextDocument::contentsChange, this, &DocumentCompletion::onContentsChange);
+}
+
+DocumentCompletion::~DocumentCompletion() {
+    ++generation;
+    pool.waitForDone();
+}
+
+std::shared_ptr<CompletionIndex> DocumentCompletion::createIndex(const QStringList &pinned) {
+    std::shared_ptr<CompletionIndex> created = std::make_shared<CompletionIndex>();
+    created->addPinned(pinned);
+    return created;
+}
+
+void DocumentCompletion::setPinnedWords(const QStringList &words) {
+    pinnedWords = words;
+}
+
+void DocumentCompletion::setSuspended(bool suspended) {
+    this->suspended = suspended;
+    if (suspended) {
+        ++generation;
+        building = false;
+    }
+}
+
+bool DocumentCompletion::isReady() const {
+    return !suspended && !building;
+}
+
+void DocumentCompletion::rebuild() {
+    suspended = false;
+    building = true;
+    changeCountAtBuild = changeCount;
+    const int buildGeneration = ++generation;
+    // Raw text keeps U+2029 between blocks, so block numbers can be
+    // recovered on the worker without touching the document.
+    const QString snapshot = document->toRawText();
+    const QStringList pinned = pinnedWords;
+    pool.start([this, snapshot, pinned, buildGeneration]() { runBuild(snapshot, pinned, buildGeneration); });
+}
+
+void DocumentCompletion::runBuild(const QString &snapshot, const QStringList &pinned, int buildGeneration) {
+    Build build;
+    build.index = createIndex(pinned);
+
+    const QStringView text(snapshot);
+    QVector<QStringView> words;
+    qsizetype start = 0;
+    for (;;) {
+        if (generation != buildGeneration)
+            return;
+        qsizetype end = text.indexOf(QChar::ParagraphSeparator, start);
+        if (end < 0)
+            end = text.size();
+
+        words.clear();
+        CompletionIndex::identifiers(text.mid(start, end - start), words);
+        QVector<quint32> ids;
+        ids.reserve(words.size());
+        for (QStringView word : std::as_const(words))
+            ids.append(build.index->acquire(word));
+        build.blockIds.append(ids);
+
+        if (end == text.size())
+            break;
+        start = end + 1;
+    }
+
+    QMetaObject::invokeMethod(this, [this, build, buildGeneration]() {
+        installBuild(build, buildGeneration);
+    }, Qt::QueuedConnection);
+}
+
+void DocumentCompletion::installBuild(const Build &build, int buildGeneration) {
+    if (buildGeneration != generation)
+        return;
+    building = false;
+    if (changeCount != changeCountAtBuild || build.blockIds.size() != document->blockCount()) {
+        // Edited while the worker was busy; the snapshot is stale.
+        rebuild();
+        return;
+    }
+
+    // Replacing the word ids releases every word from the old index.
+    index = build.index;
+    int number = 0;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next())
+        BlockData::of(block)->setWords(index, build.blockIds.at(number++));
+}
+
+void DocumentCompletion::onContentsChange(int position, int charsRemoved, int charsAdded) {
+    Q_UNUSED(charsRemoved);
+    if (suspended || building) {
+        ++changeCount;
+        return;
+    }
+
+    // Removed blocks have already released their words; only the blocks
+    // that now cover the change need to be read again.
+    QTextBlock block = document->findBlock(position);
+    const QTextBlock last = document->findBlock(position + charsAdded);
+    QVector<QStringView> words;
+    while (block.isValid()) {
+        const QString text = block.text();
+        words.clear();
+        CompletionIndex::identifiers(text, words);
+        QVector<quint32> ids;
+        ids.reserve(words.size());
+        for (QStringView word : std::as_const(words))
+            ids.append(index->acquire(word));
+        BlockData::of(block)->setWords(index, ids);
+        if (block == last)
+            break;
+        block = block.next();
+    }
+}
+
+QStringList DocumentCompletion::complete(const QTextCursor &cursor, const QString &prefix, int limit) const {
+    QHash<quint32, int> nearby;
+    const auto collect = [this, &nearby](const QTextBlock &block, int distance) {
+        const BlockData *data = BlockData::find(block);
+        if (!data || data->wordOwner() != index.get())
+            return;
+        for (quint32 id : data->wordIds()) {
+            if (!nearby.contains(id))
+                nearby.insert(id, distance);
+        }
+    };
+
+    // Walk outwards from the cursor so each word keeps its smallest distance.
+    QTextBlock above = cursor.block();
+    QTextBlock below = above.next();
+    collect(above, 0);
+    for (int distance = 1; distance <= proximityRadius; ++distance) {
+        if (above.isValid())
+            above = above.previous();
+        if (above.isValid())
+            collect(above, distance);
+        if (below.isValid()) {
+            collect(below, distance);
+            below = below.next();
+        }
+    }
+    return index->complete(prefix, nearby, proximityRadius, limit);
+}
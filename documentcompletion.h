@@ -0,0 +1,59 @@
+#ifndef DOCUMENTCOMPLETION_H
+#define DOCUMENTCOMPLETION_H
+
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "completionindex.h"
+
+class QTextCursor;
+class QTextDocument;
+
+// Keeps a CompletionIndex in step with a QTextDocument. Each block remembers
+// the word ids it contributed, so contentsChange only re-reads the blocks it
+// touches and deleted blocks give their words back as they are destroyed.
+// The initial index for a loaded file is built on a worker thread.
+class DocumentCompletion : public QObject {
+    Q_OBJECT
+public:
+    DocumentCompletion(QTextDocument *document, QObject *parent = nullptr);
+    ~DocumentCompletion();
+
+    // While suspended, edits are not tracked; rebuild() catches up.
+    void setSuspended(bool suspended);
+    void rebuild();
+    bool isReady() const;
+    // Words offered before they appear in the text, such as the language's
+    // keywords. They take effect at the next rebuild().
+    void setPinnedWords(const QStringList &words);
+
+    QStringList complete(const QTextCursor &cursor, const QString &prefix, int limit) const;
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    struct Build {
+        std::shared_ptr<CompletionIndex> index;
+        QVector<QVector<quint32>> blockIds;
+    };
+
+    static std::shared_ptr<CompletionIndex> createIndex(const QStringList &pinned);
+    void runBuild(const QString &snapshot, const QStringList &pinned, int buildGeneration);
+    void installBuild(const Build &build, int buildGeneration);
+
+    QTextDocument *document;
+    std::shared_ptr<CompletionIndex> index;
+    QStringList pinnedWords;
+    QThreadPool pool;
+    std::atomic<int> generation;
+    int changeCount = 0;
+    int changeCountAtBuild = 0;
+    bool suspended = false;
+    bool building = false;
+};
+
+#endif // DOCUMENTCOMPLETION_H
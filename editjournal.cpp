@@ -0,0 +1,272 @@
+#include "editjournal.h"
+#include "tracing.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QtEndian>
+#include <vector>
+
+static const char journalMagic[] = "TEJ1";
+// Magic, base file size, base modification time.
+static const qint64 headerSize = 4 + 8 + 8;
+// Payload length and checksum in front of every batch.
+static const qint64 batchHeaderSize = 4 + 2;
+static const int flushInterval = 2000;
+
+static QByteArray journalHeader(const QString &fileName) {
+    const QFileInfo base(fileName);
+    QByteArray header(journalMagic, 4);
+    char field[8];
+    qToLittleEndian<quint64>(quint64(base.size()), field);
+    header.append(field, 8);
+    qToLittleEndian<qint64>(base.lastModified().toMSecsSinceEpoch(), field);
+    header.append(field, 8);
+    return header;
+}
+
+static void appendVarint(QByteArray &out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+static bool readVarint(const char *&p, const char *end, quint64 &value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uchar byte = uchar(*p++);
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+EditJournal::EditJournal(QTextDocument *document, QObject *parent) : QObject(parent), document(document) {
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(flushInterval);
+    connect(&flushTimer, &QTimer::timeout, this, &EditJournal::flush);
+}
+
+EditJournal::~EditJournal() {
+    // The document may already be gone, so only the file is touched here.
+    flush();
+    file.close();
+}
+
+QString EditJournal::journalFileName(const QString &fileName) {
+    const QFileInfo info(fileName);
+    return info.absolutePath() + "/." + info.fileName() + ".journal";
+}
+
+bool EditJournal::hasRecoverableChanges(const QString &fileName) {
+    QFile journal(journalFileName(fileName));
+    if (!journal.open(QIODevice::ReadOnly) || journal.size() <= headerSize)
+        return false;
+    return journal.read(headerSize) == journalHeader(fileName);
+}
+
+bool EditJournal::replay(const QString &fileName) {
+    if (!document) {
+        error = "No document to replay into";
+        return false;
+    }
+    QFile journal(journalFileName(fileName));
+    if (!journal.open(QIODevice::ReadOnly)) {
+        error = journal.errorString();
+        return false;
+    }
+    const QByteArray data = journal.readAll();
+    if (!data.startsWith(journalHeader(fileName))) {
+        error = "The journal was recorded against a different version of the file";
+        return false;
+    }
+
+    struct Record {
+        int position;
+        int removed;
+        QString text;
+    };
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    qint64 offset = headerSize;
+    while (offset + batchHeaderSize <= data.size()) {
+        const char *batch = data.constData() + offset;
+        const quint32 length = qFromLittleEndian<quint32>(batch);
+        const quint16 checksum = qFromLittleEndian<quint16>(batch + 4);
+        if (offset + batchHeaderSize + length > data.size())
+            break;
+        const char *p = batch + batchHeaderSize;
+        const char *end = p + length;
+        if (qChecksum(QByteArrayView(p, length)) != checksum)
+            break;
+
+        // A batch is applied whole or not at all, so the journal can be
+        // continued from exactly the point the document reached.
+        std::vector<Record> records;
+        bool valid = true;
+        while (valid && p < end) {
+            quint64 position, removed, bytes;
+            valid = readVarint(p, end, position) && readVarint(p, end, removed) && readVarint(p, end, bytes)
+                    && bytes <= quint64(end - p);
+            if (valid) {
+                records.push_back({int(position), int(removed), QString::fromUtf8(p, qsizetype(bytes))});
+                p += bytes;
+            }
+        }
+        if (!valid)
+            break;
+        for (const Record &record : records) {
+            if (record.position < 0 || record.removed < 0
+                || record.position + record.removed > document->characterCount() - 1) {
+                valid = false;
+                break;
+            }
+            cursor.setPosition(record.position);
+            cursor.setPosition(record.position + record.removed, QTextCursor::KeepAnchor);
+            cursor.insertText(record.text);
+        }
+        if (!valid)
+            break;
+        offset += batchHeaderSize + length;
+    }
+    cursor.endEditBlock();
+    replayedSize = offset;
+    return true;
+}
+
+bool EditJournal::start(const QString &fileName, bool keepExisting) {
+    stop();
+    if (!document) {
+        error = "No document to record";
+        return false;
+    }
+    error.clear();
+    file.setFileName(journalFileName(fileName));
+    baseHeader = journalHeader(fileName);
+    if (keepExisting && replayedSize > headerSize) {
+        // Continue after the last batch that replayed, dropping a torn tail.
+        if (!file.open(QIODevice::ReadWrite) || !file.resize(replayedSize) || !file.seek(replayedSize)) {
+            error = file.errorString();
+            file.close();
+            return false;
+        }
+    } else {
+        QFile::remove(file.fileName());
+    }
+    replayedSize = 0;
+    lastCharacterCount = document->characterCount();
+    connect(document, &QTextDocument::contentsChange, this, &EditJournal::onContentsChange, Qt::UniqueConnection);
+    active = true;
+    return true;
+}
+
+void EditJournal::stop() {
+    if (!active)
+        return;
+    flush();
+    flushTimer.stop();
+    file.close();
+    if (document)
+        disconnect(document, &QTextDocument::contentsChange, this, &EditJournal::onContentsChange);
+    active = false;
+}
+
+void EditJournal::setDocument(QTextDocument *document) {
+    flush();
+    if (active && this->document)
+        disconnect(this->document, &QTextDocument::contentsChange, this, &EditJournal::onContentsChange);
+    this->document = document;
+    if (active && document) {
+        lastCharacterCount = document->characterCount();
+        connect(document, &QTextDocument::contentsChange, this, &EditJournal::onContentsChange, Qt::UniqueConnection);
+    }
+}
+
+bool EditJournal::compact(const QString &fileName) {
+    const QString oldJournal = file.fileName();
+    stop();
+    pending.clear();
+    if (!oldJournal.isEmpty())
+        QFile::remove(oldJournal);
+    replayedSize = 0;
+    return start(fileName, false);
+}
+
+bool EditJournal::isActive() const {
+    return active;
+}
+
+QString EditJournal::errorString() const {
+    return error;
+}
+
+qint64 EditJournal::recordCount() const {
+    return records;
+}
+
+qint64 EditJournal::averageRecordNanoseconds() const {
+    return records > 0 ? recordNanoseconds / records : 0;
+}
+
+void EditJournal::flush() {
+    if (pending.isEmpty() || file.fileName().isEmpty())
+        return;
+    TRACE_SCOPE("journalFlush");
+    if (!file.isOpen()) {
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            error = file.errorString();
+            return;
+        }
+        file.write(baseHeader);
+    }
+
+    char batchHeader[batchHeaderSize];
+    qToLittleEndian<quint32>(quint32(pending.size()), batchHeader);
+    qToLittleEndian<quint16>(qChecksum(QByteArrayView(pending)), batchHeader + 4);
+    if (file.write(batchHeader, batchHeaderSize) != batchHeaderSize || file.write(pending) != pending.size()
+        || !file.flush())
+        error = file.errorString();
+    pending.clear();
+}
+
+void EditJournal::onContentsChange(int position, int charsRemoved, int charsAdded) {
+    Q_UNUSED(charsRemoved);
+    QElapsedTimer timer;
+    timer.start();
+
+    // Qt may report a wider range than was actually touched. Only the change
+    // in length is reliable, so the removed count is derived from it; the
+    // over-reported part is rewritten with the same text.
+    const int characterCount = document->characterCount();
+    const int added = qMin(charsAdded, characterCount - 1 - position);
+    const int removed = added - (characterCount - lastCharacterCount);
+    lastCharacterCount = characterCount;
+    if (position < 0 || added < 0 || removed < 0) {
+        // The journal can no longer be trusted to rebuild the document.
+        error = "Lost track of an edit; journaling stopped";
+        const QString journal = file.fileName();
+        stop();
+        QFile::remove(journal);
+        return;
+    }
+
+    QTextCursor cursor(document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + added, QTextCursor::KeepAnchor);
+    const QByteArray text = cursor.selectedText().toUtf8();
+
+    appendVarint(pending, quint64(position));
+    appendVarint(pending, quint64(removed));
+    appendVarint(pending, quint64(text.size()));
+    pending.append(text);
+    if (!flushTimer.isActive())
+        flushTimer.start();
+
+    ++records;
+    recordNanoseconds += timer.nsecsElapsed();
+}
@@ -0,0 +1,71 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QObject>
+#include <QTimer>
+
+class QTextDocument;
+
+// Append-only record of the edits made to a document since it was last
+// loaded or saved, kept next to the file as ".<name>.journal" and only
+// created once there is something to write. Each contentsChange becomes a
+// varint-encoded (position, removed, added text) record; records are
+// batched in memory and appended on a timer, each batch with its length and
+// checksum so a torn final write is simply ignored.
+// The header names the size and modification time of the file the edits
+// apply to, so a journal is never replayed over a different version.
+class EditJournal : public QObject {
+    Q_OBJECT
+public:
+    explicit EditJournal(QTextDocument *document, QObject *parent = nullptr);
+    ~EditJournal();
+
+    static QString journalFileName(const QString &fileName);
+    // True if fileName has a journal with edits recorded against its
+    // current contents on disk.
+    static bool hasRecoverableChanges(const QString &fileName);
+
+    // Applies the journal of fileName to the document, which must hold the
+    // file as loaded, as a single undoable edit.
+    bool replay(const QString &fileName);
+    // Starts recording edits against fileName. With keepExisting the
+    // replayed journal is continued, otherwise a new one replaces it.
+    bool start(const QString &fileName, bool keepExisting);
+    // Stops recording; recorded edits stay on disk for recovery.
+    void stop();
+    // After a save the file holds every edit, so the journal starts over
+    // against the saved file and the old one is dropped.
+    bool compact(const QString &fileName);
+    // Moves recording to another QTextDocument holding the same text, or
+    // pauses it with nullptr, without starting a new journal.
+    void setDocument(QTextDocument *document);
+
+    bool isActive() const;
+    QString errorString() const;
+    qint64 recordCount() const;
+    // Mean cost of turning one contentsChange into a record.
+    qint64 averageRecordNanoseconds() const;
+
+public slots:
+    void flush();
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    QTextDocument *document;
+    QFile file;
+    QByteArray baseHeader;
+    QByteArray pending;
+    QTimer flushTimer;
+    int lastCharacterCount = 0;
+    qint64 replayedSize = 0;
+    qint64 records = 0;
+    qint64 recordNanoseconds = 0;
+    bool active = false;
+    QString error;
+};
+
+#endif // EDITJOURNAL_H
@@ -0,0 +1,177 @@
+#include "editordocument.h"
+#include "documentcompletion.h"
+#include "editjournal.h"
+#include "filefollower.h"
+#include "fileloader.h"
+#include "languages.h"
+#include "structureindex.h"
+#include "syntaxhighlighter.h"
+#include <QFileInfo>
+#include <QTextDocument>
+
+// Approximate cost of one block beyond its text: the block itself, its
+// layout and highlighting formats, its completion word ids and brackets.
+static const qint64 blockOverhead = 200;
+
+EditorDocument::EditorDocument(const QString &fileName, QObject *parent)
+    : QObject(parent), name(fileName), editJournal(new EditJournal(nullptr, this)) {}
+
+EditorDocument::~EditorDocument() {
+    // The journal has to let go before the document it watches is deleted.
+    editJournal->setDocument(nullptr);
+    destroyDocument();
+}
+
+QString EditorDocument::fileName() const {
+    return name;
+}
+
+void EditorDocument::setFileName(const QString &fileName) {
+    if (name == fileName)
+        return;
+    name = fileName;
+    if (currentState == Loaded) {
+        applyLanguage();
+        documentCompletion->rebuild();
+    }
+}
+
+QString EditorDocument::displayName() const {
+    return name.isEmpty() ? QString("Untitled") : QFileInfo(name).fileName();
+}
+
+bool EditorDocument::isLarge() const {
+    return large;
+}
+
+void EditorDocument::setLarge(bool large) {
+    this->large = large;
+}
+
+EditorDocument::State EditorDocument::state() const {
+    return currentState;
+}
+
+bool EditorDocument::isModified() const {
+    switch (currentState) {
+    case Loaded:
+        return textDocument && textDocument->isModified();
+    case Hibernated:
+        // Unmodified documents are dropped rather than hibernated.
+        return true;
+    case Unloaded:
+        break;
+    }
+    return false;
+}
+
+qint64 EditorDocument::fileSize() const {
+    return knownFileSize;
+}
+
+void EditorDocument::setFileSize(qint64 size) {
+    knownFileSize = size;
+}
+
+qint64 EditorDocument::memoryEstimate() const {
+    if (currentState == Hibernated)
+        return hibernatedText.size();
+    if (!textDocument)
+        return 0;
+    return qint64(textDocument->characterCount()) * 2 + qint64(textDocument->blockCount()) * blockOverhead;
+}
+
+void EditorDocument::load() {
+    if (currentState == Loaded || large)
+        return;
+    textDocument = new QTextDocument(this);
+    syntaxHighlighter = new SyntaxHighlighter(textDocument);
+    documentStructure = new StructureIndex(textDocument, this);
+    fileLoader = new FileLoader(textDocument, this);
+    fileFollower = new FileFollower(textDocument, this);
+
+    if (currentState == Hibernated) {
+        // Rebuilt before the completion index and journal are attached, so
+        // neither sees the text arrive as an edit.
+        textDocument->setPlainText(QString::fromUtf8(qUncompress(hibernatedText)));
+        textDocument->setModified(true);
+        hibernatedText.clear();
+        hibernatedSize = 0;
+    }
+    documentCompletion = new DocumentCompletion(textDocument, this);
+    applyLanguage();
+    documentCompletion->rebuild();
+    editJournal->setDocument(textDocument);
+    currentState = Loaded;
+}
+
+void EditorDocument::applyLanguage() {
+    const std::shared_ptr<const HighlightLexer> lexer = Languages::forFile(name);
+    syntaxHighlighter->setLexer(lexer);
+    documentCompletion->setPinnedWords(lexer->keywordList());
+}
+
+bool EditorDocument::hibernate() {
+    if (currentState != Loaded || large || fileLoader->isLoading() || fileFollower->isFollowing())
+        return false;
+
+    editJournal->setDocument(nullptr);
+    if (textDocument->isModified() || (!name.isEmpty() && !QFileInfo::exists(name))) {
+        // Raw text keeps non-breaking spaces; setPlainText() splits the
+        // U+2029 block separators back into blocks.
+        const QByteArray text = textDocument->toRawText().toUtf8();
+        hibernatedSize = text.size();
+        hibernatedText = qCompress(text);
+        currentState = Hibernated;
+    } else {
+        // The file, or for an untouched new document nothing at all, is the
+        // copy; loading it again restarts the journal.
+        editJournal->stop();
+        currentState = Unloaded;
+    }
+    destroyDocument();
+    return true;
+}
+
+void EditorDocument::destroyDocument() {
+    delete documentCompletion;
+    documentCompletion = nullptr;
+    delete fileFollower;
+    fileFollower = nullptr;
+    delete fileLoader;
+    fileLoader = nullptr;
+    delete documentStructure;
+    documentStructure = nullptr;
+    delete syntaxHighlighter;
+    syntaxHighlighter = nullptr;
+    delete textDocument;
+    textDocument = nullptr;
+}
+
+QTextDocument *EditorDocument::document() const {
+    return textDocument;
+}
+
+SyntaxHighlighter *EditorDocument::highlighter() const {
+    return syntaxHighlighter;
+}
+
+StructureIndex *EditorDocument::structure() const {
+    return documentStructure;
+}
+
+DocumentCompletion *EditorDocument::completion() const {
+    return documentCompletion;
+}
+
+FileLoader *EditorDocument::loader() const {
+    return fileLoader;
+}
+
+FileFollower *EditorDocument::follower() const {
+    return fileFollower;
+}
+
+EditJournal *EditorDocument::journal() const {
+    return editJournal;
+}
@@ -0,0 +1,91 @@
+#ifndef EDITORDOCUMENT_H
+#define EDITORDOCUMENT_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+class DocumentCompletion;
+class EditJournal;
+class FileFollower;
+class FileLoader;
+class QTextDocument;
+class StructureIndex;
+class SyntaxHighlighter;
+
+// One open tab. The QTextDocument and the helpers bound to it exist only
+// while the document is loaded: a tab restored from a session starts out
+// unloaded, and an inactive tab can be hibernated, either dropped back to
+// its file when unmodified or kept as compressed text. The edit journal
+// outlives hibernation so recorded edits keep accumulating in one file.
+class EditorDocument : public QObject {
+    Q_OBJECT
+public:
+    enum State {
+        Unloaded,
+        Loaded,
+        Hibernated
+    };
+
+    explicit EditorDocument(const QString &fileName, QObject *parent = nullptr);
+    ~EditorDocument();
+
+    QString fileName() const;
+    void setFileName(const QString &fileName);
+    QString displayName() const;
+    // Files above the large-file threshold open in LargeFileViewer and never
+    // get a QTextDocument.
+    bool isLarge() const;
+    void setLarge(bool large);
+
+    State state() const;
+    bool isModified() const;
+    // Size of the file as last loaded into or saved from the document, so
+    // anything written to it since can be told apart; -1 if never.
+    qint64 fileSize() const;
+    void setFileSize(qint64 size);
+    // Rough bytes held by the text and its layout, or by the compressed copy.
+    qint64 memoryEstimate() const;
+
+    // Creates an empty QTextDocument with its highlighter, structure and
+    // completion indexes, loader and follower, or rebuilds it from the hibernated text.
+    void load();
+    // Releases the document; returns false if it cannot be released now,
+    // e.g. while it is loading or following its file.
+    bool hibernate();
+
+    QTextDocument *document() const;
+    SyntaxHighlighter *highlighter() const;
+    StructureIndex *structure() const;
+    DocumentCompletion *completion() const;
+    FileLoader *loader() const;
+    FileFollower *follower() const;
+    EditJournal *journal() const;
+
+    // Where the view was when the tab was last left.
+    int cursorPosition = 0;
+    int scrollPosition = 0;
+    // Activation order, for choosing what to hibernate first.
+    qint64 lastActivated = 0;
+
+private:
+    void destroyDocument();
+    // Highlighting and completion keywords follow the file name.
+    void applyLanguage();
+
+    QString name;
+    bool large = false;
+    State currentState = Unloaded;
+    QTextDocument *textDocument = nullptr;
+    SyntaxHighlighter *syntaxHighlighter = nullptr;
+    StructureIndex *documentStructure = nullptr;
+    DocumentCompletion *documentCompletion = nullptr;
+    FileLoader *fileLoader = nullptr;
+    FileFollower *fileFollower = nullptr;
+    EditJournal *editJournal;
+    QByteArray hibernatedText;
+    qint64 hibernatedSize = 0;
+    qint64 knownFileSize = -1;
+};
+
+#endif // EDITORDOCUMENT_H
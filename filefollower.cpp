@@ -0,0 +1,217 @@
+#include "filefollower.h"
+#include "tracing.h"
+#include <QFileInfo>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#if defined(Q_OS_UNIX)
+#include <sys/stat.h>
+#endif
+
+// Notifications arriving within this interval share one read.
+static const int coalesceInterval = 100;
+// Bytes appended per read; anything beyond is picked up by the next one, so
+// a burst never blocks the GUI thread for long.
+static const qint64 maxReadSize = 4 * 1024 * 1024;
+
+namespace {
+
+// Device and inode, so a rotated file can be told apart from one that was
+// truncated in place. Empty where the platform offers no such identity.
+QByteArray fileIdentity(const QString &fileName) {
+#if defined(Q_OS_UNIX)
+    struct stat info;
+    if (::stat(QFile::encodeName(fileName).constData(), &info) != 0)
+        return QByteArray();
+    return QByteArray::number(qulonglong(info.st_dev)) + ':' + QByteArray::number(qulonglong(info.st_ino));
+#else
+    Q_UNUSED(fileName);
+    return QByteArray();
+#endif
+}
+
+QByteArray openFileIdentity(const QFile &file) {
+#if defined(Q_OS_UNIX)
+    struct stat info;
+    if (file.handle() < 0 || ::fstat(file.handle(), &info) != 0)
+        return QByteArray();
+    return QByteArray::number(qulonglong(info.st_dev)) + ':' + QByteArray::number(qulonglong(info.st_ino));
+#else
+    Q_UNUSED(file);
+    return QByteArray();
+#endif
+}
+
+} // namespace
+
+FileFollower::FileFollower(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document) {
+    coalesceTimer.setSingleShot(true);
+    coalesceTimer.setInterval(coalesceInterval);
+    connect(&coalesceTimer, &QTimer::timeout, this, &FileFollower::readAppended);
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, &FileFollower::scheduleRead);
+    // The file itself stops being watched once it is renamed or deleted;
+    // its directory reports when a new one appears.
+    connect(&watcher, &QFileSystemWatcher::directoryChanged, this, &FileFollower::scheduleRead);
+}
+
+bool FileFollower::start(const QString &fileName, qint64 loadedBytes) {
+    stop();
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    error.clear();
+    this->fileName = fileName;
+    // A file now shorter than what was loaded is picked up as truncated.
+    offset = loadedBytes;
+    partialLine.clear();
+    following = true;
+    wholeFile = true;
+
+    // Appends are not edits; there is nothing to undo.
+    document->setUndoRedoEnabled(false);
+    watcher.addPath(fileName);
+    watcher.addPath(QFileInfo(fileName).absolutePath());
+    // Catch up with anything written since the file was loaded.
+    scheduleRead();
+    return true;
+}
+
+void FileFollower::stop() {
+    if (!following)
+        return;
+    following = false;
+    wholeFile = wholeFile && partialLine.isEmpty() && file.size() == offset;
+    coalesceTimer.stop();
+    if (!watcher.files().isEmpty())
+        watcher.removePaths(watcher.files());
+    if (!watcher.directories().isEmpty())
+        watcher.removePaths(watcher.directories());
+    file.close();
+    document->setUndoRedoEnabled(true);
+}
+
+bool FileFollower::isFollowing() const {
+    return following;
+}
+
+bool FileFollower::showsWholeFile() const {
+    return !following && wholeFile;
+}
+
+QString FileFollower::errorString() const {
+    return error;
+}
+
+void FileFollower::setMaxLines(int lines) {
+    lineLimit = qMax(0, lines);
+    if (following)
+        trim();
+}
+
+int FileFollower::maxLines() const {
+    return lineLimit;
+}
+
+void FileFollower::scheduleRead() {
+    // Not restarted while pending: a steady stream of writes still gets a
+    // read every interval instead of waiting for a pause.
+    if (following && !coalesceTimer.isActive())
+        coalesceTimer.start();
+}
+
+void FileFollower::readAppended() {
+    TRACE_SCOPE("followRead");
+    if (!following)
+        return;
+
+    const qint64 size = file.size();
+    if (size < offset) {
+        // Truncated in place, e.g. by copytruncate: what is there now is new.
+        offset = 0;
+        partialLine.clear();
+        wholeFile = false;
+        file.seek(0);
+        emit restarted(QFileInfo(fileName).fileName() + " was truncated");
+    }
+
+    if (size > offset) {
+        file.seek(offset);
+        const QByteArray data = file.read(qMin(size - offset, maxReadSize));
+        offset += data.size();
+        append(data);
+        if (offset < size) {
+            coalesceTimer.start(0);
+            return;
+        }
+    }
+
+    // The old file is drained, so a rotation can now be followed.
+    const QByteArray current = fileIdentity(fileName);
+    const QByteArray open = openFileIdentity(file);
+    if (!current.isEmpty() && !open.isEmpty() && current != open && switchToCurrentFile()) {
+        wholeFile = false;
+        emit restarted(QFileInfo(fileName).fileName() + " was rotated");
+        coalesceTimer.start(0);
+        return;
+    }
+    if (!watcher.files().contains(fileName) && QFileInfo::exists(fileName))
+        watcher.addPath(fileName);
+    coalesceTimer.setInterval(coalesceInterval);
+}
+
+bool FileFollower::switchToCurrentFile() {
+    QFile next(fileName);
+    if (!next.open(QIODevice::ReadOnly))
+        return false;
+    // A line the old file left unfinished ends with it.
+    if (!partialLine.isEmpty())
+        append(QByteArray("\n"));
+    file.close();
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    offset = 0;
+    partialLine.clear();
+    if (!watcher.files().isEmpty())
+        watcher.removePaths(watcher.files());
+    watcher.addPath(fileName);
+    return true;
+}
+
+void FileFollower::append(const QByteArray &data) {
+    // Only whole lines are shown; the rest waits for its newline.
+    partialLine += data;
+    const qsizetype end = partialLine.lastIndexOf('\n') + 1;
+    if (end == 0)
+        return;
+    QString text = QString::fromUtf8(partialLine.constData(), end);
+    partialLine.remove(0, end);
+    if (text.contains(QLatin1Char('\r')))
+        text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+
+    QTextCursor cursor(document);
+    cursor.movePosition(QTextCursor::End);
+    cursor.beginEditBlock();
+    cursor.insertText(text);
+    cursor.endEditBlock();
+    trim();
+    // The document still shows the file, so there is nothing to save.
+    document->setModified(false);
+    emit appended(int(text.count(QLatin1Char('\n'))));
+}
+
+void FileFollower::trim() {
+    // The empty block after the final newline does not count as a line.
+    const int excess = document->blockCount() - 1 - lineLimit;
+    if (lineLimit == 0 || excess <= 0)
+        return;
+    QTextCursor cursor(document);
+    cursor.setPosition(document->findBlockByNumber(excess).position(), QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+    document->setModified(false);
+    wholeFile = false;
+}
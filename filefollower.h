@@ -0,0 +1,65 @@
+#ifndef FILEFOLLOWER_H
+#define FILEFOLLOWER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QTimer>
+
+class QTextDocument;
+
+// Keeps a QTextDocument in step with a file that is being appended to, like
+// tail -F. Only the bytes added since the last read are read, and only whole
+// lines are appended, so the highlighter and the gutter only ever see new
+// blocks at the end. Change notifications are coalesced into at most one
+// read per interval however fast the file is written.
+// A truncated file is followed again from its start; after a rotation the
+// rest of the old file is drained before the new one is picked up. Either
+// way the lines already shown are kept.
+class FileFollower : public QObject {
+    Q_OBJECT
+public:
+    explicit FileFollower(QTextDocument *document, QObject *parent = nullptr);
+
+    // The document must hold the first loadedBytes bytes of fileName, as
+    // FileLoader read them; reading resumes from there.
+    bool start(const QString &fileName, qint64 loadedBytes);
+    void stop();
+    bool isFollowing() const;
+    // Once stopped: whether the document still holds exactly the file on
+    // disk, with no lines dropped, no restart and nothing left unread.
+    bool showsWholeFile() const;
+    QString errorString() const;
+
+    // The oldest lines are dropped beyond this many; 0 keeps them all.
+    void setMaxLines(int lines);
+    int maxLines() const;
+
+signals:
+    void appended(int lines);
+    void restarted(const QString &reason);
+
+private slots:
+    void scheduleRead();
+    void readAppended();
+
+private:
+    bool switchToCurrentFile();
+    void append(const QByteArray &data);
+    void trim();
+
+    QTextDocument *document;
+    QFileSystemWatcher watcher;
+    QTimer coalesceTimer;
+    QFile file;
+    QString fileName;
+    QByteArray partialLine;
+    qint64 offset = 0;
+    int lineLimit = 0;
+    bool following = false;
+    bool wholeFile = true;
+    QString error;
+};
+
+#endif // FILEFOLLOWER_H
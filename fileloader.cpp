@@ -0,0 +1,179 @@
+#include "fileloader.h"
+#include "tracing.h"
+#include <QFile>
+#include <QTextDocument>
+#include <QTextCursor>
+
+// The first chunk is small so the first screen shows up quickly; after that
+// larger chunks keep the number of document inserts down.
+static const qint64 firstChunkSize = 64 * 1024;
+static const qint64 chunkSize = 1024 * 1024;
+static const int maxChunksInFlight = 4;
+
+// Returns where to cut a chunk that does not end the file: after the last
+// newline if there is one, otherwise at a UTF-8 lead byte that does not split
+// a "\r\n" pair.
+static qint64 chunkSplitPoint(const uchar *data, qint64 length) {
+    for (qint64 i = length - 1; i >= 0; --i) {
+        if (data[i] == '\n')
+            return i + 1;
+    }
+    for (qint64 i = length - 1; i > 0; --i) {
+        if ((data[i] & 0xc0) != 0x80 && data[i - 1] != '\r')
+            return i;
+    }
+    return length;
+}
+
+FileLoader::FileLoader(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document), inFlight(maxChunksInFlight), generation(0) {
+    pool.setMaxThreadCount(1);
+}
+
+FileLoader::~FileLoader() {
+    ++generation;
+    pool.waitForDone();
+}
+
+bool FileLoader::load(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    totalBytes = file.size();
+    file.close();
+
+    const int loadGeneration = ++generation;
+    loading = true;
+    error.clear();
+
+    // Loading is not an edit the user should be able to undo.
+    document->setUndoRedoEnabled(false);
+    document->clear();
+
+    const qint64 fileSize = totalBytes;
+    pool.start([this, fileName, fileSize, loadGeneration]() {
+        readChunks(fileName, fileSize, loadGeneration);
+    });
+    return true;
+}
+
+bool FileLoader::isLoading() const {
+    return loading;
+}
+
+QString FileLoader::errorString() const {
+    return error;
+}
+
+qint64 FileLoader::loadedBytes() const {
+    return totalBytes;
+}
+
+void FileLoader::cancel() {
+    if (!loading)
+        return;
+    ++generation;
+    // A partial document must never be saved over the original.
+    document->clear();
+    finish(false);
+}
+
+void FileLoader::readChunks(const QString &fileName, qint64 fileSize, int loadGeneration) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fail(file.errorString(), loadGeneration);
+        return;
+    }
+
+    qint64 offset = 0;
+    bool firstChunk = true;
+    do {
+        const qint64 length = qMin(firstChunk ? firstChunkSize : chunkSize, fileSize - offset);
+        const qint64 readStart = Tracing::isEnabled() ? Tracing::now() : 0;
+
+        // Map one window at a time so only the current chunk is resident.
+        // Files that cannot be mapped are read the ordinary way.
+        QByteArray buffer;
+        uchar *mapped = length > 0 ? file.map(offset, length) : nullptr;
+        const uchar *data = mapped;
+        qint64 available = length;
+        if (!mapped && length > 0) {
+            if (!file.seek(offset)) {
+                fail(file.errorString(), loadGeneration);
+                return;
+            }
+            buffer = file.read(length);
+            if (buffer.size() != length) {
+                fail(file.errorString(), loadGeneration);
+                return;
+            }
+            data = reinterpret_cast<const uchar *>(buffer.constData());
+        }
+
+        qint64 begin = 0;
+        if (firstChunk && available >= 3 && data[0] == 0xef && data[1] == 0xbb && data[2] == 0xbf)
+            begin = 3;
+        const qint64 end = offset + length < fileSize ? chunkSplitPoint(data, available) : available;
+
+        QString text = QString::fromUtf8(reinterpret_cast<const char *>(data) + begin, end - begin);
+        if (mapped)
+            file.unmap(mapped);
+        if (text.contains(QLatin1Char('\r')))
+            text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+        if (readStart)
+            Tracing::record("readChunk", readStart, Tracing::now());
+
+        offset += end;
+        firstChunk = false;
+        const bool last = offset >= fileSize;
+
+        while (!inFlight.tryAcquire(1, 50)) {
+            if (generation.load(std::memory_order_relaxed) != loadGeneration)
+                return;
+        }
+        if (generation.load(std::memory_order_relaxed) != loadGeneration) {
+            inFlight.release();
+            return;
+        }
+        const qint64 bytesRead = offset;
+        QMetaObject::invokeMethod(this, [this, text, bytesRead, last, loadGeneration]() {
+            appendChunk(text, bytesRead, last, loadGeneration);
+        }, Qt::QueuedConnection);
+    } while (offset < fileSize);
+}
+
+void FileLoader::appendChunk(const QString &text, qint64 bytesRead, bool last, int loadGeneration) {
+    TRACE_SCOPE("appendChunk");
+    inFlight.release();
+    if (loadGeneration != generation.load())
+        return;
+
+    if (!text.isEmpty()) {
+        QTextCursor cursor(document);
+        cursor.movePosition(QTextCursor::End);
+        cursor.insertText(text);
+    }
+    emit progress(bytesRead, totalBytes);
+
+    if (last)
+        finish(true);
+}
+
+void FileLoader::fail(const QString &message, int loadGeneration) {
+    QMetaObject::invokeMethod(this, [this, message, loadGeneration]() {
+        if (loadGeneration != generation.load())
+            return;
+        error = message;
+        document->clear();
+        finish(false);
+    }, Qt::QueuedConnection);
+}
+
+void FileLoader::finish(bool completed) {
+    loading = false;
+    document->setUndoRedoEnabled(true);
+    document->setModified(false);
+    emit finished(completed);
+}
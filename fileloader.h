@@ -0,0 +1,50 @@
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include <QObject>
+#include <QSemaphore>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+
+class QTextDocument;
+
+// Loads a file into a QTextDocument without blocking the GUI thread. The file
+// is memory-mapped a window at a time and decoded on a worker thread; decoded
+// chunks are appended to the document as they arrive, so the first screen is
+// available long before the whole file has been read.
+class FileLoader : public QObject {
+    Q_OBJECT
+public:
+    explicit FileLoader(QTextDocument *document, QObject *parent = nullptr);
+    ~FileLoader();
+
+    bool load(const QString &fileName);
+    bool isLoading() const;
+    QString errorString() const;
+    // Bytes of the file the last load reads: its size when load() opened it.
+    qint64 loadedBytes() const;
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(qint64 bytesRead, qint64 totalBytes);
+    void finished(bool completed);
+
+private:
+    void readChunks(const QString &fileName, qint64 fileSize, int loadGeneration);
+    void appendChunk(const QString &text, qint64 bytesRead, bool last, int loadGeneration);
+    void fail(const QString &message, int loadGeneration);
+    void finish(bool completed);
+
+    QTextDocument *document;
+    QThreadPool pool;
+    QSemaphore inFlight;
+    std::atomic<int> generation;
+    qint64 totalBytes = 0;
+    bool loading = false;
+    QString error;
+};
+
+#endif // FILELOADER_H
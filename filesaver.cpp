@@ -0,0 +1,233 @@
+#include "filesaver.h"
+#include "piecetable.h"
+#include "tracing.h"
+#include <QSaveFile>
+#include <QTextDocument>
+
+// Encoded text per chunk, and chunks allowed between the GUI thread and the
+// writer at once. Together they bound the memory a save can take.
+static const qint64 chunkSize = 1024 * 1024;
+static const int maxChunksInFlight = 4;
+// Piece-table saves write large pieces in slices so progress and
+// cancellation stay responsive.
+static const qint64 pieceSliceSize = 4 * 1024 * 1024;
+
+FileSaver::FileSaver(QObject *parent) : QObject(parent), generation(0) {
+    pool.setMaxThreadCount(1);
+}
+
+FileSaver::~FileSaver() {
+    {
+        QMutexLocker locker(&mutex);
+        ++generation;
+        queueChanged.wakeAll();
+    }
+    pool.waitForDone();
+}
+
+bool FileSaver::isSaving() const {
+    return saving;
+}
+
+QString FileSaver::errorString() const {
+    return error;
+}
+
+qint64 FileSaver::bytesWritten() const {
+    return writtenBytes;
+}
+
+void FileSaver::begin(qint64 totalBytes) {
+    error.clear();
+    saving = true;
+    this->totalBytes = totalBytes;
+    writtenBytes = 0;
+    chunksInFlight = 0;
+    producing = false;
+    QMutexLocker locker(&mutex);
+    queue.clear();
+    endOfInput = false;
+}
+
+bool FileSaver::save(QTextDocument *document, const QString &fileName) {
+    if (saving) {
+        error = "A save is already in progress";
+        return false;
+    }
+    // Characters, not bytes; only used to scale the progress bar.
+    begin(document->characterCount());
+    nextBlock = document->begin();
+    int saveGeneration;
+    {
+        QMutexLocker locker(&mutex);
+        saveGeneration = ++generation;
+    }
+    pool.start([this, fileName, saveGeneration]() { writeQueuedChunks(fileName, saveGeneration); });
+    produceChunk(saveGeneration);
+    return true;
+}
+
+bool FileSaver::save(const std::shared_ptr<const PieceTable> &document, const QString &fileName) {
+    if (saving) {
+        error = "A save is already in progress";
+        return false;
+    }
+    begin(document->size());
+    nextBlock = QTextBlock();
+    int saveGeneration;
+    {
+        QMutexLocker locker(&mutex);
+        saveGeneration = ++generation;
+    }
+    pool.start([this, document, fileName, saveGeneration]() { writePieces(document, fileName, saveGeneration); });
+    return true;
+}
+
+void FileSaver::cancel() {
+    if (!saving)
+        return;
+    {
+        QMutexLocker locker(&mutex);
+        ++generation;
+        queue.clear();
+        queueChanged.wakeAll();
+    }
+    // The writer drops its QSaveFile without committing, which removes the
+    // temporary file and leaves the target untouched.
+    pool.waitForDone();
+    saving = false;
+    nextBlock = QTextBlock();
+    emit finished(false);
+}
+
+void FileSaver::produceChunk(int saveGeneration) {
+    TRACE_SCOPE("encodeChunk");
+    producing = false;
+    if (saveGeneration != generation || !nextBlock.isValid())
+        return;
+
+    // Same conversions as QTextDocument::toPlainText(), one block at a time.
+    QByteArray chunk;
+    chunk.reserve(chunkSize + 1024);
+    while (nextBlock.isValid() && chunk.size() < chunkSize) {
+        QString text = nextBlock.text();
+        text.replace(QChar::Nbsp, QLatin1Char(' '));
+        text.replace(QChar::LineSeparator, QLatin1Char('\n'));
+        chunk += text.toUtf8();
+        nextBlock = nextBlock.next();
+        if (nextBlock.isValid())
+            chunk += '\n';
+    }
+
+    ++chunksInFlight;
+    {
+        QMutexLocker locker(&mutex);
+        queue.enqueue(chunk);
+        endOfInput = !nextBlock.isValid();
+        queueChanged.wakeAll();
+    }
+
+    // One chunk per event loop pass keeps the GUI responsive.
+    if (nextBlock.isValid() && chunksInFlight < maxChunksInFlight) {
+        producing = true;
+        QMetaObject::invokeMethod(this, [this, saveGeneration]() { produceChunk(saveGeneration); }, Qt::QueuedConnection);
+    }
+}
+
+void FileSaver::writeQueuedChunks(const QString &fileName, int saveGeneration) {
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        const QString message = file.errorString();
+        QMetaObject::invokeMethod(this, [this, message, saveGeneration]() {
+            writerFinished(false, message, saveGeneration);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    for (;;) {
+        QByteArray chunk;
+        {
+            QMutexLocker locker(&mutex);
+            while (queue.isEmpty() && !endOfInput && generation == saveGeneration)
+                queueChanged.wait(&mutex);
+            if (generation != saveGeneration)
+                return;
+            if (queue.isEmpty())
+                break;
+            chunk = queue.dequeue();
+        }
+        TRACE_SCOPE("writeChunk");
+        if (file.write(chunk) != chunk.size()) {
+            const QString message = file.errorString();
+            QMetaObject::invokeMethod(this, [this, message, saveGeneration]() {
+                writerFinished(false, message, saveGeneration);
+            }, Qt::QueuedConnection);
+            return;
+        }
+        const qint64 bytes = chunk.size();
+        QMetaObject::invokeMethod(this, [this, bytes, saveGeneration]() {
+            chunkWritten(bytes, saveGeneration);
+        }, Qt::QueuedConnection);
+    }
+
+    // commit() flushes, syncs the temporary file to disk and renames it.
+    const qint64 commitStart = Tracing::isEnabled() ? Tracing::now() : 0;
+    const bool committed = file.commit();
+    if (commitStart)
+        Tracing::record("commit", commitStart, Tracing::now());
+    const QString message = committed ? QString() : file.errorString();
+    QMetaObject::invokeMethod(this, [this, committed, message, saveGeneration]() {
+        writerFinished(committed, message, saveGeneration);
+    }, Qt::QueuedConnection);
+}
+
+void FileSaver::writePieces(const std::shared_ptr<const PieceTable> &document, const QString &fileName, int saveGeneration) {
+    QSaveFile file(fileName);
+    bool ok = file.open(QIODevice::WriteOnly);
+    if (ok) {
+        ok = document->forEachPiece([this, &file, saveGeneration](const char *data, qint64 length) {
+            for (qint64 offset = 0; offset < length; offset += pieceSliceSize) {
+                if (generation != saveGeneration)
+                    return false;
+                const qint64 bytes = qMin(pieceSliceSize, length - offset);
+                TRACE_SCOPE("writeChunk");
+                if (file.write(data + offset, bytes) != bytes)
+                    return false;
+                QMetaObject::invokeMethod(this, [this, bytes, saveGeneration]() {
+                    chunkWritten(bytes, saveGeneration);
+                }, Qt::QueuedConnection);
+            }
+            return true;
+        });
+    }
+    if (generation != saveGeneration)
+        return;
+
+    const bool committed = ok && file.commit();
+    const QString message = committed ? QString() : file.errorString();
+    QMetaObject::invokeMethod(this, [this, committed, message, saveGeneration]() {
+        writerFinished(committed, message, saveGeneration);
+    }, Qt::QueuedConnection);
+}
+
+void FileSaver::chunkWritten(qint64 bytes, int saveGeneration) {
+    if (saveGeneration != generation)
+        return;
+    writtenBytes += bytes;
+    emit progress(qMin(writtenBytes, totalBytes), totalBytes);
+
+    if (nextBlock.isValid()) {
+        --chunksInFlight;
+        if (!producing)
+            produceChunk(saveGeneration);
+    }
+}
+
+void FileSaver::writerFinished(bool committed, const QString &message, int saveGeneration) {
+    if (saveGeneration != generation)
+        return;
+    saving = false;
+    nextBlock = QTextBlock();
+    error = message;
+    emit finished(committed);
+}
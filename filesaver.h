@@ -0,0 +1,68 @@
+#ifndef FILESAVER_H
+#define FILESAVER_H
+
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QTextBlock>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <atomic>
+#include <memory>
+
+class PieceTable;
+class QTextDocument;
+
+// Saves without blocking the GUI thread and without ever holding the whole
+// text in memory. Output goes through QSaveFile, which writes a temporary
+// file, syncs it to disk and renames it over the target, so a crash leaves
+// either the old file or the new one. The caller keeps the document
+// read-only until finished() so that it acts as its own snapshot.
+class FileSaver : public QObject {
+    Q_OBJECT
+public:
+    explicit FileSaver(QObject *parent = nullptr);
+    ~FileSaver();
+
+    // QTextDocument blocks are encoded on the GUI thread one chunk per event
+    // loop pass and handed to the writer thread through a short queue.
+    bool save(QTextDocument *document, const QString &fileName);
+    // Pieces are written straight from the table on the writer thread.
+    bool save(const std::shared_ptr<const PieceTable> &document, const QString &fileName);
+
+    bool isSaving() const;
+    QString errorString() const;
+    qint64 bytesWritten() const;
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(qint64 bytesWritten, qint64 totalBytes);
+    void finished(bool completed);
+
+private:
+    void begin(qint64 totalBytes);
+    void produceChunk(int saveGeneration);
+    void writeQueuedChunks(const QString &fileName, int saveGeneration);
+    void writePieces(const std::shared_ptr<const PieceTable> &document, const QString &fileName, int saveGeneration);
+    void chunkWritten(qint64 bytes, int saveGeneration);
+    void writerFinished(bool committed, const QString &message, int saveGeneration);
+
+    QThreadPool pool;
+    std::atomic<int> generation;
+    QMutex mutex;
+    QWaitCondition queueChanged;
+    QQueue<QByteArray> queue;
+    bool endOfInput = false;
+    int chunksInFlight = 0;
+    bool producing = false;
+    QTextBlock nextBlock;
+    qint64 totalBytes = 0;
+    qint64 writtenBytes = 0;
+    bool saving = false;
+    QString error;
+};
+
+#endif // FILESAVER_H
@@ -0,0 +1,132 @@
+#include "findpanel.h"
+#include <QAbstractListModel>
+#include <QCheckBox>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListView>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+class SearchHitModel : public QAbstractListModel {
+public:
+    explicit SearchHitModel(QObject *parent) : QAbstractListModel(parent) {}
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override {
+        return parent.isValid() ? 0 : int(hits.size());
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override {
+        if (role != Qt::DisplayRole || !index.isValid() || !describe)
+            return QVariant();
+        return describe(hits.at(index.row()));
+    }
+
+    void append(const QVector<SearchHit> &more) {
+        beginInsertRows(QModelIndex(), int(hits.size()), int(hits.size() + more.size()) - 1);
+        hits += more;
+        endInsertRows();
+    }
+
+    void clear() {
+        beginResetModel();
+        hits.clear();
+        endResetModel();
+    }
+
+    QVector<SearchHit> hits;
+    std::function<QString(const SearchHit &)> describe;
+};
+
+FindPanel::FindPanel(QWidget *parent) : QWidget(parent) {
+    findEdit = new QLineEdit(this);
+    replaceEdit = new QLineEdit(this);
+    regexBox = new QCheckBox("Regular expression", this);
+    caseBox = new QCheckBox("Match case", this);
+    caseBox->setChecked(true);
+    findButton = new QPushButton("Find All", this);
+    replaceButton = new QPushButton("Replace All", this);
+    stopButton = new QPushButton("Stop", this);
+    stopButton->setEnabled(false);
+    statusLabel = new QLabel(this);
+
+    hitModel = new SearchHitModel(this);
+    hitView = new QListView(this);
+    hitView->setModel(hitModel);
+    // Rows are never measured one by one, so millions of hits stay cheap.
+    hitView->setUniformItemSizes(true);
+
+    QGridLayout *fields = new QGridLayout;
+    fields->addWidget(new QLabel("Find:", this), 0, 0);
+    fields->addWidget(findEdit, 0, 1);
+    fields->addWidget(findButton, 0, 2);
+    fields->addWidget(new QLabel("Replace:", this), 1, 0);
+    fields->addWidget(replaceEdit, 1, 1);
+    fields->addWidget(replaceButton, 1, 2);
+
+    QHBoxLayout *flags = new QHBoxLayout;
+    flags->addWidget(regexBox);
+    flags->addWidget(caseBox);
+    flags->addWidget(statusLabel, 1);
+    flags->addWidget(stopButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(fields);
+    layout->addLayout(flags);
+    layout->addWidget(hitView, 1);
+
+    connect(findEdit, &QLineEdit::returnPressed, this, &FindPanel::findAllRequested);
+    connect(findButton, &QPushButton::clicked, this, &FindPanel::findAllRequested);
+    connect(replaceButton, &QPushButton::clicked, this, &FindPanel::replaceAllRequested);
+    connect(stopButton, &QPushButton::clicked, this, &FindPanel::stopRequested);
+    connect(hitView, &QListView::activated, this, &FindPanel::activateHit);
+    connect(hitView, &QListView::clicked, this, &FindPanel::activateHit);
+}
+
+SearchOptions FindPanel::options() const {
+    SearchOptions options;
+    options.pattern = findEdit->text();
+    options.regularExpression = regexBox->isChecked();
+    options.caseSensitive = caseBox->isChecked();
+    options.replacement = replaceEdit->text();
+    return options;
+}
+
+void FindPanel::setDescriber(const std::function<QString(const SearchHit &)> &describe) {
+    hitModel->describe = describe;
+}
+
+const QVector<SearchHit> &FindPanel::hits() const {
+    return hitModel->hits;
+}
+
+void FindPanel::clearHits() {
+    hitModel->clear();
+}
+
+void FindPanel::addHits(const QVector<SearchHit> &hits) {
+    hitModel->append(hits);
+}
+
+void FindPanel::setSearching(bool searching) {
+    findButton->setEnabled(!searching);
+    replaceButton->setEnabled(!searching);
+    stopButton->setEnabled(searching);
+}
+
+void FindPanel::setStatus(const QString &status) {
+    statusLabel->setText(status);
+}
+
+void FindPanel::focusFind() {
+    findEdit->setFocus();
+    findEdit->selectAll();
+}
+
+void FindPanel::activateHit(const QModelIndex &index) {
+    if (!index.isValid())
+        return;
+    const SearchHit &hit = hitModel->hits.at(index.row());
+    emit hitActivated(hit.position, hit.length);
+}
@@ -0,0 +1,57 @@
+#ifndef FINDPANEL_H
+#define FINDPANEL_H
+
+#include <QWidget>
+#include <functional>
+#include "searchengine.h"
+
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QListView;
+class QModelIndex;
+class QPushButton;
+class SearchHitModel;
+
+// Find/Replace controls and the list of hits. Hits are appended as the
+// search streams them in; their text is only produced for rows on screen,
+// through the describer set by the owner.
+class FindPanel : public QWidget {
+    Q_OBJECT
+public:
+    explicit FindPanel(QWidget *parent = nullptr);
+
+    SearchOptions options() const;
+    void setDescriber(const std::function<QString(const SearchHit &)> &describe);
+    const QVector<SearchHit> &hits() const;
+    void clearHits();
+    void setSearching(bool searching);
+    void setStatus(const QString &status);
+
+public slots:
+    void addHits(const QVector<SearchHit> &hits);
+    void focusFind();
+
+signals:
+    void findAllRequested();
+    void replaceAllRequested();
+    void stopRequested();
+    void hitActivated(qint64 position, qint64 length);
+
+private slots:
+    void activateHit(const QModelIndex &index);
+
+private:
+    QLineEdit *findEdit;
+    QLineEdit *replaceEdit;
+    QCheckBox *regexBox;
+    QCheckBox *caseBox;
+    QPushButton *findButton;
+    QPushButton *replaceButton;
+    QPushButton *stopButton;
+    QLabel *statusLabel;
+    QListView *hitView;
+    SearchHitModel *hitModel;
+};
+
+#endif // FINDPANEL_H
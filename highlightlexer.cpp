@@ -0,0 +1,280 @@
+#include "highlightlexer.h"
+#include <QDataStream>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+
+const char *const kindNames[HighlightLexer::tokenKindCount] = {
+    "keyword", "class", "function", "comment", "multiLineComment",
+    "string", "number", "key", "error", "warning"
+};
+
+// Returns -1 for an omitted kind (plain text) and -2 for an unknown one.
+int kindFromName(const QJsonValue &value) {
+    if (value.isUndefined() || value.isNull())
+        return -1;
+    const QString name = value.toString();
+    for (int kind = 0; kind < HighlightLexer::tokenKindCount; ++kind) {
+        if (name == QLatin1String(kindNames[kind]))
+            return kind;
+    }
+    return -2;
+}
+
+QString escapedLiteral(const QString &word) {
+    QString pattern;
+    for (const QChar c : word) {
+        if (!c.isLetterOrNumber() && c != '_')
+            pattern += '\\';
+        pattern += c;
+    }
+    return pattern;
+}
+
+bool isAnchored(const QString &pattern) {
+    return pattern.startsWith('^');
+}
+
+} // namespace
+
+std::shared_ptr<const HighlightLexer> HighlightLexer::compile(const QByteArray &definition, QString *error) {
+    QJsonParseError parseError;
+    const QJsonDocument json = QJsonDocument::fromJson(definition, &parseError);
+    if (!json.isObject()) {
+        *error = parseError.error != QJsonParseError::NoError ? parseError.errorString() : "not a JSON object";
+        return nullptr;
+    }
+    const QJsonObject root = json.object();
+
+    std::shared_ptr<HighlightLexer> lexer(new HighlightLexer);
+    lexer->languageName = root.value("name").toString();
+    if (lexer->languageName.isEmpty()) {
+        *error = "missing \"name\"";
+        return nullptr;
+    }
+    for (const QJsonValue &extension : root.value("extensions").toArray())
+        lexer->fileExtensions.append(extension.toString().toLower());
+    lexer->firstLine = root.value("firstLine").toString();
+
+    QStringList patterns;
+    auto addRule = [&](const QString &pattern, const Rule &rule) {
+        patterns.append(pattern);
+        lexer->rules.append(rule);
+    };
+
+    // Keywords go first so they win a tie with a general word rule.
+    const QJsonObject keywords = root.value("keywords").toObject();
+    for (auto it = keywords.constBegin(); it != keywords.constEnd(); ++it) {
+        const int kind = kindFromName(it.key());
+        if (kind < 0) {
+            *error = QString("unknown token kind \"%1\"").arg(it.key());
+            return nullptr;
+        }
+        for (const QJsonValue &word : it.value().toArray()) {
+            lexer->keywords.append(word.toString());
+            addRule(escapedLiteral(word.toString()), {kind, kind, 0, -1});
+        }
+    }
+
+    const QJsonArray rules = root.value("rules").toArray();
+    for (int i = 0; i < rules.size(); ++i) {
+        const QJsonObject rule = rules.at(i).toObject();
+        const int kind = kindFromName(rule.value("kind"));
+        const int followedKind = rule.contains("followedKind") ? kindFromName(rule.value("followedKind")) : kind;
+        const QString followedBy = rule.value("followedBy").toString();
+        if (kind == -2 || followedKind == -2 || followedBy.size() > 1) {
+            *error = QString("rule %1: bad \"kind\", \"followedKind\" or \"followedBy\"").arg(i);
+            return nullptr;
+        }
+        const char16_t follower = followedBy.isEmpty() ? 0 : followedBy.at(0).unicode();
+
+        if (rule.contains("begin")) {
+            const QString end = rule.value("end").toString();
+            Region region{kind, RegexDfa()};
+            QString dfaError;
+            if (isAnchored(end) || !region.end.compile({end}, &dfaError)) {
+                *error = QString("rule %1: bad \"end\": %2").arg(i).arg(dfaError.isEmpty() ? "anchored" : dfaError);
+                return nullptr;
+            }
+            lexer->regions.append(region);
+            addRule(rule.value("begin").toString(), {kind, kind, 0, int(lexer->regions.size()) - 1});
+        } else if (rule.contains("match")) {
+            addRule(rule.value("match").toString(), {kind, followedKind, follower, -1});
+        } else {
+            *error = QString("rule %1: needs \"match\" or \"begin\"").arg(i);
+            return nullptr;
+        }
+    }
+
+    // Without this a keyword would also match inside a longer word.
+    if (!lexer->keywords.isEmpty())
+        addRule("\\w+", {-1, -1, 0, -1});
+
+    QStringList unanchored;
+    for (int i = 0; i < patterns.size(); ++i) {
+        if (isAnchored(patterns.at(i))) {
+            patterns[i].remove(0, 1);
+        } else {
+            unanchored.append(patterns.at(i));
+            lexer->anywhereRules.append(i);
+        }
+    }
+    QString dfaError;
+    if (!lexer->lineStart.compile(patterns, &dfaError) || !lexer->anywhere.compile(unanchored, &dfaError)) {
+        *error = dfaError;
+        return nullptr;
+    }
+    return lexer;
+}
+
+std::shared_ptr<const HighlightLexer> HighlightLexer::plainText() {
+    static const std::shared_ptr<const HighlightLexer> lexer = [] {
+        std::shared_ptr<HighlightLexer> created(new HighlightLexer);
+        created->languageName = "Plain Text";
+        return created;
+    }();
+    return lexer;
+}
+
+void HighlightLexer::applyRule(const Rule &rule, const QChar *text, int length, int start, int end,
+                               QVector<Token> &tokens, int *next, int *state) const {
+    if (rule.region >= 0) {
+        const Region &region = regions.at(rule.region);
+        int regionEnd = 0;
+        if (region.end.find(text, length, end, &regionEnd) < 0) {
+            if (region.kind >= 0)
+                tokens.append({start, length - start, TokenKind(region.kind)});
+            *next = length;
+            *state = rule.region + 1;
+            return;
+        }
+        end = regionEnd;
+    }
+    int kind = rule.kind;
+    if (rule.followedBy && end < length && text[end].unicode() == rule.followedBy)
+        kind = rule.followedKind;
+    if (kind >= 0)
+        tokens.append({start, end - start, TokenKind(kind)});
+    *next = end;
+}
+
+int HighlightLexer::tokenize(QStringView text, int previousState, QVector<Token> &tokens) const {
+    const QChar *data = text.data();
+    const int length = int(text.size());
+    int i = 0;
+
+    if (previousState > 0 && previousState <= regions.size()) {
+        const Region &region = regions.at(previousState - 1);
+        int end = 0;
+        if (region.end.find(data, length, 0, &end) < 0) {
+            if (region.kind >= 0)
+                tokens.append({0, length, TokenKind(region.kind)});
+            return previousState;
+        }
+        if (region.kind >= 0)
+            tokens.append({0, end, TokenKind(region.kind)});
+        i = end;
+    }
+
+    int state = NormalState;
+    if (i == 0 && length > 0) {
+        int end = 0;
+        const int rule = lineStart.match(data, length, 0, &end);
+        if (rule >= 0)
+            applyRule(rules.at(rule), data, length, 0, end, tokens, &i, &state);
+    }
+    while (i < length && state == NormalState) {
+        int end = 0;
+        int pattern = 0;
+        const int start = anywhere.find(data, length, i, &end, &pattern);
+        if (start < 0)
+            break;
+        applyRule(rules.at(anywhereRules.at(pattern)), data, length, start, end, tokens, &i, &state);
+    }
+    return state;
+}
+
+QString HighlightLexer::name() const {
+    return languageName;
+}
+
+QStringList HighlightLexer::extensions() const {
+    return fileExtensions;
+}
+
+QString HighlightLexer::firstLinePattern() const {
+    return firstLine;
+}
+
+QStringList HighlightLexer::keywordList() const {
+    return keywords;
+}
+
+void HighlightLexer::write(QDataStream &stream) const {
+    stream << languageName << fileExtensions << firstLine << keywords;
+    stream << qint32(rules.size());
+    for (const Rule &rule : rules)
+        stream << qint32(rule.kind) << qint32(rule.followedKind) << quint16(rule.followedBy) << qint32(rule.region);
+    stream << qint32(regions.size());
+    for (const Region &region : regions) {
+        stream << qint32(region.kind);
+        region.end.write(stream);
+    }
+    lineStart.write(stream);
+    anywhere.write(stream);
+    stream << anywhereRules;
+}
+
+std::shared_ptr<const HighlightLexer> HighlightLexer::read(QDataStream &stream) {
+    std::shared_ptr<HighlightLexer> lexer(new HighlightLexer);
+    stream >> lexer->languageName >> lexer->fileExtensions >> lexer->firstLine >> lexer->keywords;
+
+    qint32 ruleCount = 0;
+    stream >> ruleCount;
+    if (ruleCount < 0 || stream.status() != QDataStream::Ok)
+        return nullptr;
+    for (int i = 0; i < ruleCount && stream.status() == QDataStream::Ok; ++i) {
+        qint32 kind, followedKind, region;
+        quint16 followedBy;
+        stream >> kind >> followedKind >> followedBy >> region;
+        lexer->rules.append({kind, followedKind, followedBy, region});
+    }
+    qint32 regionCount = 0;
+    stream >> regionCount;
+    if (regionCount < 0 || stream.status() != QDataStream::Ok)
+        return nullptr;
+    for (int i = 0; i < regionCount; ++i) {
+        qint32 kind = 0;
+        stream >> kind;
+        Region region{kind, RegexDfa()};
+        if (!region.end.read(stream))
+            return nullptr;
+        lexer->regions.append(region);
+    }
+    if (!lexer->lineStart.read(stream) || !lexer->anywhere.read(stream))
+        return nullptr;
+    stream >> lexer->anywhereRules;
+    if (stream.status() != QDataStream::Ok)
+        return nullptr;
+
+    // The automata only hand out rule numbers they were built with, but a
+    // damaged cache must still not send tokenize() out of bounds.
+    auto validKind = [](int kind) { return kind >= -1 && kind < tokenKindCount; };
+    for (const Rule &rule : std::as_const(lexer->rules)) {
+        if (!validKind(rule.kind) || !validKind(rule.followedKind) || rule.region < -1 || rule.region >= regionCount)
+            return nullptr;
+    }
+    for (const Region &region : std::as_const(lexer->regions)) {
+        if (!validKind(region.kind))
+            return nullptr;
+    }
+    for (int rule : std::as_const(lexer->anywhereRules)) {
+        if (rule < 0 || rule >= ruleCount)
+            return nullptr;
+    }
+    if (lexer->lineStart.patternCount() > ruleCount || lexer->anywhere.patternCount() > lexer->anywhereRules.size())
+        return nullptr;
+    return lexer;
+}
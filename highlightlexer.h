@@ -0,0 +1,94 @@
+#ifndef HIGHLIGHTLEXER_H
+#define HIGHLIGHTLEXER_H
+
+#include <QByteArray>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+#include <memory>
+#include "regexdfa.h"
+
+class QDataStream;
+
+// Tokenizer for one language, compiled from a JSON definition (see
+// languages/*.json). Every rule that may start a token goes into a single
+// RegexDfa, so a line is lexed in one forward pass however many rules the
+// language has. Rules with "begin"/"end" open a region that may span lines;
+// region r is carried to the next block as state r + 1.
+// A compiled lexer is immutable and shared, so it can be called for any
+// block from any thread.
+class HighlightLexer {
+public:
+    enum TokenKind {
+        Keyword,
+        ClassName,
+        Function,
+        SingleLineComment,
+        MultiLineComment,
+        Quotation,
+        Number,
+        Key,
+        Error,
+        Warning
+    };
+    static const int tokenKindCount = Warning + 1;
+
+    // Block states, compatible with QSyntaxHighlighter::setCurrentBlockState().
+    enum BlockState {
+        NormalState = 0
+    };
+
+    struct Token {
+        int start;
+        int length;
+        TokenKind kind;
+    };
+
+    static std::shared_ptr<const HighlightLexer> compile(const QByteArray &definition, QString *error);
+    // No rules at all; used for files no definition claims.
+    static std::shared_ptr<const HighlightLexer> plainText();
+
+    // Appends the tokens of one block to tokens and returns the state the
+    // next block starts in.
+    int tokenize(QStringView text, int previousState, QVector<Token> &tokens) const;
+
+    QString name() const;
+    QStringList extensions() const;
+    QString firstLinePattern() const;
+    // Every word listed under "keywords", for completion.
+    QStringList keywordList() const;
+
+    void write(QDataStream &stream) const;
+    static std::shared_ptr<const HighlightLexer> read(QDataStream &stream);
+
+private:
+    HighlightLexer() = default;
+
+    struct Rule {
+        int kind;         // -1 consumes the text without styling it
+        int followedKind; // replaces kind when followedBy comes next
+        char16_t followedBy;
+        int region;       // -1, or the region the match opens
+    };
+    struct Region {
+        int kind;
+        RegexDfa end;
+    };
+
+    void applyRule(const Rule &rule, const QChar *text, int length, int start, int end,
+                   QVector<Token> &tokens, int *next, int *state) const;
+
+    QString languageName;
+    QStringList fileExtensions;
+    QString firstLine;
+    QStringList keywords;
+    QVector<Rule> rules;
+    // Matches every rule, anchored or not, at the start of a line.
+    RegexDfa lineStart;
+    // Matches the unanchored rules everywhere else.
+    RegexDfa anywhere;
+    QVector<int> anywhereRules;
+    QVector<Region> regions;
+};
+
+#endif // HIGHLIGHTLEXER_H
@@ -0,0 +1,198 @@
+#include "languages.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+static const quint32 cacheMagic = 0x54454c58; // "TELX"
+// Bump whenever HighlightLexer or RegexDfa serialize differently.
+static const quint32 cacheVersion = 1;
+// Enough of the file to see a shebang or a log timestamp.
+static const qint64 firstLineBytes = 1024;
+
+namespace {
+
+// What picking a language needs, read from the definition without
+// compiling it; the lexer is compiled or read from the cache on first use.
+struct Language {
+    QString fileName;
+    QString name;
+    QRegularExpression firstLine;
+    std::shared_ptr<const HighlightLexer> lexer;
+    bool failed = false;
+};
+
+struct Registry {
+    QVector<Language> languages;
+    QHash<QString, int> byExtension;
+};
+
+QMutex mutex;
+
+QString cacheFileName(const QString &baseName) {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/languages/" + baseName + ".lexer";
+}
+
+QByteArray cacheKey(const QByteArray &definition) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(definition);
+    hash.addData(QByteArray::number(cacheVersion));
+    return hash.result();
+}
+
+std::shared_ptr<const HighlightLexer> readCache(const QString &baseName, const QByteArray &key) {
+    QFile file(cacheFileName(baseName));
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray storedKey;
+    stream >> magic >> version >> storedKey;
+    if (magic != cacheMagic || version != cacheVersion || storedKey != key)
+        return nullptr;
+    return HighlightLexer::read(stream);
+}
+
+void writeCache(const QString &baseName, const QByteArray &key, const HighlightLexer &lexer) {
+    const QString fileName = cacheFileName(baseName);
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << cacheMagic << cacheVersion << key;
+    lexer.write(stream);
+    if (stream.status() == QDataStream::Ok)
+        file.commit();
+}
+
+std::shared_ptr<const HighlightLexer> load(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("Cannot read language definition %s: %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return nullptr;
+    }
+    const QByteArray definition = file.readAll();
+    const QString baseName = QFileInfo(fileName).completeBaseName();
+    const QByteArray key = cacheKey(definition);
+    if (std::shared_ptr<const HighlightLexer> cached = readCache(baseName, key))
+        return cached;
+
+    QString error;
+    std::shared_ptr<const HighlightLexer> lexer = HighlightLexer::compile(definition, &error);
+    if (!lexer) {
+        qWarning("Language definition %s: %s", qPrintable(fileName), qPrintable(error));
+        return nullptr;
+    }
+    writeCache(baseName, key, *lexer);
+    return lexer;
+}
+
+// Called with mutex held.
+Registry &registry() {
+    static Registry *loaded = nullptr;
+    if (loaded)
+        return *loaded;
+
+    // A user definition replaces the built-in one with the same file name.
+    QMap<QString, QString> definitions;
+    const QStringList directories{
+        ":/languages",
+        QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/languages"
+    };
+    for (const QString &directory : directories) {
+        const QFileInfoList files = QDir(directory).entryInfoList({"*.json"}, QDir::Files, QDir::Name);
+        for (const QFileInfo &info : files)
+            definitions.insert(info.completeBaseName(), info.filePath());
+    }
+
+    loaded = new Registry;
+    for (const QString &fileName : std::as_const(definitions)) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+        Language language;
+        language.fileName = fileName;
+        language.name = root.value("name").toString();
+        if (language.name.isEmpty()) {
+            qWarning("Language definition %s has no name", qPrintable(fileName));
+            continue;
+        }
+        const QString firstLine = root.value("firstLine").toString();
+        if (!firstLine.isEmpty())
+            language.firstLine.setPattern(firstLine);
+        const int index = int(loaded->languages.size());
+        loaded->languages.append(language);
+        for (const QJsonValue &extension : root.value("extensions").toArray()) {
+            const QString suffix = extension.toString().toLower();
+            if (!loaded->byExtension.contains(suffix))
+                loaded->byExtension.insert(suffix, index);
+        }
+    }
+    return *loaded;
+}
+
+// Called with mutex held.
+std::shared_ptr<const HighlightLexer> lexerOf(Language &language) {
+    if (!language.lexer && !language.failed) {
+        language.lexer = load(language.fileName);
+        language.failed = !language.lexer;
+    }
+    return language.lexer ? language.lexer : HighlightLexer::plainText();
+}
+
+} // namespace
+
+std::shared_ptr<const HighlightLexer> Languages::forFile(const QString &fileName) {
+    if (fileName.isEmpty())
+        return HighlightLexer::plainText();
+    {
+        QMutexLocker locker(&mutex);
+        Registry &languages = registry();
+        const int byExtension = languages.byExtension.value(QFileInfo(fileName).suffix().toLower(), -1);
+        if (byExtension >= 0)
+            return lexerOf(languages.languages[byExtension]);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return HighlightLexer::plainText();
+    const QString firstLine = QString::fromUtf8(file.readLine(firstLineBytes)).trimmed();
+    QMutexLocker locker(&mutex);
+    for (Language &language : registry().languages) {
+        if (!language.firstLine.pattern().isEmpty() && language.firstLine.match(firstLine).hasMatch())
+            return lexerOf(language);
+    }
+    return HighlightLexer::plainText();
+}
+
+std::shared_ptr<const HighlightLexer> Languages::forName(const QString &name) {
+    QMutexLocker locker(&mutex);
+    for (Language &language : registry().languages) {
+        if (language.name.compare(name, Qt::CaseInsensitive) == 0)
+            return lexerOf(language);
+    }
+    return HighlightLexer::plainText();
+}
+
+QStringList Languages::names() {
+    QMutexLocker locker(&mutex);
+    QStringList list;
+    for (const Language &language : std::as_const(registry().languages))
+        list.append(language.name);
+    return list;
+}
@@ -0,0 +1,24 @@
+#ifndef LANGUAGES_H
+#define LANGUAGES_H
+
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include "highlightlexer.h"
+
+// The languages the editor highlights. Definitions are the JSON files built
+// in under :/languages plus any in the "languages" folder of the app data
+// directory, which replace a built-in one of the same file name. A language
+// is compiled the first time a file needs it and the result cached under the
+// cache directory, keyed by a hash of the definition, so later starts only
+// read it back.
+// Safe to call from any thread; the registry is loaded on first use.
+namespace Languages {
+// Picks a language by extension, then by the first line of the file, and
+// falls back to plain text.
+std::shared_ptr<const HighlightLexer> forFile(const QString &fileName);
+std::shared_ptr<const HighlightLexer> forName(const QString &name);
+QStringList names();
+}
+
+#endif // LANGUAGES_H
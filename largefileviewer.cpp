@@ -0,0 +1,606 @@
+#include "largefileviewer.h"
+#include "languages.h"
+#include "syntaxhighlighter.h"
+#include "tracing.h"
+#include "utf8decoder.h"
+#include <QApplication>
+#include <QClipboard>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QTextLayout>
+#include <QFileInfo>
+#include <algorithm>
+#include <climits>
+
+// Very long lines are cut for display; the mapped file itself is untouched.
+static const qint64 maxDisplayedLineBytes = 64 * 1024;
+// How far above the first visible line to look for an open multi-line region.
+static const int stateLookbackLines = 100;
+static const int textMargin = 4;
+
+LargeFileViewer::LargeFileViewer(QWidget *parent)
+    : QAbstractScrollArea(parent), cancelled(false) {
+    pool.setMaxThreadCount(1);
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    verticalScrollBar()->setSingleStep(1);
+    horizontalScrollBar()->setSingleStep(fontMetrics().horizontalAdvance(QLatin1Char('9')));
+}
+
+LargeFileViewer::~LargeFileViewer() {
+    cancelled = true;
+    pool.waitForDone();
+}
+
+bool LargeFileViewer::openFile(const QString &fileName) {
+    closeFile();
+
+    std::shared_ptr<LineIndex> built = std::make_shared<LineIndex>();
+    if (!built->open(fileName)) {
+        error = built->errorString();
+        return false;
+    }
+
+    cancelled = false;
+    indexing = true;
+    pendingFileName = fileName;
+    lexer = Languages::forFile(fileName);
+    const int indexGeneration = generation;
+    pool.start([this, built, indexGeneration]() {
+        const bool completed = built->build(cancelled);
+        QMetaObject::invokeMethod(this, [this, built, completed, indexGeneration]() {
+            indexFinished(built, completed, indexGeneration);
+        }, Qt::QueuedConnection);
+    });
+    viewport()->update();
+    return true;
+}
+
+void LargeFileViewer::closeFile() {
+    cancelled = true;
+    pool.waitForDone();
+    ++generation;
+    indexing = false;
+    document.reset();
+    index.reset();
+    pendingFileName.clear();
+    caret = anchor = {0, 0};
+    longestLineWidth = 0;
+    cachedStateLine = -1;
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    updateScrollBars();
+    viewport()->update();
+}
+
+void LargeFileViewer::indexFinished(const std::shared_ptr<LineIndex> &built, bool completed, int indexGeneration) {
+    if (indexGeneration != generation)
+        return;
+    indexing = false;
+    if (completed) {
+        index = built;
+        document = std::make_shared<PieceTable>(index);
+        // New lines follow the file's own convention.
+        lineEnding = index->lineCount() > 1 && index->lineEnd(0) + 1 < index->lineStart(1) ? "\r\n" : "\n";
+    }
+    updateScrollBars();
+    viewport()->update();
+    emit viewportChanged();
+    emit indexed(completed);
+}
+
+bool LargeFileViewer::isIndexing() const {
+    return indexing;
+}
+
+QString LargeFileViewer::fileName() const {
+    return index ? index->fileName() : pendingFileName;
+}
+
+QString LargeFileViewer::errorString() const {
+    return error;
+}
+
+void LargeFileViewer::setReadOnly(bool readOnly) {
+    this->readOnly = readOnly;
+}
+
+bool LargeFileViewer::isReadOnly() const {
+    return readOnly;
+}
+
+bool LargeFileViewer::isModified() const {
+    return document && document->isModified();
+}
+
+void LargeFileViewer::markSaved() {
+    if (document)
+        document->markSaved();
+}
+
+std::shared_ptr<const PieceTable> LargeFileViewer::pieceTable() const {
+    return document;
+}
+
+void LargeFileViewer::select(qint64 offset, qint64 length) {
+    if (!document)
+        return;
+    moveCaret(positionFor(offset), false);
+    moveCaret(positionFor(offset + length), true);
+}
+
+void LargeFileViewer::replaceAll(const QVector<SearchHit> &hits) {
+    if (!document || readOnly || hits.isEmpty())
+        return;
+    std::vector<PieceTable::Edit> edits;
+    edits.reserve(hits.size());
+    QString lastReplacement;
+    QByteArray lastBytes;
+    for (const SearchHit &hit : hits) {
+        // Hits usually share one replacement; encode it once.
+        if (edits.empty() || hit.replacement != lastReplacement) {
+            lastReplacement = hit.replacement;
+            lastBytes = encode(hit.replacement);
+        }
+        edits.push_back({hit.position, hit.length, lastBytes});
+    }
+    document->replace(edits);
+    contentsEdited(hits.first().position);
+}
+
+qint64 LargeFileViewer::lineCount() const {
+    return document ? document->lineCount() : 0;
+}
+
+int LargeFileViewer::firstVisibleLine() const {
+    return verticalScrollBar()->value();
+}
+
+int LargeFileViewer::visibleLineCount() const {
+    return viewport()->height() / lineHeight() + 1;
+}
+
+int LargeFileViewer::lineHeight() const {
+    return qMax(1, fontMetrics().lineSpacing());
+}
+
+void LargeFileViewer::goToLine(int line) {
+    if (!document)
+        return;
+    const qint64 target = qBound<qint64>(0, line, document->lineCount() - 1);
+    moveCaret({target, 0}, false);
+    verticalScrollBar()->setValue(int(target) - visibleLineCount() / 2);
+}
+
+int LargeFileViewer::stateBefore(qint64 line) const {
+    // The true state depends on everything above; a bounded lookback keeps
+    // painting O(visible lines) and is right unless a comment spans more
+    // than stateLookbackLines lines.
+    if (line == cachedStateLine)
+        return cachedState;
+
+    int state = HighlightLexer::NormalState;
+    QVector<HighlightLexer::Token> tokens;
+    for (qint64 l = qMax<qint64>(0, line - stateLookbackLines); l < line; ++l) {
+        tokens.clear();
+        state = lexer->tokenize(displayedText(l), state, tokens);
+    }
+    cachedStateLine = line;
+    cachedState = state;
+    return state;
+}
+
+int LargeFileViewer::prepareLayout(QTextLayout &layout, const QString &text, int state) const {
+    QVector<HighlightLexer::Token> tokens;
+    state = lexer->tokenize(text, state, tokens);
+
+    QList<QTextLayout::FormatRange> ranges;
+    ranges.reserve(tokens.size());
+    for (const HighlightLexer::Token &token : std::as_const(tokens)) {
+        QTextLayout::FormatRange range;
+        range.start = token.start;
+        range.length = token.length;
+        range.format = SyntaxHighlighter::formatFor(token.kind);
+        ranges.append(range);
+    }
+
+    QTextOption option;
+    option.setWrapMode(QTextOption::NoWrap);
+    option.setTabStopDistance(4 * fontMetrics().horizontalAdvance(QLatin1Char(' ')));
+
+    layout.setText(text);
+    layout.setFont(font());
+    layout.setTextOption(option);
+    layout.setFormats(ranges);
+    layout.beginLayout();
+    layout.createLine();
+    layout.endLayout();
+    return state;
+}
+
+void LargeFileViewer::paintEvent(QPaintEvent *event) {
+    TRACE_SCOPE("paintEvent");
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().base());
+    painter.setPen(palette().text().color());
+
+    if (!document) {
+        if (indexing)
+            painter.drawText(viewport()->rect(), Qt::AlignCenter,
+                             "Indexing " + QFileInfo(pendingFileName).fileName() + "...");
+        return;
+    }
+
+    const int height = lineHeight();
+    const qint64 first = firstVisibleLine();
+    const qint64 last = qMin<qint64>(first + visibleLineCount(), document->lineCount() - 1);
+    const qreal x = textMargin - horizontalScrollBar()->value();
+
+    Position selectionStart, selectionEnd;
+    selectionBounds(&selectionStart, &selectionEnd);
+    QTextCharFormat selectionFormat;
+    selectionFormat.setBackground(palette().highlight());
+    selectionFormat.setForeground(palette().highlightedText());
+
+    int state = stateBefore(first);
+    int widest = longestLineWidth;
+    for (qint64 line = first; line <= last; ++line) {
+        const int top = int(line - first) * height;
+        if (line == caret.line)
+            painter.fillRect(QRect(0, top, viewport()->width(), height), QColor(Qt::yellow).lighter(160));
+
+        const QString text = displayedText(line);
+        QTextLayout layout;
+        state = prepareLayout(layout, text, state);
+        if (layout.lineCount() == 0)
+            continue;
+
+        QVector<QTextLayout::FormatRange> selections;
+        if (hasSelection() && line >= selectionStart.line && line <= selectionEnd.line) {
+            QTextLayout::FormatRange selection;
+            selection.start = line == selectionStart.line ? selectionStart.column : 0;
+            const int end = line == selectionEnd.line ? selectionEnd.column : int(text.size()) + 1;
+            selection.length = end - selection.start;
+            selection.format = selectionFormat;
+            selections.append(selection);
+        }
+        layout.draw(&painter, QPointF(x, top), selections);
+        if (line == caret.line && hasFocus())
+            layout.drawCursor(&painter, QPointF(x, top), caret.column);
+        widest = qMax(widest, int(layout.lineAt(0).naturalTextWidth()) + 2 * textMargin);
+    }
+
+    if (widest != longestLineWidth) {
+        longestLineWidth = widest;
+        updateScrollBars();
+    }
+    Tracing::inputPainted();
+}
+
+void LargeFileViewer::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+    emit viewportChanged();
+}
+
+void LargeFileViewer::keyPressEvent(QKeyEvent *event) {
+    TRACE_SCOPE("keyPressEvent");
+    Tracing::inputReceived();
+    if (!document) {
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+
+    if (event == QKeySequence::Copy) {
+        copy();
+        return;
+    } else if (event == QKeySequence::Cut) {
+        cut();
+        return;
+    } else if (event == QKeySequence::Paste) {
+        paste();
+        return;
+    } else if (event == QKeySequence::Undo) {
+        undo();
+        return;
+    } else if (event == QKeySequence::Redo) {
+        redo();
+        return;
+    } else if (event == QKeySequence::SelectAll) {
+        selectAll();
+        return;
+    }
+
+    const bool select = event->modifiers() & Qt::ShiftModifier;
+    const bool control = event->modifiers() & Qt::ControlModifier;
+    const int lineLength = int(displayedText(caret.line).size());
+    const qint64 lastLine = document->lineCount() - 1;
+    const int pageLines = qMax(1, visibleLineCount() - 1);
+
+    switch (event->key()) {
+    case Qt::Key_Left:
+        if (caret.column > 0)
+            moveCaret({caret.line, caret.column - 1}, select);
+        else if (caret.line > 0)
+            moveCaret({caret.line - 1, INT_MAX}, select);
+        return;
+    case Qt::Key_Right:
+        if (caret.column < lineLength)
+            moveCaret({caret.line, caret.column + 1}, select);
+        else if (caret.line < lastLine)
+            moveCaret({caret.line + 1, 0}, select);
+        return;
+    case Qt::Key_Up:
+        moveCaret({qMax<qint64>(0, caret.line - 1), caret.column}, select);
+        return;
+    case Qt::Key_Down:
+        moveCaret({qMin(lastLine, caret.line + 1), caret.column}, select);
+        return;
+    case Qt::Key_PageUp:
+        moveCaret({qMax<qint64>(0, caret.line - pageLines), caret.column}, select);
+        return;
+    case Qt::Key_PageDown:
+        moveCaret({qMin(lastLine, caret.line + pageLines), caret.column}, select);
+        return;
+    case Qt::Key_Home:
+        moveCaret({control ? 0 : caret.line, 0}, select);
+        return;
+    case Qt::Key_End:
+        moveCaret({control ? lastLine : caret.line, INT_MAX}, select);
+        return;
+    case Qt::Key_Backspace:
+        if (readOnly)
+            return;
+        if (hasSelection()) {
+            removeSelection();
+        } else if (caret.column > 0) {
+            removeBytes(offsetFor({caret.line, caret.column - 1}), offsetFor(caret));
+        } else if (caret.line > 0) {
+            // Only the line break goes, even when the line above is cut.
+            removeBytes(document->lineEnd(caret.line - 1), document->lineStart(caret.line));
+        }
+        return;
+    case Qt::Key_Delete:
+        if (readOnly)
+            return;
+        if (hasSelection()) {
+            removeSelection();
+        } else if (caret.column < lineLength) {
+            removeBytes(offsetFor(caret), offsetFor({caret.line, caret.column + 1}));
+        } else if (caret.line < lastLine && !isTruncated(caret.line)) {
+            // At the end of a cut line the rest of it is not on screen, so
+            // there is nothing visible to delete.
+            removeBytes(offsetFor(caret), document->lineStart(caret.line + 1));
+        }
+        return;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        insertText(QStringLiteral("\n"));
+        return;
+    default:
+        break;
+    }
+
+    const QString text = event->text();
+    if (!text.isEmpty() && !control && (text.at(0).isPrint() || text.at(0) == QLatin1Char('\t'))) {
+        insertText(text);
+        return;
+    }
+    QAbstractScrollArea::keyPressEvent(event);
+}
+
+void LargeFileViewer::mousePressEvent(QMouseEvent *event) {
+    if (!document || event->button() != Qt::LeftButton) {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+    moveCaret(positionAt(event->pos()), event->modifiers() & Qt::ShiftModifier);
+}
+
+void LargeFileViewer::mouseMoveEvent(QMouseEvent *event) {
+    if (!document || !(event->buttons() & Qt::LeftButton)) {
+        QAbstractScrollArea::mouseMoveEvent(event);
+        return;
+    }
+    moveCaret(positionAt(event->pos()), true);
+}
+
+void LargeFileViewer::scrollContentsBy(int dx, int dy) {
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    viewport()->update();
+    emit viewportChanged();
+}
+
+void LargeFileViewer::updateScrollBars() {
+    const qint64 lines = lineCount();
+    const int pageLines = visibleLineCount() - 1;
+    verticalScrollBar()->setPageStep(qMax(1, pageLines));
+    verticalScrollBar()->setRange(0, int(qBound<qint64>(0, lines - pageLines, INT_MAX)));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setRange(0, qMax(0, longestLineWidth - viewport()->width()));
+}
+
+LargeFileViewer::Position LargeFileViewer::positionAt(const QPoint &point) const {
+    const qint64 line = qBound<qint64>(0, firstVisibleLine() + point.y() / lineHeight(), document->lineCount() - 1);
+    QTextLayout layout;
+    prepareLayout(layout, displayedText(line), stateBefore(line));
+    const qreal x = point.x() - textMargin + horizontalScrollBar()->value();
+    return {line, layout.lineCount() > 0 ? layout.lineAt(0).xToCursor(x) : 0};
+}
+
+QString LargeFileViewer::displayedText(qint64 line, QVector<int> *byteOffsets) const {
+    if (line < 0 || line >= document->lineCount())
+        return Utf8Decoder::decode(QByteArray(), byteOffsets);
+    const qint64 start = document->lineStart(line);
+    const qint64 length = document->lineEnd(line) - start;
+    if (length <= maxDisplayedLineBytes)
+        return Utf8Decoder::decode(document->text(start, length), byteOffsets);
+
+    // The cut backs off to a character boundary, so an edit at the end of
+    // what is shown never splits a character.
+    QByteArray bytes = document->text(start, maxDisplayedLineBytes + 1);
+    qint64 cut = maxDisplayedLineBytes;
+    for (int k = 0; k < 3 && (uchar(bytes.at(cut)) & 0xc0) == 0x80; ++k)
+        --cut;
+    bytes.truncate(cut);
+    return Utf8Decoder::decode(bytes, byteOffsets);
+}
+
+bool LargeFileViewer::isTruncated(qint64 line) const {
+    return document->lineEnd(line) - document->lineStart(line) > maxDisplayedLineBytes;
+}
+
+LargeFileViewer::Position LargeFileViewer::positionFor(qint64 offset) const {
+    const qint64 line = document->lineAt(offset);
+    QVector<int> offsets;
+    displayedText(line, &offsets);
+    // The column of the character holding offset; past what is shown that
+    // is the end of the displayed text.
+    const qint64 byte = offset - document->lineStart(line);
+    auto found = std::upper_bound(offsets.cbegin(), offsets.cend(), byte) - 1;
+    found = std::lower_bound(offsets.cbegin(), found, *found);
+    return {line, int(found - offsets.cbegin())};
+}
+
+qint64 LargeFileViewer::offsetFor(const Position &position) const {
+    QVector<int> offsets;
+    displayedText(position.line, &offsets);
+    return document->lineStart(position.line) + offsets.at(qBound(0, position.column, int(offsets.size()) - 1));
+}
+
+void LargeFileViewer::moveCaret(const Position &position, bool keepAnchor) {
+    const qint64 line = qBound<qint64>(0, position.line, document->lineCount() - 1);
+    const int length = int(displayedText(line).size());
+    caret = {line, qBound(0, position.column, length)};
+    if (!keepAnchor)
+        anchor = caret;
+    ensureCaretVisible();
+    viewport()->update();
+}
+
+void LargeFileViewer::ensureCaretVisible() {
+    const int pageLines = qMax(1, visibleLineCount() - 1);
+    if (caret.line < firstVisibleLine())
+        verticalScrollBar()->setValue(int(caret.line));
+    else if (caret.line >= firstVisibleLine() + pageLines)
+        verticalScrollBar()->setValue(int(caret.line) - pageLines + 1);
+
+    QTextLayout layout;
+    prepareLayout(layout, displayedText(caret.line), stateBefore(caret.line));
+    if (layout.lineCount() == 0)
+        return;
+    const int x = int(layout.lineAt(0).cursorToX(caret.column)) + textMargin;
+    QScrollBar *bar = horizontalScrollBar();
+    if (x + textMargin > bar->value() + viewport()->width()) {
+        longestLineWidth = qMax(longestLineWidth, x + 2 * textMargin);
+        updateScrollBars();
+        bar->setValue(x + textMargin - viewport()->width());
+    } else if (x - textMargin < bar->value()) {
+        bar->setValue(x - textMargin);
+    }
+}
+
+bool LargeFileViewer::hasSelection() const {
+    return caret.line != anchor.line || caret.column != anchor.column;
+}
+
+void LargeFileViewer::selectionBounds(Position *start, Position *end) const {
+    const bool caretFirst = caret.line < anchor.line || (caret.line == anchor.line && caret.column < anchor.column);
+    *start = caretFirst ? caret : anchor;
+    *end = caretFirst ? anchor : caret;
+}
+
+void LargeFileViewer::removeSelection() {
+    Position start, end;
+    selectionBounds(&start, &end);
+    // From the shown end of a cut line the selection takes the line break,
+    // not the rest of the line that was never on screen.
+    qint64 from = offsetFor(start);
+    if (end.line > start.line && isTruncated(start.line)
+        && start.column >= int(displayedText(start.line).size()))
+        from = document->lineEnd(start.line);
+    removeBytes(from, offsetFor(end));
+}
+
+QByteArray LargeFileViewer::encode(QString text) const {
+    text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    QByteArray bytes = text.toUtf8();
+    if (lineEnding != "\n")
+        bytes.replace('\n', lineEnding);
+    return bytes;
+}
+
+void LargeFileViewer::insertText(QString text) {
+    if (!document || readOnly)
+        return;
+    if (hasSelection())
+        removeSelection();
+
+    const QByteArray bytes = encode(text);
+    const qint64 offset = offsetFor(caret);
+    document->insert(offset, bytes);
+    contentsEdited(offset + bytes.size());
+}
+
+void LargeFileViewer::removeBytes(qint64 from, qint64 to) {
+    if (!document || readOnly || from >= to)
+        return;
+    document->remove(from, to - from);
+    contentsEdited(from);
+}
+
+void LargeFileViewer::contentsEdited(qint64 caretOffset) {
+    cachedStateLine = -1;
+    updateScrollBars();
+    moveCaret(positionFor(caretOffset), false);
+    emit contentsChanged();
+    emit viewportChanged();
+}
+
+void LargeFileViewer::cut() {
+    if (readOnly || !hasSelection())
+        return;
+    copy();
+    removeSelection();
+}
+
+void LargeFileViewer::copy() {
+    if (!document || !hasSelection())
+        return;
+    Position start, end;
+    selectionBounds(&start, &end);
+    const qint64 from = offsetFor(start);
+    QString text = QString::fromUtf8(document->text(from, offsetFor(end) - from));
+    text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    QApplication::clipboard()->setText(text);
+}
+
+void LargeFileViewer::paste() {
+    insertText(QApplication::clipboard()->text());
+}
+
+void LargeFileViewer::undo() {
+    if (!document || readOnly)
+        return;
+    const qint64 offset = document->undo();
+    if (offset >= 0)
+        contentsEdited(offset);
+}
+
+void LargeFileViewer::redo() {
+    if (!document || readOnly)
+        return;
+    const qint64 offset = document->redo();
+    if (offset >= 0)
+        contentsEdited(offset);
+}
+
+void LargeFileViewer::selectAll() {
+    if (!document)
+        return;
+    anchor = {0, 0};
+    moveCaret({document->lineCount() - 1, INT_MAX}, true);
+}
@@ -0,0 +1,114 @@
+#ifndef LARGEFILEVIEWER_H
+#define LARGEFILEVIEWER_H
+
+#include <QAbstractScrollArea>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include "highlightlexer.h"
+#include "lineindex.h"
+#include "piecetable.h"
+#include "searchengine.h"
+
+class QTextLayout;
+
+// View over a file too large for QTextDocument. The file stays memory-mapped
+// behind a LineIndex and edits go into a PieceTable; painting, scrolling and
+// the line number gutter only ever touch the lines on screen.
+class LargeFileViewer : public QAbstractScrollArea {
+    Q_OBJECT
+public:
+    explicit LargeFileViewer(QWidget *parent = nullptr);
+    ~LargeFileViewer();
+
+    bool openFile(const QString &fileName);
+    void closeFile();
+    bool isIndexing() const;
+    QString fileName() const;
+    QString errorString() const;
+
+    void setReadOnly(bool readOnly);
+    bool isReadOnly() const;
+    bool isModified() const;
+    void markSaved();
+    // Shared with SearchEngine and FileSaver workers; keep the view
+    // read-only meanwhile.
+    std::shared_ptr<const PieceTable> pieceTable() const;
+    void select(qint64 offset, qint64 length);
+    // Applies every hit's replacement as a single undo step.
+    void replaceAll(const QVector<SearchHit> &hits);
+
+    qint64 lineCount() const;
+    int firstVisibleLine() const;
+    int visibleLineCount() const;
+    int lineHeight() const;
+    void goToLine(int line);
+
+public slots:
+    void cut();
+    void copy();
+    void paste();
+    void undo();
+    void redo();
+    void selectAll();
+
+signals:
+    void indexed(bool completed);
+    void viewportChanged();
+    void contentsChanged();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private:
+    struct Position {
+        qint64 line;
+        int column;
+    };
+
+    void indexFinished(const std::shared_ptr<LineIndex> &built, bool completed, int indexGeneration);
+    void updateScrollBars();
+    int stateBefore(qint64 line) const;
+    int prepareLayout(QTextLayout &layout, const QString &text, int state) const;
+
+    // A line's text as shown, cut after maxDisplayedLineBytes; byteOffsets
+    // receives where each column starts relative to the line, plus its end.
+    QString displayedText(qint64 line, QVector<int> *byteOffsets = nullptr) const;
+    bool isTruncated(qint64 line) const;
+    Position positionAt(const QPoint &point) const;
+    Position positionFor(qint64 offset) const;
+    qint64 offsetFor(const Position &position) const;
+    void moveCaret(const Position &position, bool keepAnchor);
+    void ensureCaretVisible();
+    bool hasSelection() const;
+    void selectionBounds(Position *start, Position *end) const;
+    void removeSelection();
+    QByteArray encode(QString text) const;
+    void insertText(QString text);
+    void removeBytes(qint64 from, qint64 to);
+    void contentsEdited(qint64 caretOffset);
+
+    std::shared_ptr<LineIndex> index;
+    std::shared_ptr<PieceTable> document;
+    std::shared_ptr<const HighlightLexer> lexer = HighlightLexer::plainText();
+    QThreadPool pool;
+    std::atomic<bool> cancelled;
+    int generation = 0;
+    bool indexing = false;
+    bool readOnly = false;
+    QString pendingFileName;
+    QString error;
+    QByteArray lineEnding = "\n";
+    Position caret = {0, 0};
+    Position anchor = {0, 0};
+    int longestLineWidth = 0;
+    mutable qint64 cachedStateLine = -1;
+    mutable int cachedState = 0;
+};
+
+#endif // LARGEFILEVIEWER_H
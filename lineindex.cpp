@@ -0,0 +1,153 @@
+#include "lineindex.h"
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstring>
+
+// Chunks are small enough for 32-bit relative offsets and large enough to
+// keep per-task overhead negligible.
+static const qint64 scanChunkSize = 64 * 1024 * 1024;
+
+LineIndex::LineIndex() {}
+
+LineIndex::~LineIndex() {
+    close();
+}
+
+bool LineIndex::open(const QString &fileName) {
+    close();
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    fileSize = file.size();
+    if (fileSize > 0) {
+        mapped = reinterpret_cast<const char *>(file.map(0, fileSize));
+        if (!mapped) {
+            error = file.errorString();
+            file.close();
+            fileSize = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LineIndex::build(const std::atomic<bool> &cancelled) {
+    const qint64 chunkCount = (fileSize + scanChunkSize - 1) / scanChunkSize;
+    chunks.assign(size_t(chunkCount), Chunk());
+
+    // memchr is vectorized in every libc we ship on, so each task is a tight
+    // SIMD scan over its own chunk; tasks pull chunks from a shared counter.
+    std::atomic<qint64> nextChunk(0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    const int taskCount = int(qMin<qint64>(pool.maxThreadCount(), chunkCount));
+    for (int task = 0; task < taskCount; ++task) {
+        pool.start([this, &nextChunk, &cancelled, chunkCount]() {
+            for (qint64 c = nextChunk++; c < chunkCount; c = nextChunk++) {
+                if (cancelled.load(std::memory_order_relaxed))
+                    return;
+                Chunk &chunk = chunks[size_t(c)];
+                chunk.base = c * scanChunkSize;
+                const char *begin = mapped + chunk.base;
+                const char *end = mapped + qMin(chunk.base + scanChunkSize, fileSize);
+                for (const char *p = begin; p < end; ++p) {
+                    p = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+                    if (!p)
+                        break;
+                    chunk.newlines.push_back(quint32(p - begin));
+                }
+            }
+        });
+    }
+    pool.waitForDone();
+    if (cancelled.load())
+        return false;
+
+    newlineCount = 0;
+    for (Chunk &chunk : chunks) {
+        chunk.firstNewline = newlineCount;
+        newlineCount += qint64(chunk.newlines.size());
+    }
+    return true;
+}
+
+void LineIndex::close() {
+    if (mapped)
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(mapped)));
+    mapped = nullptr;
+    file.close();
+    fileSize = 0;
+    newlineCount = 0;
+    chunks.clear();
+}
+
+bool LineIndex::isOpen() const {
+    return file.isOpen();
+}
+
+QString LineIndex::fileName() const {
+    return file.fileName();
+}
+
+QString LineIndex::errorString() const {
+    return error;
+}
+
+const char *LineIndex::data() const {
+    return mapped;
+}
+
+qint64 LineIndex::size() const {
+    return fileSize;
+}
+
+qint64 LineIndex::lineCount() const {
+    return newlineCount + 1;
+}
+
+qint64 LineIndex::newlineOffset(qint64 newline) const {
+    auto it = std::upper_bound(chunks.begin(), chunks.end(), newline,
+                               [](qint64 value, const Chunk &chunk) { return value < chunk.firstNewline; });
+    // The last chunk starting at or before the newline holds it; an empty
+    // chunk can never be that one.
+    --it;
+    return it->base + it->newlines[size_t(newline - it->firstNewline)];
+}
+
+qint64 LineIndex::newlinesBefore(qint64 offset) const {
+    if (offset <= 0 || chunks.empty())
+        return 0;
+    if (offset >= fileSize)
+        return newlineCount;
+    const Chunk &chunk = chunks[size_t(offset / scanChunkSize)];
+    const quint32 relative = quint32(offset - chunk.base);
+    return chunk.firstNewline
+           + qint64(std::lower_bound(chunk.newlines.begin(), chunk.newlines.end(), relative) - chunk.newlines.begin());
+}
+
+qint64 LineIndex::lineStart(qint64 line) const {
+    if (line <= 0)
+        return 0;
+    return newlineOffset(qMin(line, newlineCount) - 1) + 1;
+}
+
+qint64 LineIndex::lineEnd(qint64 line) const {
+    const qint64 start = lineStart(line);
+    qint64 end = line < newlineCount ? newlineOffset(line) : fileSize;
+    if (end > start && mapped[end - 1] == '\r')
+        --end;
+    return end;
+}
+
+QString LineIndex::lineText(qint64 line, qint64 maxBytes) const {
+    if (!mapped || line < 0 || line >= lineCount())
+        return QString();
+    const qint64 start = lineStart(line);
+    qint64 length = lineEnd(line) - start;
+    if (maxBytes >= 0)
+        length = qMin(length, maxBytes);
+    return QString::fromUtf8(mapped + start, length);
+}
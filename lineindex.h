@@ -0,0 +1,55 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <QFile>
+#include <QString>
+#include <atomic>
+#include <vector>
+
+// Newline-offset index over a memory-mapped file. The file is split into
+// chunks that are scanned in parallel; each chunk stores its newline offsets
+// relative to the chunk start so the index costs four bytes per line.
+class LineIndex {
+public:
+    LineIndex();
+    ~LineIndex();
+
+    bool open(const QString &fileName);
+    // Scans the mapped file; returns false if cancelled is raised meanwhile.
+    bool build(const std::atomic<bool> &cancelled);
+    void close();
+
+    bool isOpen() const;
+    QString fileName() const;
+    QString errorString() const;
+
+    const char *data() const;
+    qint64 size() const;
+
+    qint64 lineCount() const;
+    qint64 lineStart(qint64 line) const;
+    // End of the line's text, excluding "\n" and a preceding "\r".
+    qint64 lineEnd(qint64 line) const;
+    QString lineText(qint64 line, qint64 maxBytes = -1) const;
+
+    // Newline queries used by PieceTable to count and locate lines inside
+    // slices of the original file without scanning them.
+    qint64 newlinesBefore(qint64 offset) const;
+    qint64 newlineOffset(qint64 newline) const;
+
+private:
+    struct Chunk {
+        qint64 base;
+        qint64 firstNewline;
+        std::vector<quint32> newlines;
+    };
+
+    QFile file;
+    const char *mapped = nullptr;
+    qint64 fileSize = 0;
+    qint64 newlineCount = 0;
+    std::vector<Chunk> chunks;
+    QString error;
+};
+
+#endif // LINEINDEX_H
@@ -9,4 +9,8 @@ QSize LineNumberArea::sizeHint() const {
 
 void LineNumberArea::paintEvent(QPaintEvent *event) {
     textEditor->lineNumberAreaPaintEvent(event);
-}
\ No newline at end of file
+}
+
+void LineNumberArea::mousePressEvent(QMouseEvent *event) {
+    textEditor->lineNumberAreaMousePressEvent(event);
+}
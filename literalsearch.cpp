@@ -0,0 +1,149 @@
+#include "literalsearch.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(Q_PROCESSOR_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LITERALSEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(LITERALSEARCH_SSE2) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+#define LITERALSEARCH_AVX2
+#include <immintrin.h>
+#define LITERALSEARCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+template <typename Unit>
+bool matchesAt(const Unit *haystack, qsizetype position, const Unit *needle, qsizetype needleLength) {
+    // First and last units are already known to match.
+    return needleLength <= 2
+           || std::memcmp(haystack + position + 1, needle + 1, size_t(needleLength - 2) * sizeof(Unit)) == 0;
+}
+
+template <typename Unit>
+qsizetype indexOfScalar(const Unit *haystack, qsizetype length, const Unit *needle, qsizetype needleLength, qsizetype from) {
+    const Unit first = needle[0];
+    const Unit last = needle[needleLength - 1];
+    for (qsizetype i = from; i + needleLength <= length; ++i) {
+        if (haystack[i] == first && haystack[i + needleLength - 1] == last
+            && matchesAt(haystack, i, needle, needleLength))
+            return i;
+    }
+    return -1;
+}
+
+// Clears the movemask bits of the lane that starts at bit.
+template <typename Unit>
+unsigned clearLane(unsigned mask, int bit) {
+    return mask & ~(((1u << sizeof(Unit)) - 1) << bit);
+}
+
+#ifdef LITERALSEARCH_SSE2
+inline __m128i splat128(char c) { return _mm_set1_epi8(c); }
+inline __m128i splat128(char16_t c) { return _mm_set1_epi16(short(c)); }
+inline __m128i equal128(__m128i a, __m128i b, char) { return _mm_cmpeq_epi8(a, b); }
+inline __m128i equal128(__m128i a, __m128i b, char16_t) { return _mm_cmpeq_epi16(a, b); }
+
+template <typename Unit>
+qsizetype indexOfSse2(const Unit *haystack, qsizetype length, const Unit *needle, qsizetype needleLength, qsizetype from) {
+    const qsizetype lanes = 16 / sizeof(Unit);
+    const __m128i first = splat128(needle[0]);
+    const __m128i last = splat128(needle[needleLength - 1]);
+    qsizetype i = from;
+    for (; i + needleLength - 1 + lanes <= length; i += lanes) {
+        const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+        const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i + needleLength - 1));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_and_si128(equal128(blockFirst, first, Unit()),
+                                                                 equal128(blockLast, last, Unit()))));
+        while (mask) {
+            const int bit = int(qCountTrailingZeroBits(mask));
+            const qsizetype position = i + bit / qsizetype(sizeof(Unit));
+            if (matchesAt(haystack, position, needle, needleLength))
+                return position;
+            mask = clearLane<Unit>(mask, bit);
+        }
+    }
+    return indexOfScalar(haystack, length, needle, needleLength, i);
+}
+#endif
+
+#ifdef LITERALSEARCH_AVX2
+LITERALSEARCH_TARGET_AVX2 inline __m256i splat256(char c) { return _mm256_set1_epi8(c); }
+LITERALSEARCH_TARGET_AVX2 inline __m256i splat256(char16_t c) { return _mm256_set1_epi16(short(c)); }
+LITERALSEARCH_TARGET_AVX2 inline __m256i equal256(__m256i a, __m256i b, char) { return _mm256_cmpeq_epi8(a, b); }
+LITERALSEARCH_TARGET_AVX2 inline __m256i equal256(__m256i a, __m256i b, char16_t) { return _mm256_cmpeq_epi16(a, b); }
+
+template <typename Unit>
+LITERALSEARCH_TARGET_AVX2 qsizetype indexOfAvx2(const Unit *haystack, qsizetype length, const Unit *needle, qsizetype needleLength, qsizetype from) {
+    const qsizetype lanes = 32 / sizeof(Unit);
+    const __m256i first = splat256(needle[0]);
+    const __m256i last = splat256(needle[needleLength - 1]);
+    qsizetype i = from;
+    for (; i + needleLength - 1 + lanes <= length; i += lanes) {
+        const __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i));
+        const __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i + needleLength - 1));
+        unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_and_si256(equal256(blockFirst, first, Unit()),
+                                                                       equal256(blockLast, last, Unit()))));
+        while (mask) {
+            const int bit = int(qCountTrailingZeroBits(mask));
+            const qsizetype position = i + bit / qsizetype(sizeof(Unit));
+            if (matchesAt(haystack, position, needle, needleLength))
+                return position;
+            mask = clearLane<Unit>(mask, bit);
+        }
+    }
+    return indexOfScalar(haystack, length, needle, needleLength, i);
+}
+
+bool hasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+template <typename Unit>
+qsizetype indexOfUnits(const Unit *haystack, qsizetype length, const Unit *needle, qsizetype needleLength, qsizetype from) {
+    from = qMax<qsizetype>(0, from);
+    if (needleLength <= 0)
+        return from <= length ? from : -1;
+    if (from + needleLength > length)
+        return -1;
+#ifdef LITERALSEARCH_AVX2
+    if (hasAvx2())
+        return indexOfAvx2(haystack, length, needle, needleLength, from);
+#endif
+#ifdef LITERALSEARCH_SSE2
+    return indexOfSse2(haystack, length, needle, needleLength, from);
+#else
+    return indexOfScalar(haystack, length, needle, needleLength, from);
+#endif
+}
+
+} // namespace
+
+namespace LiteralSearch {
+
+qsizetype indexOf(const char *haystack, qsizetype length, const char *needle, qsizetype needleLength, qsizetype from) {
+    return indexOfUnits(haystack, length, needle, needleLength, from);
+}
+
+qsizetype indexOf(QStringView haystack, QStringView needle, qsizetype from) {
+    return indexOfUnits(reinterpret_cast<const char16_t *>(haystack.data()), haystack.size(),
+                        reinterpret_cast<const char16_t *>(needle.data()), needle.size(), from);
+}
+
+const char *kernelName() {
+#ifdef LITERALSEARCH_AVX2
+    if (hasAvx2())
+        return "AVX2";
+#endif
+#ifdef LITERALSEARCH_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace LiteralSearch
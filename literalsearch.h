@@ -0,0 +1,20 @@
+#ifndef LITERALSEARCH_H
+#define LITERALSEARCH_H
+
+#include <QStringView>
+#include <QtGlobal>
+
+// Exact substring search used by SearchEngine. Candidate positions are found
+// by comparing the needle's first and last unit against a whole vector of
+// haystack positions at once (AVX2 or SSE2, picked at run time), so only a
+// few positions per block are ever compared in full.
+namespace LiteralSearch {
+// Offset of the first occurrence of needle at or after from, or -1.
+qsizetype indexOf(const char *haystack, qsizetype length, const char *needle, qsizetype needleLength, qsizetype from = 0);
+qsizetype indexOf(QStringView haystack, QStringView needle, qsizetype from = 0);
+
+// Name of the kernel in use, for diagnostics.
+const char *kernelName();
+}
+
+#endif // LITERALSEARCH_H
@@ -1,9 +1,48 @@
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QStatusBar>
+#include <QTimer>
+#include <cstdio>
+#include "batchexporter.h"
+#include "startuptime.h"
 #include "texteditor.h"
 
 int main(int argc, char *argv[]) {
+    // Exports run without a display, so they must not create a QApplication.
+    if (BatchExporter::isBatchCommandLine(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        return BatchExporter::run(app.arguments());
+    }
+
     QApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Text editor.");
+    parser.addHelpOption();
+    QCommandLineOption startupTimeOption("startup-time",
+                                         "Print the time from process start to the first painted screen, then quit.");
+    parser.addOption(startupTimeOption);
+    parser.addPositionalArgument("files", "Files to open.", "[files...]");
+    parser.process(app);
+    const QStringList files = parser.positionalArguments();
+    const bool reportOnly = parser.isSet(startupTimeOption);
+
     TextEditor editor;
+    QObject::connect(&editor, &TextEditor::firstScreenPainted, &editor, [&editor, reportOnly]() {
+        const qint64 ms = StartupTime::sinceProcessStart();
+        if (reportOnly) {
+            std::printf("startup: %lld ms\n", static_cast<long long>(ms));
+            std::fflush(stdout);
+            QTimer::singleShot(0, qApp, &QCoreApplication::quit);
+        } else if (ms >= 0) {
+            editor.statusBar()->showMessage(QString("Started in %1 ms").arg(ms), 5000);
+        }
+    });
+    // Named files start loading before the window is shown, so reading
+    // overlaps with the window being set up; the session tabs stay unread.
+    if (!reportOnly)
+        editor.restoreSession(files.isEmpty());
+    for (const QString &fileName : files)
+        editor.loadFile(fileName);
     editor.resize(800, 600);
     editor.show();
     return app.exec();
@@ -0,0 +1,17 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <QtGlobal>
+
+// Process memory figures used for load/save diagnostics. Both return -1 on
+// platforms where the value is not available.
+namespace MemoryUsage {
+qint64 currentResidentBytes();
+qint64 peakResidentBytes();
+// Starts a new peak from the current resident set, so the next
+// peakResidentBytes() covers only what follows. Returns false where the
+// peak cannot be reset and stays process-wide.
+bool resetPeakResidentBytes();
+}
+
+#endif // MEMORYUSAGE_H
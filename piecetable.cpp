@@ -0,0 +1,323 @@
+#include "piecetable.h"
+#include "lineindex.h"
+#include <algorithm>
+
+PieceTable::PieceTable(std::shared_ptr<const LineIndex> original)
+    : original(std::move(original)) {
+    const qint64 size = this->original->size();
+    if (size > 0) {
+        const Piece whole = {false, 0, size, this->original->lineCount() - 1};
+        root = makeNode(whole, nextPriority(), nullptr, nullptr);
+    }
+    savedRoot = root;
+}
+
+qint64 PieceTable::lengthOf(const NodePtr &node) {
+    return node ? node->length : 0;
+}
+
+qint64 PieceTable::newlinesOf(const NodePtr &node) {
+    return node ? node->newlines : 0;
+}
+
+PieceTable::NodePtr PieceTable::makeNode(const Piece &piece, quint32 priority, const NodePtr &left, const NodePtr &right) {
+    return std::make_shared<const Node>(Node{piece, priority,
+                                             lengthOf(left) + piece.length + lengthOf(right),
+                                             newlinesOf(left) + piece.newlines + newlinesOf(right),
+                                             left, right});
+}
+
+PieceTable::NodePtr PieceTable::merge(const NodePtr &left, const NodePtr &right) {
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+    if (left->priority > right->priority)
+        return makeNode(left->piece, left->priority, left->left, merge(left->right, right));
+    return makeNode(right->piece, right->priority, merge(left, right->left), right->right);
+}
+
+std::pair<PieceTable::NodePtr, PieceTable::NodePtr> PieceTable::split(const NodePtr &node, qint64 offset) const {
+    if (!node || offset <= 0)
+        return {nullptr, node};
+    if (offset >= node->length)
+        return {node, nullptr};
+
+    const qint64 leftLength = lengthOf(node->left);
+    if (offset <= leftLength) {
+        auto parts = split(node->left, offset);
+        return {parts.first, makeNode(node->piece, node->priority, parts.second, node->right)};
+    }
+    offset -= leftLength;
+    if (offset >= node->piece.length) {
+        auto parts = split(node->right, offset - node->piece.length);
+        return {makeNode(node->piece, node->priority, node->left, parts.first), parts.second};
+    }
+
+    // The cut falls inside this piece. Both halves may keep the priority:
+    // each becomes the root of its own side.
+    const Piece head = slice(node->piece, 0, offset);
+    const Piece tail = slice(node->piece, offset, node->piece.length - offset);
+    return {makeNode(head, node->priority, node->left, nullptr),
+            makeNode(tail, node->priority, nullptr, node->right)};
+}
+
+PieceTable::Piece PieceTable::slice(const Piece &piece, qint64 from, qint64 length) const {
+    return {piece.added, piece.start + from, length, countNewlines(piece.added, piece.start + from, length)};
+}
+
+qint64 PieceTable::countNewlines(bool added, qint64 start, qint64 length) const {
+    if (!added)
+        return original->newlinesBefore(start + length) - original->newlinesBefore(start);
+    return std::lower_bound(addNewlines.begin(), addNewlines.end(), start + length)
+           - std::lower_bound(addNewlines.begin(), addNewlines.end(), start);
+}
+
+qint64 PieceTable::newlineInPiece(const Piece &piece, qint64 k) const {
+    if (!piece.added)
+        return original->newlineOffset(original->newlinesBefore(piece.start) + k);
+    const auto first = std::lower_bound(addNewlines.begin(), addNewlines.end(), piece.start);
+    return *(first + k);
+}
+
+const char *PieceTable::bufferFor(const Piece &piece) const {
+    return piece.added ? addBuffer.constData() : original->data();
+}
+
+quint32 PieceTable::nextPriority() {
+    // xorshift32; treap balance only needs the priorities to look random.
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+qint64 PieceTable::size() const {
+    return lengthOf(root);
+}
+
+qint64 PieceTable::lineCount() const {
+    return newlinesOf(root) + 1;
+}
+
+qint64 PieceTable::lineStart(qint64 line) const {
+    if (line <= 0)
+        return 0;
+    qint64 k = qMin(line, newlinesOf(root)) - 1;
+    qint64 base = 0;
+    const Node *node = root.get();
+    while (node) {
+        const qint64 leftNewlines = newlinesOf(node->left);
+        if (k < leftNewlines) {
+            node = node->left.get();
+            continue;
+        }
+        k -= leftNewlines;
+        base += lengthOf(node->left);
+        if (k < node->piece.newlines)
+            return base + newlineInPiece(node->piece, k) - node->piece.start + 1;
+        k -= node->piece.newlines;
+        base += node->piece.length;
+        node = node->right.get();
+    }
+    return size();
+}
+
+qint64 PieceTable::lineEnd(qint64 line) const {
+    const qint64 start = lineStart(line);
+    qint64 end = line + 1 < lineCount() ? lineStart(line + 1) - 1 : size();
+    if (end > start && byteAt(end - 1) == '\r')
+        --end;
+    return end;
+}
+
+qint64 PieceTable::lineAt(qint64 offset) const {
+    qint64 line = 0;
+    const Node *node = root.get();
+    while (node) {
+        const qint64 leftLength = lengthOf(node->left);
+        if (offset < leftLength) {
+            node = node->left.get();
+            continue;
+        }
+        line += newlinesOf(node->left);
+        offset -= leftLength;
+        if (offset < node->piece.length)
+            return line + countNewlines(node->piece.added, node->piece.start, offset);
+        line += node->piece.newlines;
+        offset -= node->piece.length;
+        node = node->right.get();
+    }
+    return line;
+}
+
+char PieceTable::byteAt(qint64 offset) const {
+    const Node *node = root.get();
+    while (node) {
+        const qint64 leftLength = lengthOf(node->left);
+        if (offset < leftLength) {
+            node = node->left.get();
+            continue;
+        }
+        offset -= leftLength;
+        if (offset < node->piece.length)
+            return bufferFor(node->piece)[node->piece.start + offset];
+        offset -= node->piece.length;
+        node = node->right.get();
+    }
+    return '\0';
+}
+
+QByteArray PieceTable::text(qint64 offset, qint64 length) const {
+    QByteArray result;
+    const qint64 from = qMax<qint64>(0, offset);
+    const qint64 to = qMin(size(), offset + length);
+    if (from >= to)
+        return result;
+    result.reserve(to - from);
+
+    // In-order walk that only descends into subtrees overlapping [from, to).
+    std::function<void(const Node *, qint64)> collect = [&](const Node *node, qint64 nodeStart) {
+        if (!node || to <= nodeStart || from >= nodeStart + node->length)
+            return;
+        collect(node->left.get(), nodeStart);
+        const qint64 pieceStart = nodeStart + lengthOf(node->left);
+        const qint64 begin = qMax(from, pieceStart);
+        const qint64 end = qMin(to, pieceStart + node->piece.length);
+        if (begin < end)
+            result.append(bufferFor(node->piece) + node->piece.start + (begin - pieceStart), end - begin);
+        collect(node->right.get(), pieceStart + node->piece.length);
+    };
+    collect(root.get(), 0);
+    return result;
+}
+
+QString PieceTable::lineText(qint64 line, qint64 maxBytes) const {
+    if (line < 0 || line >= lineCount())
+        return QString();
+    const qint64 start = lineStart(line);
+    qint64 length = lineEnd(line) - start;
+    if (maxBytes >= 0)
+        length = qMin(length, maxBytes);
+    return QString::fromUtf8(text(start, length));
+}
+
+void PieceTable::insert(qint64 offset, const QByteArray &text) {
+    if (text.isEmpty())
+        return;
+    offset = qBound<qint64>(0, offset, size());
+
+    const Piece piece = append(text);
+    auto parts = split(root, offset);
+    NodePtr newRoot = merge(merge(parts.first, makeNode(piece, nextPriority(), nullptr, nullptr)), parts.second);
+
+    // Consecutive typing on one line undoes as a single step.
+    const bool continuesTyping = offset == lastInsertEnd && piece.newlines == 0 && !undoStack.empty();
+    if (continuesTyping) {
+        root = newRoot;
+        redoStack.clear();
+    } else {
+        commit(newRoot, offset);
+    }
+    lastInsertEnd = offset + text.size();
+}
+
+void PieceTable::remove(qint64 offset, qint64 length) {
+    offset = qBound<qint64>(0, offset, size());
+    length = qMin(length, size() - offset);
+    if (length <= 0)
+        return;
+    auto head = split(root, offset);
+    auto tail = split(head.second, length);
+    commit(merge(head.first, tail.second), offset);
+    lastInsertEnd = -1;
+}
+
+void PieceTable::replace(const std::vector<Edit> &edits) {
+    if (edits.empty())
+        return;
+
+    // Work back to front so earlier offsets stay valid, and share one copy
+    // of the replacement text between consecutive edits that use the same.
+    NodePtr newRoot = root;
+    const QByteArray *appendedText = nullptr;
+    Piece appended = {};
+    for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+        auto head = split(newRoot, edit->offset);
+        auto tail = split(head.second, edit->length);
+        NodePtr middle;
+        if (!edit->text.isEmpty()) {
+            if (!appendedText || *appendedText != edit->text) {
+                appended = append(edit->text);
+                appendedText = &edit->text;
+            }
+            middle = makeNode(appended, nextPriority(), nullptr, nullptr);
+        }
+        newRoot = merge(merge(head.first, middle), tail.second);
+    }
+    commit(newRoot, edits.front().offset);
+    lastInsertEnd = -1;
+}
+
+PieceTable::Piece PieceTable::append(const QByteArray &text) {
+    const qint64 start = addBuffer.size();
+    addBuffer.append(text);
+    for (qint64 i = text.indexOf('\n'); i >= 0; i = text.indexOf('\n', i + 1))
+        addNewlines.push_back(start + i);
+    return {true, start, text.size(), countNewlines(true, start, text.size())};
+}
+
+void PieceTable::commit(NodePtr newRoot, qint64 offset) {
+    undoStack.push_back({root, offset});
+    redoStack.clear();
+    root = std::move(newRoot);
+}
+
+bool PieceTable::canUndo() const {
+    return !undoStack.empty();
+}
+
+bool PieceTable::canRedo() const {
+    return !redoStack.empty();
+}
+
+qint64 PieceTable::undo() {
+    if (undoStack.empty())
+        return -1;
+    const Revision revision = undoStack.back();
+    undoStack.pop_back();
+    redoStack.push_back({root, revision.offset});
+    root = revision.root;
+    lastInsertEnd = -1;
+    return revision.offset;
+}
+
+qint64 PieceTable::redo() {
+    if (redoStack.empty())
+        return -1;
+    const Revision revision = redoStack.back();
+    redoStack.pop_back();
+    undoStack.push_back({root, revision.offset});
+    root = revision.root;
+    lastInsertEnd = -1;
+    return revision.offset;
+}
+
+bool PieceTable::isModified() const {
+    return root != savedRoot;
+}
+
+void PieceTable::markSaved() {
+    savedRoot = root;
+}
+
+bool PieceTable::forEachPiece(const std::function<bool(const char *, qint64)> &write) const {
+    std::function<bool(const Node *)> visit = [&](const Node *node) {
+        if (!node)
+            return true;
+        return visit(node->left.get())
+               && write(bufferFor(node->piece) + node->piece.start, node->piece.length)
+               && visit(node->right.get());
+    };
+    return visit(root.get());
+}
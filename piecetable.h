@@ -0,0 +1,104 @@
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class LineIndex;
+
+// Editable byte buffer over a memory-mapped file. The original file is never
+// copied: edits are appended to an add buffer and the document is a sequence
+// of pieces referring to either buffer. Pieces live in a persistent treap
+// keyed by position, so an edit anywhere costs O(log n) new nodes and every
+// undo step is just the previous root.
+class PieceTable {
+public:
+    struct Edit {
+        qint64 offset;
+        qint64 length;
+        QByteArray text;
+    };
+
+    explicit PieceTable(std::shared_ptr<const LineIndex> original);
+
+    qint64 size() const;
+    qint64 lineCount() const;
+    qint64 lineStart(qint64 line) const;
+    // End of the line's text, excluding "\n" and a preceding "\r".
+    qint64 lineEnd(qint64 line) const;
+    qint64 lineAt(qint64 offset) const;
+    QByteArray text(qint64 offset, qint64 length) const;
+    QString lineText(qint64 line, qint64 maxBytes = -1) const;
+
+    void insert(qint64 offset, const QByteArray &text);
+    void remove(qint64 offset, qint64 length);
+    // Applies edits sorted by offset and not overlapping as one undo step.
+    void replace(const std::vector<Edit> &edits);
+
+    bool canUndo() const;
+    bool canRedo() const;
+    // Both return the offset of the change, or -1 if there was nothing to do.
+    qint64 undo();
+    qint64 redo();
+
+    bool isModified() const;
+    void markSaved();
+
+    // Calls write for each piece in document order until it returns false.
+    bool forEachPiece(const std::function<bool(const char *, qint64)> &write) const;
+
+private:
+    struct Piece {
+        bool added;
+        qint64 start;
+        qint64 length;
+        qint64 newlines;
+    };
+
+    struct Node;
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    struct Node {
+        Piece piece;
+        quint32 priority;
+        qint64 length;
+        qint64 newlines;
+        NodePtr left;
+        NodePtr right;
+    };
+
+    struct Revision {
+        NodePtr root;
+        qint64 offset;
+    };
+
+    static qint64 lengthOf(const NodePtr &node);
+    static qint64 newlinesOf(const NodePtr &node);
+    static NodePtr makeNode(const Piece &piece, quint32 priority, const NodePtr &left, const NodePtr &right);
+    static NodePtr merge(const NodePtr &left, const NodePtr &right);
+    std::pair<NodePtr, NodePtr> split(const NodePtr &node, qint64 offset) const;
+
+    Piece append(const QByteArray &text);
+    Piece slice(const Piece &piece, qint64 from, qint64 length) const;
+    qint64 countNewlines(bool added, qint64 start, qint64 length) const;
+    qint64 newlineInPiece(const Piece &piece, qint64 k) const;
+    const char *bufferFor(const Piece &piece) const;
+    char byteAt(qint64 offset) const;
+    quint32 nextPriority();
+    void commit(NodePtr newRoot, qint64 offset);
+
+    std::shared_ptr<const LineIndex> original;
+    QByteArray addBuffer;
+    std::vector<qint64> addNewlines;
+    NodePtr root;
+    NodePtr savedRoot;
+    std::vector<Revision> undoStack;
+    std::vector<Revision> redoStack;
+    qint64 lastInsertEnd = -1;
+    quint32 seed = 0x9e3779b9u;
+};
+
+#endif // PIECETABLE_H
@@ -0,0 +1,670 @@
+#include "regexdfa.h"
+#include <QDataStream>
+#include <QHash>
+#include <algorithm>
+
+// Beyond this the pattern set is almost certainly a mistake.
+static const int maxDfaStates = 20000;
+static const int maxRepeat = 100;
+
+namespace {
+
+struct CharRange {
+    char16_t first;
+    char16_t last;
+};
+
+// Sorted, non-overlapping, inclusive ranges.
+using CharSet = QVector<CharRange>;
+
+CharSet normalized(CharSet set) {
+    std::sort(set.begin(), set.end(), [](const CharRange &a, const CharRange &b) { return a.first < b.first; });
+    CharSet merged;
+    for (const CharRange &range : std::as_const(set)) {
+        if (!merged.isEmpty() && int(range.first) <= int(merged.last().last) + 1)
+            merged.last().last = qMax(merged.last().last, range.last);
+        else
+            merged.append(range);
+    }
+    return merged;
+}
+
+CharSet negated(const CharSet &set) {
+    CharSet result;
+    int next = 0;
+    for (const CharRange &range : set) {
+        if (range.first > next)
+            result.append({char16_t(next), char16_t(range.first - 1)});
+        next = range.last + 1;
+    }
+    if (next <= 0xffff)
+        result.append({char16_t(next), char16_t(0xffff)});
+    return result;
+}
+
+CharSet single(char16_t c) {
+    return CharSet{{c, c}};
+}
+
+struct NfaEdge {
+    int set; // -1 for an epsilon edge
+    int target;
+};
+
+struct NfaState {
+    QVector<NfaEdge> edges;
+    int accept = -1;
+};
+
+struct Nfa {
+    QVector<NfaState> states;
+    QVector<CharSet> sets;
+    QHash<QByteArray, int> setIds;
+
+    int addState() {
+        states.append(NfaState());
+        return int(states.size()) - 1;
+    }
+    void addEdge(int from, int to, int set = -1) { states[from].edges.append({set, to}); }
+    int addSet(const CharSet &set) {
+        const QByteArray key(reinterpret_cast<const char *>(set.constData()), int(set.size() * sizeof(CharRange)));
+        auto it = setIds.constFind(key);
+        if (it != setIds.constEnd())
+            return it.value();
+        sets.append(set);
+        const int id = int(sets.size()) - 1;
+        setIds.insert(key, id);
+        return id;
+    }
+};
+
+// Recursive descent over one pattern, adding its Thompson automaton to nfa.
+class Parser {
+public:
+    Parser(const QString &pattern, Nfa &nfa) : pattern(pattern), nfa(nfa) {}
+
+    bool parse(int *start, int *end, QString *error) {
+        Fragment fragment;
+        if (!alternation(&fragment))
+            return fail(error);
+        if (position < pattern.size()) {
+            message = "unbalanced ')'";
+            return fail(error);
+        }
+        *start = fragment.start;
+        *end = fragment.end;
+        return true;
+    }
+
+private:
+    struct Fragment {
+        int start;
+        int end;
+    };
+
+    bool fail(QString *error) {
+        *error = QString("%1 at offset %2 of \"%3\"").arg(message).arg(position).arg(pattern);
+        return false;
+    }
+    bool atEnd() const { return position >= pattern.size(); }
+    char16_t peek() const { return pattern.at(position).unicode(); }
+
+    bool alternation(Fragment *fragment) {
+        Fragment first;
+        if (!sequence(&first))
+            return false;
+        if (atEnd() || peek() != '|') {
+            *fragment = first;
+            return true;
+        }
+        const int start = nfa.addState();
+        const int end = nfa.addState();
+        nfa.addEdge(start, first.start);
+        nfa.addEdge(first.end, end);
+        while (!atEnd() && peek() == '|') {
+            ++position;
+            Fragment next;
+            if (!sequence(&next))
+                return false;
+            nfa.addEdge(start, next.start);
+            nfa.addEdge(next.end, end);
+        }
+        *fragment = {start, end};
+        return true;
+    }
+
+    bool sequence(Fragment *fragment) {
+        const int start = nfa.addState();
+        int end = start;
+        while (!atEnd() && peek() != '|' && peek() != ')') {
+            Fragment next;
+            if (!repeat(&next))
+                return false;
+            nfa.addEdge(end, next.start);
+            end = next.end;
+        }
+        *fragment = {start, end};
+        return true;
+    }
+
+    bool repeat(Fragment *fragment) {
+        const int atomStart = position;
+        Fragment atomFragment;
+        if (!atom(&atomFragment))
+            return false;
+        if (atEnd()) {
+            *fragment = atomFragment;
+            return true;
+        }
+
+        int minimum = 1;
+        int maximum = 1;
+        switch (peek()) {
+        case '*':
+            minimum = 0;
+            maximum = -1;
+            ++position;
+            break;
+        case '+':
+            maximum = -1;
+            ++position;
+            break;
+        case '?':
+            minimum = 0;
+            ++position;
+            break;
+        case '{':
+            if (!bounds(&minimum, &maximum))
+                return false;
+            break;
+        default:
+            *fragment = atomFragment;
+            return true;
+        }
+        if (!atEnd() && (peek() == '*' || peek() == '+' || peek() == '?' || peek() == '{')) {
+            message = "lazy, possessive and nested quantifiers are not supported";
+            return false;
+        }
+
+        // Every copy beyond the first is parsed again from the same text.
+        const int resume = position;
+        auto copy = [&](Fragment *next) {
+            position = atomStart;
+            const bool parsed = atom(next);
+            position = resume;
+            return parsed;
+        };
+
+        const int start = nfa.addState();
+        int end = start;
+        const int copies = qMax(1, maximum < 0 ? minimum + 1 : maximum);
+        for (int i = 0; i < copies; ++i) {
+            Fragment piece = atomFragment;
+            if (i > 0 && !copy(&piece))
+                return false;
+            if (i < minimum) {
+                nfa.addEdge(end, piece.start);
+                end = piece.end;
+            } else if (maximum < 0) {
+                // The last copy loops for an unbounded repeat.
+                const int next = nfa.addState();
+                nfa.addEdge(end, piece.start);
+                nfa.addEdge(piece.end, piece.start);
+                nfa.addEdge(piece.end, next);
+                nfa.addEdge(end, next);
+                end = next;
+            } else {
+                const int next = nfa.addState();
+                nfa.addEdge(end, piece.start);
+                nfa.addEdge(piece.end, next);
+                nfa.addEdge(end, next);
+                end = next;
+            }
+        }
+        *fragment = {start, end};
+        return true;
+    }
+
+    bool bounds(int *minimum, int *maximum) {
+        ++position;
+        auto number = [this](int *value) {
+            const int from = position;
+            while (!atEnd() && peek() >= '0' && peek() <= '9')
+                ++position;
+            *value = pattern.mid(from, position - from).toInt();
+            return position > from;
+        };
+        if (!number(minimum)) {
+            message = "expected a repeat count";
+            return false;
+        }
+        *maximum = *minimum;
+        if (!atEnd() && peek() == ',') {
+            ++position;
+            if (!number(maximum))
+                *maximum = -1;
+        }
+        if (atEnd() || peek() != '}') {
+            message = "expected '}'";
+            return false;
+        }
+        ++position;
+        if (*minimum > maxRepeat || *maximum > maxRepeat || *maximum == 0 || (*maximum >= 0 && *maximum < *minimum)) {
+            message = "bad repeat count";
+            return false;
+        }
+        return true;
+    }
+
+    bool atom(Fragment *fragment) {
+        if (atEnd()) {
+            message = "unexpected end of pattern";
+            return false;
+        }
+        CharSet set;
+        const char16_t c = peek();
+        ++position;
+        switch (c) {
+        case '(':
+            if (pattern.mid(position, 2) == QLatin1String("?:"))
+                position += 2;
+            if (!alternation(fragment))
+                return false;
+            if (atEnd() || peek() != ')') {
+                message = "expected ')'";
+                return false;
+            }
+            ++position;
+            return true;
+        case '[':
+            if (!characterClass(&set))
+                return false;
+            break;
+        case '.':
+            set = CharSet{{0, 0xffff}};
+            break;
+        case '\\':
+            if (!escape(&set))
+                return false;
+            break;
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            --position;
+            message = "nothing to repeat";
+            return false;
+        case '^':
+        case '$':
+            --position;
+            message = "anchors are only supported at the start of a rule";
+            return false;
+        default:
+            set = single(c);
+            break;
+        }
+        const int start = nfa.addState();
+        const int end = nfa.addState();
+        nfa.addEdge(start, end, nfa.addSet(set));
+        *fragment = {start, end};
+        return true;
+    }
+
+    bool escape(CharSet *set) {
+        if (atEnd()) {
+            message = "trailing backslash";
+            return false;
+        }
+        const char16_t c = peek();
+        ++position;
+        static const CharSet digits{{'0', '9'}};
+        static const CharSet word = normalized(CharSet{{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}});
+        static const CharSet space = normalized(CharSet{{'\t', '\r'}, {' ', ' '}});
+        switch (c) {
+        case 'd':
+            *set = digits;
+            return true;
+        case 'D':
+            *set = negated(digits);
+            return true;
+        case 'w':
+            *set = word;
+            return true;
+        case 'W':
+            *set = negated(word);
+            return true;
+        case 's':
+            *set = space;
+            return true;
+        case 'S':
+            *set = negated(space);
+            return true;
+        case 't':
+            *set = single('\t');
+            return true;
+        case 'n':
+            *set = single('\n');
+            return true;
+        case 'r':
+            *set = single('\r');
+            return true;
+        case 'f':
+            *set = single('\f');
+            return true;
+        case 'v':
+            *set = single('\v');
+            return true;
+        case 'u': {
+            bool ok = false;
+            const uint code = pattern.mid(position, 4).toUInt(&ok, 16);
+            if (!ok || position + 4 > pattern.size()) {
+                message = "expected four hex digits";
+                return false;
+            }
+            position += 4;
+            *set = single(char16_t(code));
+            return true;
+        }
+        default:
+            break;
+        }
+        if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+            --position;
+            message = "unsupported escape";
+            return false;
+        }
+        *set = single(c);
+        return true;
+    }
+
+    bool characterClass(CharSet *set) {
+        bool negate = false;
+        if (!atEnd() && peek() == '^') {
+            negate = true;
+            ++position;
+        }
+        CharSet members;
+        bool first = true;
+        while (!atEnd() && (peek() != ']' || first)) {
+            first = false;
+            CharSet item;
+            const char16_t c = peek();
+            ++position;
+            if (c == '\\') {
+                if (!escape(&item))
+                    return false;
+            } else {
+                item = single(c);
+            }
+            // A range needs single characters at both ends.
+            if (item.size() == 1 && item.first().first == item.first().last && position + 1 < pattern.size()
+                && peek() == '-' && pattern.at(position + 1).unicode() != ']') {
+                ++position;
+                CharSet last;
+                const char16_t d = peek();
+                ++position;
+                if (d == '\\') {
+                    if (!escape(&last))
+                        return false;
+                } else {
+                    last = single(d);
+                }
+                if (last.size() != 1 || last.first().first != last.first().last || last.first().first < item.first().first) {
+                    message = "bad range";
+                    return false;
+                }
+                item.first().last = last.first().first;
+            }
+            members += item;
+        }
+        if (atEnd()) {
+            message = "expected ']'";
+            return false;
+        }
+        ++position;
+        members = normalized(members);
+        *set = negate ? negated(members) : members;
+        return true;
+    }
+
+    const QString &pattern;
+    Nfa &nfa;
+    int position = 0;
+    QString message;
+};
+
+// NFA states reachable from states through epsilon edges, sorted.
+QVector<int> closure(const Nfa &nfa, QVector<int> states, QVector<int> &marks, int &stamp) {
+    ++stamp;
+    QVector<int> stack = states;
+    for (int state : std::as_const(states))
+        marks[state] = stamp;
+    while (!stack.isEmpty()) {
+        const int state = stack.takeLast();
+        for (const NfaEdge &edge : nfa.states.at(state).edges) {
+            if (edge.set < 0 && marks[edge.target] != stamp) {
+                marks[edge.target] = stamp;
+                states.append(edge.target);
+                stack.append(edge.target);
+            }
+        }
+    }
+    std::sort(states.begin(), states.end());
+    return states;
+}
+
+} // namespace
+
+bool RegexDfa::compile(const QStringList &patterns, QString *error) {
+    Nfa nfa;
+    const int start = nfa.addState();
+    for (int i = 0; i < patterns.size(); ++i) {
+        int patternStart = 0;
+        int patternEnd = 0;
+        Parser parser(patterns.at(i), nfa);
+        if (!parser.parse(&patternStart, &patternEnd, error))
+            return false;
+        nfa.addEdge(start, patternStart);
+        nfa.states[patternEnd].accept = i;
+    }
+
+    // Split the code units into intervals no character set cuts through,
+    // then merge intervals every set treats alike into one class.
+    QVector<int> boundaries{0};
+    for (const CharSet &set : std::as_const(nfa.sets)) {
+        for (const CharRange &range : set) {
+            boundaries.append(range.first);
+            if (range.last < 0xffff)
+                boundaries.append(range.last + 1);
+        }
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+    QHash<QByteArray, int> classIds;
+    QVector<int> intervalClasses;
+    QVector<QVector<bool>> setClasses(nfa.sets.size());
+    for (int interval = 0; interval < boundaries.size(); ++interval) {
+        const int c = boundaries.at(interval);
+        QByteArray signature(int(nfa.sets.size()), '0');
+        for (int s = 0; s < nfa.sets.size(); ++s) {
+            for (const CharRange &range : nfa.sets.at(s)) {
+                if (c >= range.first && c <= range.last) {
+                    signature[s] = '1';
+                    break;
+                }
+            }
+        }
+        auto it = classIds.constFind(signature);
+        int id;
+        if (it == classIds.constEnd()) {
+            id = int(classIds.size());
+            classIds.insert(signature, id);
+            for (int s = 0; s < nfa.sets.size(); ++s)
+                setClasses[s].append(signature.at(s) == '1');
+        } else {
+            id = it.value();
+        }
+        intervalClasses.append(id);
+    }
+    classCount = int(classIds.size());
+    compiledPatterns = int(patterns.size());
+
+    asciiClasses.fill(0, 128);
+    rangeStarts.clear();
+    rangeClasses.clear();
+    for (int interval = 0; interval < boundaries.size(); ++interval) {
+        const int first = boundaries.at(interval);
+        const int last = interval + 1 < boundaries.size() ? boundaries.at(interval + 1) - 1 : 0xffff;
+        for (int c = first; c <= qMin(last, 127); ++c)
+            asciiClasses[c] = intervalClasses.at(interval);
+        if (last >= 128) {
+            const int id = intervalClasses.at(interval);
+            if (rangeClasses.isEmpty() || rangeClasses.last() != id) {
+                rangeStarts.append(quint16(qMax(first, 128)));
+                rangeClasses.append(id);
+            }
+        }
+    }
+
+    // Subset construction.
+    QVector<int> marks(nfa.states.size(), 0);
+    int stamp = 0;
+    QHash<QVector<int>, int> stateIds;
+    QVector<QVector<int>> dfaStates;
+    transitions.clear();
+    accepting.clear();
+    const QVector<int> initial = closure(nfa, {start}, marks, stamp);
+    stateIds.insert(initial, 0);
+    dfaStates.append(initial);
+    for (int current = 0; current < dfaStates.size(); ++current) {
+        const QVector<int> members = dfaStates.at(current);
+        int accept = -1;
+        for (int state : members) {
+            const int pattern = nfa.states.at(state).accept;
+            if (pattern >= 0 && (accept < 0 || pattern < accept))
+                accept = pattern;
+        }
+        if (current == 0 && accept >= 0) {
+            *error = QString("\"%1\" matches the empty string").arg(patterns.at(accept));
+            return false;
+        }
+        accepting.append(accept);
+
+        for (int c = 0; c < classCount; ++c) {
+            QVector<int> targets;
+            for (int state : members) {
+                for (const NfaEdge &edge : nfa.states.at(state).edges) {
+                    if (edge.set >= 0 && setClasses.at(edge.set).at(c))
+                        targets.append(edge.target);
+                }
+            }
+            if (targets.isEmpty()) {
+                transitions.append(-1);
+                continue;
+            }
+            targets = closure(nfa, targets, marks, stamp);
+            auto it = stateIds.constFind(targets);
+            if (it != stateIds.constEnd()) {
+                transitions.append(it.value());
+                continue;
+            }
+            if (dfaStates.size() >= maxDfaStates) {
+                *error = "the patterns need too many automaton states";
+                return false;
+            }
+            const int id = int(dfaStates.size());
+            stateIds.insert(targets, id);
+            dfaStates.append(targets);
+            transitions.append(id);
+        }
+    }
+    return true;
+}
+
+bool RegexDfa::isEmpty() const {
+    return accepting.isEmpty();
+}
+
+int RegexDfa::stateCount() const {
+    return int(accepting.size());
+}
+
+int RegexDfa::patternCount() const {
+    return compiledPatterns;
+}
+
+int RegexDfa::nonAsciiClassOf(char16_t c) const {
+    // The first range starts at 128, so there is always one at or below c.
+    const auto it = std::upper_bound(rangeStarts.constBegin(), rangeStarts.constEnd(), quint16(c));
+    return rangeClasses.at(int(it - rangeStarts.constBegin()) - 1);
+}
+
+int RegexDfa::match(const QChar *text, int length, int from, int *end) const {
+    if (accepting.isEmpty())
+        return -1;
+    const int *table = transitions.constData();
+    int state = 0;
+    int pattern = -1;
+    for (int i = from; i < length; ++i) {
+        state = table[state * classCount + classOf(text[i].unicode())];
+        if (state < 0)
+            break;
+        if (accepting.at(state) >= 0) {
+            pattern = accepting.at(state);
+            *end = i + 1;
+        }
+    }
+    return pattern;
+}
+
+int RegexDfa::find(const QChar *text, int length, int from, int *end, int *pattern) const {
+    if (accepting.isEmpty())
+        return -1;
+    const int *table = transitions.constData();
+    for (int i = from; i < length; ++i) {
+        // Most positions cannot even start a match.
+        if (table[classOf(text[i].unicode())] < 0)
+            continue;
+        const int matched = match(text, length, i, end);
+        if (matched >= 0) {
+            if (pattern)
+                *pattern = matched;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RegexDfa::write(QDataStream &stream) const {
+    stream << qint32(compiledPatterns) << qint32(classCount) << asciiClasses << rangeStarts << rangeClasses << transitions << accepting;
+}
+
+bool RegexDfa::read(QDataStream &stream) {
+    qint32 patternTotal = 0;
+    qint32 classes = 0;
+    stream >> patternTotal >> classes >> asciiClasses >> rangeStarts >> rangeClasses >> transitions >> accepting;
+    compiledPatterns = patternTotal;
+    classCount = classes;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    // A damaged cache must not index out of bounds.
+    const int states = int(accepting.size());
+    bool valid = classCount > 0 && asciiClasses.size() == 128 && rangeStarts.size() == rangeClasses.size()
+                 && !rangeStarts.isEmpty() && rangeStarts.first() == 128
+                 && transitions.size() == qsizetype(states) * classCount;
+    for (int i = 0; valid && i < asciiClasses.size(); ++i)
+        valid = asciiClasses.at(i) >= 0 && asciiClasses.at(i) < classCount;
+    for (int i = 0; valid && i < rangeClasses.size(); ++i)
+        valid = rangeClasses.at(i) >= 0 && rangeClasses.at(i) < classCount;
+    for (int i = 0; valid && i < transitions.size(); ++i)
+        valid = transitions.at(i) >= -1 && transitions.at(i) < states;
+    for (int i = 0; valid && i < accepting.size(); ++i)
+        valid = accepting.at(i) >= -1 && accepting.at(i) < compiledPatterns;
+    if (!valid) {
+        accepting.clear();
+        transitions.clear();
+    }
+    return valid;
+}
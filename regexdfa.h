@@ -0,0 +1,56 @@
+#ifndef REGEXDFA_H
+#define REGEXDFA_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QDataStream;
+
+// A set of regular expressions compiled into one deterministic automaton
+// over UTF-16 code units. From a given position it finds the longest match
+// of any of the patterns in a single forward pass, reporting the earliest
+// pattern on a tie, the way a lexer generator does.
+// Patterns support literals, ".", [...] classes with ranges and negation,
+// \d \w \s and their negations, escapes, grouping with (...) or (?:...),
+// "|", and the *, +, ?, {n}, {n,} and {n,m} quantifiers. There are no
+// anchors or backreferences, and a pattern must not match the empty string.
+class RegexDfa {
+public:
+    bool compile(const QStringList &patterns, QString *error);
+    bool isEmpty() const;
+    int stateCount() const;
+    int patternCount() const;
+
+    // Returns the pattern with the longest match starting at from and sets
+    // end past it, or returns -1.
+    int match(const QChar *text, int length, int from, int *end) const;
+    // Returns the first position at or after from where a pattern matches,
+    // or -1.
+    int find(const QChar *text, int length, int from, int *end, int *pattern = nullptr) const;
+
+    void write(QDataStream &stream) const;
+    bool read(QDataStream &stream);
+
+private:
+    int classOf(char16_t c) const {
+        if (c < 128)
+            return asciiClasses.at(c);
+        return nonAsciiClassOf(c);
+    }
+    int nonAsciiClassOf(char16_t c) const;
+
+    int compiledPatterns = 0;
+    int classCount = 0;
+    // Code units below 128 map through asciiClasses, the rest through the
+    // sorted ranges starting at rangeStarts.
+    QVector<int> asciiClasses;
+    QVector<quint16> rangeStarts;
+    QVector<int> rangeClasses;
+    // transitions[state * classCount + class] is -1 where no pattern can
+    // match any more; state 0 is the start.
+    QVector<int> transitions;
+    QVector<int> accepting;
+};
+
+#endif // REGEXDFA_H
@@ -0,0 +1,254 @@
+#include "searchengine.h"
+#include "literalsearch.h"
+#include "piecetable.h"
+#include "utf8decoder.h"
+
+// Units (characters or bytes) per chunk handed to a worker.
+static const qint64 chunkSize = 4 * 1024 * 1024;
+
+static QString expandReplacement(const QString &replacement, const QRegularExpressionMatch &match) {
+    QString result;
+    result.reserve(replacement.size());
+    for (int i = 0; i < replacement.size(); ++i) {
+        const QChar c = replacement.at(i);
+        if (c == QLatin1Char('\\') && i + 1 < replacement.size()) {
+            const QChar next = replacement.at(i + 1);
+            if (next.isDigit()) {
+                result += match.captured(next.digitValue());
+                ++i;
+                continue;
+            }
+            if (next == QLatin1Char('\\')) {
+                result += next;
+                ++i;
+                continue;
+            }
+        }
+        result += c;
+    }
+    return result;
+}
+
+SearchEngine::SearchEngine(QObject *parent) : QObject(parent), generation(0) {}
+
+SearchEngine::~SearchEngine() {
+    ++generation;
+    pool.clear();
+    pool.waitForDone();
+}
+
+bool SearchEngine::isSearching() const {
+    return searching;
+}
+
+QString SearchEngine::errorString() const {
+    return error;
+}
+
+qint64 SearchEngine::bytesSearched() const {
+    return searchedBytes;
+}
+
+qint64 SearchEngine::elapsed() const {
+    return timer.isValid() ? timer.elapsed() : 0;
+}
+
+void SearchEngine::cancel() {
+    ++generation;
+    pool.clear();
+    // Workers may be reading the caller's document; wait so it can be
+    // edited as soon as this returns.
+    pool.waitForDone();
+    if (!searching)
+        return;
+    searching = false;
+    pendingChunks.clear();
+    emit finished(false);
+}
+
+bool SearchEngine::prepare(const SearchOptions &options) {
+    cancel();
+    error.clear();
+    if (options.pattern.isEmpty()) {
+        error = "Nothing to find";
+        return false;
+    }
+
+    this->options = options;
+    // Case-insensitive plain text goes through the regex engine as an
+    // escaped pattern; the literal kernel compares units exactly.
+    useRegex = options.regularExpression || !options.caseSensitive;
+    if (useRegex) {
+        // ^ and $ match at every line, and \r\n counts as one line end so
+        // that . never eats the \r of a large file's line ending.
+        const QString pattern = options.regularExpression ? options.pattern : QRegularExpression::escape(options.pattern);
+        regex.setPattern(QStringLiteral("(*ANYCRLF)") + pattern);
+        regex.setPatternOptions(QRegularExpression::MultilineOption
+                                | (options.caseSensitive ? QRegularExpression::NoPatternOption
+                                                         : QRegularExpression::CaseInsensitiveOption));
+        if (!regex.isValid()) {
+            error = regex.errorString();
+            return false;
+        }
+        // Compile now, on this thread, so the workers only ever match.
+        regex.optimize();
+    }
+    utf8Needle = options.pattern.toUtf8();
+    return true;
+}
+
+void SearchEngine::start(int chunkCount) {
+    this->chunkCount = chunkCount;
+    nextChunk = 0;
+    pendingChunks.clear();
+    searching = true;
+    timer.start();
+}
+
+bool SearchEngine::search(const QString &text, const SearchOptions &options) {
+    if (!prepare(options))
+        return false;
+
+    // Chunk ends are moved forward to the next block separator.
+    QVector<qint64> bounds = {0};
+    const QStringView view(text);
+    while (bounds.last() < text.size()) {
+        const qint64 nominal = bounds.last() + chunkSize;
+        qint64 end = nominal < text.size() ? view.indexOf(QChar::ParagraphSeparator, nominal) : -1;
+        bounds.append(end < 0 ? text.size() : end + 1);
+    }
+
+    // PCRE does not take U+2029 for a line break, so . and \s would run
+    // from block to block. The regex searches a copy with '\n' instead;
+    // both are one unit, so hit positions are unchanged.
+    QString searched = text;
+    if (useRegex)
+        searched.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+
+    searchedBytes = text.size() * qint64(sizeof(QChar));
+    const int count = qMax(1, int(bounds.size()) - 1);
+    start(count);
+    const int searchGeneration = generation;
+    for (int chunk = 0; chunk < count; ++chunk) {
+        const qint64 from = bounds.value(chunk);
+        const qint64 to = bounds.value(chunk + 1, from);
+        pool.start([this, searched, from, to, chunk, searchGeneration]() {
+            QVector<SearchHit> hits;
+            if (generation == searchGeneration)
+                searchTextChunk(searched, from, to, hits);
+            QMetaObject::invokeMethod(this, [this, chunk, hits, searchGeneration]() {
+                chunkFinished(chunk, hits, searchGeneration);
+            }, Qt::QueuedConnection);
+        });
+    }
+    return true;
+}
+
+bool SearchEngine::search(const std::shared_ptr<const PieceTable> &document, const SearchOptions &options) {
+    if (!prepare(options))
+        return false;
+
+    // Chunk ends are moved forward to the start of the next line.
+    QVector<qint64> bounds = {0};
+    while (bounds.last() < document->size()) {
+        const qint64 line = document->lineAt(bounds.last() + chunkSize);
+        bounds.append(line + 1 < document->lineCount() ? document->lineStart(line + 1) : document->size());
+    }
+
+    searchedBytes = document->size();
+    const int count = qMax(1, int(bounds.size()) - 1);
+    start(count);
+    const int searchGeneration = generation;
+    for (int chunk = 0; chunk < count; ++chunk) {
+        const qint64 from = bounds.value(chunk);
+        const qint64 to = bounds.value(chunk + 1, from);
+        pool.start([this, document, from, to, chunk, searchGeneration]() {
+            QVector<SearchHit> hits;
+            if (generation == searchGeneration)
+                searchBytesChunk(document->text(from, to - from), from, hits);
+            QMetaObject::invokeMethod(this, [this, chunk, hits, searchGeneration]() {
+                chunkFinished(chunk, hits, searchGeneration);
+            }, Qt::QueuedConnection);
+        });
+    }
+    return true;
+}
+
+void SearchEngine::searchTextChunk(const QString &text, qint64 from, qint64 to, QVector<SearchHit> &hits) const {
+    if (from >= to)
+        return;
+
+    if (!useRegex) {
+        const QStringView chunk = QStringView(text).mid(from, to - from);
+        const QStringView needle(options.pattern);
+        for (qsizetype i = LiteralSearch::indexOf(chunk, needle); i >= 0;
+             i = LiteralSearch::indexOf(chunk, needle, i + needle.size()))
+            hits.append({from + i, needle.size(), options.computeReplacements ? options.replacement : QString()});
+        return;
+    }
+
+    QRegularExpressionMatchIterator it = regex.globalMatch(text.mid(from, to - from));
+    while (it.hasNext()) {
+        const QRegularExpressionMatch match = it.next();
+        if (match.capturedLength() == 0)
+            continue;
+        hits.append({from + match.capturedStart(), match.capturedLength(),
+                     options.computeReplacements ? expandReplacement(options.replacement, match) : QString()});
+    }
+}
+
+void SearchEngine::searchBytesChunk(const QByteArray &bytes, qint64 base, QVector<SearchHit> &hits) const {
+    if (bytes.isEmpty())
+        return;
+
+    if (!useRegex) {
+        const qsizetype needleLength = utf8Needle.size();
+        for (qsizetype i = LiteralSearch::indexOf(bytes.constData(), bytes.size(), utf8Needle.constData(), needleLength);
+             i >= 0; i = LiteralSearch::indexOf(bytes.constData(), bytes.size(), utf8Needle.constData(), needleLength, i + needleLength))
+            hits.append({base + i, needleLength, options.computeReplacements ? options.replacement : QString()});
+        return;
+    }
+
+    // Matches come back in UTF-16 offsets. They are converted by walking
+    // the chunk's own bytes alongside the decoded text, so the chunk is
+    // measured only once and invalid UTF-8 does not shift later hits.
+    const QString text = Utf8Decoder::decode(bytes);
+    qint64 unit = 0;
+    qint64 byte = 0;
+    const auto advanceTo = [&](qint64 target) {
+        while (unit < target && byte < bytes.size()) {
+            char32_t code;
+            byte += Utf8Decoder::decodeCharacter(bytes.constData() + byte, bytes.size() - byte, &code);
+            unit += Utf8Decoder::unitsFor(code);
+        }
+    };
+    QRegularExpressionMatchIterator it = regex.globalMatch(text);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch match = it.next();
+        if (match.capturedLength() == 0)
+            continue;
+        advanceTo(match.capturedStart());
+        const qint64 start = byte;
+        advanceTo(match.capturedEnd());
+        hits.append({base + start, byte - start,
+                     options.computeReplacements ? expandReplacement(options.replacement, match) : QString()});
+    }
+}
+
+void SearchEngine::chunkFinished(int chunk, const QVector<SearchHit> &hits, int searchGeneration) {
+    if (searchGeneration != generation || !searching)
+        return;
+    pendingChunks.insert(chunk, hits);
+
+    // Release hits in document order; later chunks wait for earlier ones.
+    while (!pendingChunks.isEmpty() && pendingChunks.firstKey() == nextChunk) {
+        const QVector<SearchHit> ready = pendingChunks.take(nextChunk);
+        ++nextChunk;
+        if (!ready.isEmpty())
+            emit hitsFound(ready);
+    }
+    if (nextChunk == chunkCount) {
+        searching = false;
+        emit finished(true);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef SEARCHENGINE_H
+#define SEARCHENGINE_H
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QObject>
+#include <QRegularExpression>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+class PieceTable;
+
+struct SearchOptions {
+    QString pattern;
+    bool regularExpression = false;
+    bool caseSensitive = true;
+    // When set, every hit carries its replacement, with \0-\9 expanded from
+    // the match for regular expressions.
+    bool computeReplacements = false;
+    QString replacement;
+};
+
+struct SearchHit {
+    qint64 position;
+    qint64 length;
+    QString replacement;
+};
+
+// Find-all over a whole document on a thread pool. The text is cut into
+// chunks at line boundaries and each chunk is searched independently, by
+// LiteralSearch for plain case-sensitive strings and by QRegularExpression
+// otherwise. Hits are reported in document order as soon as every chunk
+// before them is done. Regular expressions see lines as lines: ^ and $
+// match at each one and . stops at its end. Matches never span a chunk
+// boundary, so a regular expression that crosses a line break can miss a
+// few of them.
+class SearchEngine : public QObject {
+    Q_OBJECT
+public:
+    explicit SearchEngine(QObject *parent = nullptr);
+    ~SearchEngine();
+
+    // Hit positions are UTF-16 offsets into text.
+    bool search(const QString &text, const SearchOptions &options);
+    // Hit positions are byte offsets. The table must not be edited until
+    // finished() has been emitted.
+    bool search(const std::shared_ptr<const PieceTable> &document, const SearchOptions &options);
+
+    bool isSearching() const;
+    QString errorString() const;
+    qint64 bytesSearched() const;
+    qint64 elapsed() const;
+
+public slots:
+    void cancel();
+
+signals:
+    void hitsFound(const QVector<SearchHit> &hits);
+    void finished(bool completed);
+
+private:
+    bool prepare(const SearchOptions &options);
+    void start(int chunkCount);
+    void searchTextChunk(const QString &text, qint64 from, qint64 to, QVector<SearchHit> &hits) const;
+    void searchBytesChunk(const QByteArray &bytes, qint64 base, QVector<SearchHit> &hits) const;
+    void chunkFinished(int chunk, const QVector<SearchHit> &hits, int searchGeneration);
+
+    QThreadPool pool;
+    std::atomic<int> generation;
+    SearchOptions options;
+    QRegularExpression regex;
+    bool useRegex = false;
+    QByteArray utf8Needle;
+    QMap<int, QVector<SearchHit>> pendingChunks;
+    int nextChunk = 0;
+    int chunkCount = 0;
+    bool searching = false;
+    qint64 searchedBytes = 0;
+    QElapsedTimer timer;
+    QString error;
+};
+
+#endif // SEARCHENGINE_H
@@ -0,0 +1,59 @@
+#include "startuptime.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_MACOS)
+#include <sys/sysctl.h>
+#include <sys/time.h>
+#include <unistd.h>
+#elif defined(Q_OS_LINUX)
+#include <QFile>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace StartupTime {
+
+qint64 sinceProcessStart() {
+#if defined(Q_OS_WIN)
+    FILETIME creation, exit, kernel, user, now;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return -1;
+    GetSystemTimePreciseAsFileTime(&now);
+    auto ticks = [](const FILETIME &time) {
+        return (qint64(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    // FILETIME counts 100 ns intervals.
+    return (ticks(now) - ticks(creation)) / 10000;
+#elif defined(Q_OS_MACOS)
+    int mib[] = {CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid()};
+    kinfo_proc info;
+    size_t size = sizeof(info);
+    if (sysctl(mib, 4, &info, &size, nullptr, 0) != 0)
+        return -1;
+    timeval now;
+    gettimeofday(&now, nullptr);
+    const timeval &start = info.kp_proc.p_starttime;
+    return (qint64(now.tv_sec) - start.tv_sec) * 1000 + (qint64(now.tv_usec) - start.tv_usec) / 1000;
+#elif defined(Q_OS_LINUX)
+    // Field 22 of stat is the start time in clock ticks since boot. The
+    // command name before it may contain spaces, so count from its ')'.
+    QFile stat(QStringLiteral("/proc/self/stat"));
+    if (!stat.open(QIODevice::ReadOnly))
+        return -1;
+    const QByteArray contents = stat.readAll();
+    const QList<QByteArray> fields = contents.mid(contents.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 20)
+        return -1;
+    const qint64 startTicks = fields.at(19).toLongLong();
+    timespec now;
+    if (clock_gettime(CLOCK_BOOTTIME, &now) != 0)
+        return -1;
+    const qint64 ticksPerSecond = sysconf(_SC_CLK_TCK);
+    return qint64(now.tv_sec) * 1000 + now.tv_nsec / 1000000 - startTicks * 1000 / ticksPerSecond;
+#else
+    return -1;
+#endif
+}
+
+} // namespace StartupTime
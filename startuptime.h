@@ -0,0 +1,15 @@
+#ifndef STARTUPTIME_H
+#define STARTUPTIME_H
+
+#include <QtGlobal>
+
+// Cold start measurement. The start is taken from the operating system's
+// record of when the process was created, so dynamic linking and static
+// initialization are counted too.
+namespace StartupTime {
+// Milliseconds since the process was created, or -1 on platforms where the
+// creation time is not available.
+qint64 sinceProcessStart();
+}
+
+#endif // STARTUPTIME_H
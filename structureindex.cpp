@@ -0,0 +1,269 @@
+#include "structureindex.h"
+#include <QTextDocument>
+#include <algorithm>
+
+namespace {
+
+const char16_t openers[] = {u'(', u'[', u'{'};
+const char16_t closers[] = {u')', u']', u'}'};
+
+// Index into openers and closers, or -1 for anything else.
+int pairOf(char16_t c) {
+    for (int i = 0; i < 3; ++i) {
+        if (c == openers[i] || c == closers[i])
+            return i;
+    }
+    return -1;
+}
+
+bool isLiteralOrComment(HighlightLexer::TokenKind kind) {
+    switch (kind) {
+    case HighlightLexer::SingleLineComment:
+    case HighlightLexer::MultiLineComment:
+    case HighlightLexer::Quotation:
+    case HighlightLexer::Key:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+StructureIndex::StructureIndex(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document) {
+    connect(document, &QTextDocument::contentsChange, this, &StructureIndex::onContentsChange);
+}
+
+void StructureIndex::scan(QStringView text, const QVector<HighlightLexer::Token> &tokens,
+                          QVector<BlockData::Bracket> &brackets) {
+    brackets.clear();
+    int token = 0;
+    for (int i = 0; i < text.size(); ++i) {
+        const char16_t c = text.at(i).unicode();
+        if (pairOf(c) < 0)
+            continue;
+        // Tokens come in column order and do not overlap.
+        while (token < tokens.size() && tokens.at(token).start + tokens.at(token).length <= i)
+            ++token;
+        if (token < tokens.size() && tokens.at(token).start <= i && isLiteralOrComment(tokens.at(token).kind))
+            continue;
+        brackets.append({i, c});
+    }
+}
+
+void StructureIndex::setBrackets(const QTextBlock &block, QVector<BlockData::Bracket> brackets) {
+    // Most lines have none; they need no data of their own.
+    if (brackets.isEmpty() && !BlockData::find(block))
+        return;
+    BlockData::Balances balances;
+    for (int pair = 0; pair < 3; ++pair) {
+        BlockData::Balance &balance = balances[pair];
+        int depth = 0;
+        for (const BlockData::Bracket &bracket : std::as_const(brackets)) {
+            if (pairOf(bracket.character) != pair)
+                continue;
+            depth += bracket.character == openers[pair] ? 1 : -1;
+            balance.forwardLow = qMin(balance.forwardLow, depth);
+        }
+        balance.net = depth;
+        depth = 0;
+        for (int i = int(brackets.size()) - 1; i >= 0; --i) {
+            if (pairOf(brackets.at(i).character) != pair)
+                continue;
+            depth += brackets.at(i).character == closers[pair] ? 1 : -1;
+            balance.backwardLow = qMin(balance.backwardLow, depth);
+        }
+    }
+    BlockData::of(block)->setBrackets(std::move(brackets), balances);
+}
+
+bool StructureIndex::findMatch(int position, int *match, int blockLimit) const {
+    QTextBlock block = document->findBlock(position);
+    const BlockData *data = BlockData::find(block);
+    if (!data)
+        return false;
+    const QVector<BlockData::Bracket> &brackets = data->brackets();
+    const int column = position - block.position();
+    const auto found = std::lower_bound(brackets.begin(), brackets.end(), column,
+                                        [](const BlockData::Bracket &bracket, int column) {
+        return bracket.column < column;
+    });
+    // A block waiting for the background highlighter may still list the
+    // brackets of its old text.
+    if (found == brackets.end() || found->column != column
+        || document->characterAt(position).unicode() != found->character)
+        return false;
+
+    const int pair = pairOf(found->character);
+    const char16_t open = openers[pair];
+    const char16_t close = closers[pair];
+    const bool forward = found->character == open;
+    int index = int(found - brackets.begin());
+    int depth = 0;
+    *match = -1;
+    for (int blocks = 0;; ++blocks) {
+        // Lines that cannot bring the depth back to zero are stepped over
+        // on their balance alone, so a distant partner costs a visit per
+        // line rather than a look at every bracket on the way.
+        const BlockData::Balance *balance = data && blocks > 0 ? &data->balance(pair) : nullptr;
+        if (balance && depth + (forward ? balance->forwardLow : balance->backwardLow) > 0) {
+            depth += forward ? balance->net : -balance->net;
+        } else if (data) {
+            const QVector<BlockData::Bracket> &list = data->brackets();
+            for (; index >= 0 && index < list.size(); index += forward ? 1 : -1) {
+                const char16_t c = list.at(index).character;
+                if (c == (forward ? open : close)) {
+                    ++depth;
+                } else if (c == (forward ? close : open) && --depth == 0) {
+                    *match = block.position() + list.at(index).column;
+                    return true;
+                }
+            }
+        }
+        block = forward ? block.next() : block.previous();
+        if (!block.isValid())
+            return true;
+        if (blockLimit >= 0 && blocks >= blockLimit)
+            return false;
+        data = BlockData::find(block);
+        index = forward || !data ? 0 : int(data->brackets().size()) - 1;
+    }
+}
+
+int StructureIndex::foldOpener(const QTextBlock &block) const {
+    const BlockData *data = BlockData::find(block);
+    if (!data)
+        return -1;
+    const QVector<BlockData::Bracket> &brackets = data->brackets();
+    for (int i = 0; i < brackets.size(); ++i) {
+        const char16_t open = brackets.at(i).character;
+        if (open != u'{' && open != u'[')
+            continue;
+        const char16_t close = closers[pairOf(open)];
+        int depth = 0;
+        int j = i;
+        for (; j < brackets.size(); ++j) {
+            if (brackets.at(j).character == open)
+                ++depth;
+            else if (brackets.at(j).character == close && --depth == 0)
+                break;
+        }
+        if (j == brackets.size())
+            return i;
+    }
+    return -1;
+}
+
+bool StructureIndex::isFoldable(const QTextBlock &block) const {
+    return foldOpener(block) >= 0;
+}
+
+bool StructureIndex::isFolded(const QTextBlock &block) const {
+    const BlockData *data = BlockData::find(block);
+    return data && data->foldedBlocks > 0;
+}
+
+bool StructureIndex::fold(const QTextBlock &block) {
+    if (isFolded(block))
+        return true;
+    const int opener = foldOpener(block);
+    if (opener < 0)
+        return false;
+    int match = -1;
+    if (!findMatch(block.position() + BlockData::find(block)->brackets().at(opener).column, &match) || match < 0)
+        return false;
+
+    // The line with the closing brace stays visible.
+    const QTextBlock end = document->findBlock(match);
+    const int hidden = end.blockNumber() - block.blockNumber() - 1;
+    if (hidden <= 0)
+        return false;
+    BlockData::of(block)->foldedBlocks = hidden;
+    ++foldCount;
+    for (QTextBlock next = block.next(); next != end; next = next.next())
+        next.setVisible(false);
+    const int from = block.next().position();
+    document->markContentsDirty(from, end.position() - from);
+    return true;
+}
+
+void StructureIndex::unfold(const QTextBlock &block) {
+    if (!isFolded(block))
+        return;
+    BlockData *data = BlockData::of(block);
+    int remaining = data->foldedBlocks;
+    data->foldedBlocks = 0;
+    --foldCount;
+
+    QTextBlock next = block.next();
+    const int from = next.position();
+    while (remaining > 0 && next.isValid()) {
+        next.setVisible(true);
+        // Folds inside this one stay closed.
+        const BlockData *inner = BlockData::find(next);
+        int skip = 1 + (inner ? inner->foldedBlocks : 0);
+        for (; skip > 0 && next.isValid(); --skip, --remaining)
+            next = next.next();
+    }
+    const int to = next.isValid() ? next.position() : document->characterCount();
+    if (to > from)
+        document->markContentsDirty(from, to - from);
+}
+
+void StructureIndex::toggleFold(const QTextBlock &block) {
+    if (isFolded(block))
+        unfold(block);
+    else
+        fold(block);
+}
+
+void StructureIndex::unfoldAll() {
+    if (foldCount == 0)
+        return;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        if (isFolded(block))
+            BlockData::of(block)->foldedBlocks = 0;
+        block.setVisible(true);
+    }
+    foldCount = 0;
+    document->markContentsDirty(0, document->characterCount());
+}
+
+void StructureIndex::reveal(const QTextBlock &block) {
+    while (block.isValid() && !block.isVisible()) {
+        // With nested folds the outermost one is opened first.
+        QTextBlock owner = block.previous();
+        while (owner.isValid() && !owner.isVisible())
+            owner = owner.previous();
+        if (!owner.isValid() || !isFolded(owner)) {
+            // The fold lost its first line to an edit.
+            QTextBlock hidden = block;
+            hidden.setVisible(true);
+            document->markContentsDirty(hidden.position(), hidden.length());
+            return;
+        }
+        unfold(owner);
+    }
+}
+
+void StructureIndex::onContentsChange(int position, int charsRemoved, int charsAdded) {
+    Q_UNUSED(charsRemoved);
+    if (foldCount == 0)
+        return;
+
+    // An edit inside a fold, on its first line or on the line that closes
+    // it may move the brace the fold ends at, so those folds open.
+    QTextBlock block = document->findBlock(position);
+    const QTextBlock last = document->findBlock(position + charsAdded);
+    while (block.isValid()) {
+        reveal(block);
+        unfold(block);
+        const QTextBlock previous = block.previous();
+        if (previous.isValid() && !previous.isVisible())
+            reveal(previous);
+        if (block == last)
+            break;
+        block = block.next();
+    }
+}
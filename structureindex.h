@@ -0,0 +1,61 @@
+#ifndef STRUCTUREINDEX_H
+#define STRUCTUREINDEX_H
+
+#include <QObject>
+#include <QStringView>
+#include <QTextBlock>
+#include <QVector>
+#include "blockdata.h"
+#include "highlightlexer.h"
+
+class QTextDocument;
+
+// Bracket matching and folding for one QTextDocument. The index is the list
+// of brackets in each block's BlockData, written whenever the highlighter
+// lexes the block, so it follows edits block by block, including the lines
+// whose comment or string state an edit changes, and never rescans the
+// document. Brackets inside strings and comments are left out.
+// A fold hides the blocks between a line that opens a brace and the line
+// that closes it. Edits that reach into a fold open it again.
+class StructureIndex : public QObject {
+    Q_OBJECT
+public:
+    explicit StructureIndex(QTextDocument *document, QObject *parent = nullptr);
+
+    // The brackets of one lexed line; tokens as HighlightLexer::tokenize()
+    // returns them. Safe to call from any thread.
+    static void scan(QStringView text, const QVector<HighlightLexer::Token> &tokens,
+                     QVector<BlockData::Bracket> &brackets);
+    static void setBrackets(const QTextBlock &block, QVector<BlockData::Bracket> brackets);
+
+    // If an indexed bracket sits at position, returns true and sets match to
+    // the position of its partner, or to -1 when it has none. With a
+    // blockLimit the search gives up, returning false, after that many
+    // blocks past the bracket's own.
+    bool findMatch(int position, int *match, int blockLimit = -1) const;
+
+    // A block can be folded when it opens a brace or square bracket that it
+    // does not close itself.
+    bool isFoldable(const QTextBlock &block) const;
+    bool isFolded(const QTextBlock &block) const;
+    // Returns false when block is not foldable or nothing would be hidden.
+    bool fold(const QTextBlock &block);
+    void unfold(const QTextBlock &block);
+    void toggleFold(const QTextBlock &block);
+    void unfoldAll();
+    // Opens every fold hiding block.
+    void reveal(const QTextBlock &block);
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    int foldOpener(const QTextBlock &block) const;
+
+    QTextDocument *document;
+    // Folds opened by unfold() are counted off; ones whose first line was
+    // deleted are not, which only costs onContentsChange() its shortcut.
+    int foldCount = 0;
+};
+
+#endif // STRUCTUREINDEX_H
@@ -1,82 +1,168 @@
 #include "syntaxhighlighter.h"
+#include "structureindex.h"
+#include "tracing.h"
 #include <QTextDocument>
+#include <QTextLayout>
 
 SyntaxHighlighter::SyntaxHighlighter(QTextDocument *parent)
-    : QSyntaxHighlighter(parent) {
-    setupHighlightingRules();
+    : QSyntaxHighlighter(parent), language(HighlightLexer::plainText()) {
 }
 
-void SyntaxHighlighter::setupHighlightingRules() {
-    HighlightingRule rule;
-
-    keywordFormat.setForeground(Qt::blue);
-    keywordFormat.setFontWeight(QFont::Bold);
-    QStringList keywordPatterns;
-    keywordPatterns << "\\bchar\\b" << "\\bclass\\b" << "\\bconst\\b"
-                    << "\\bdouble\\b" << "\\benum\\b" << "\\bexplicit\\b"
-                    << "\\bfriend\\b" << "\\binline\\b" << "\\bint\\b"
-                    << "\\blong\\b" << "\\bnamespace\\b" << "\\boperator\\b"
-                    << "\\bprivate\\b" << "\\bprotected\\b" << "\\bpublic\\b"
-                    << "\\bshort\\b" << "\\bsignals\\b" << "\\bsigned\\b"
-                    << "\\bslots\\b" << "\\bstatic\\b" << "\\bstruct\\b"
-                    << "\\btemplate\\b" << "\\btypedef\\b" << "\\btypename\\b"
-                    << "\\bunion\\b" << "\\bunsigned\\b" << "\\bvirtual\\b"
-                    << "\\bvoid\\b" << "\\bvolatile\\b";
-    for (const QString &pattern : keywordPatterns) {
-        rule.pattern = QRegularExpression(pattern);
-        rule.format = keywordFormat;
-        highlightingRules.append(rule);
+void SyntaxHighlighter::setLexer(std::shared_ptr<const HighlightLexer> lexer) {
+    if (!lexer || lexer == language)
+        return;
+    language = std::move(lexer);
+    rehighlight();
+}
+
+std::shared_ptr<const HighlightLexer> SyntaxHighlighter::lexer() const {
+    return language;
+}
+
+QTextCharFormat SyntaxHighlighter::defaultFormat(HighlightLexer::TokenKind kind) {
+    QTextCharFormat format;
+    switch (kind) {
+    case HighlightLexer::Keyword:
+        format.setForeground(Qt::blue);
+        format.setFontWeight(QFont::Bold);
+        break;
+    case HighlightLexer::ClassName:
+        format.setFontWeight(QFont::Bold);
+        format.setForeground(Qt::darkMagenta);
+        break;
+    case HighlightLexer::Function:
+        format.setFontItalic(true);
+        format.setForeground(Qt::blue);
+        break;
+    case HighlightLexer::SingleLineComment:
+    case HighlightLexer::MultiLineComment:
+        format.setForeground(Qt::red);
+        break;
+    case HighlightLexer::Quotation:
+        format.setForeground(Qt::darkGreen);
+        break;
+    case HighlightLexer::Number:
+        format.setForeground(Qt::darkCyan);
+        break;
+    case HighlightLexer::Key:
+        format.setForeground(Qt::darkBlue);
+        break;
+    case HighlightLexer::Error:
+        format.setForeground(Qt::red);
+        format.setFontWeight(QFont::Bold);
+        break;
+    case HighlightLexer::Warning:
+        format.setForeground(QColor(0xc0, 0x70, 0x00));
+        format.setFontWeight(QFont::Bold);
+        break;
+    }
+    return format;
+}
+
+const QTextCharFormat &SyntaxHighlighter::formatFor(HighlightLexer::TokenKind kind) {
+    // Every document and language shares this table.
+    static const QVector<QTextCharFormat> formats = [] {
+        QVector<QTextCharFormat> table;
+        for (int kind = 0; kind < HighlightLexer::tokenKindCount; ++kind)
+            table.append(defaultFormat(HighlightLexer::TokenKind(kind)));
+        return table;
+    }();
+    return formats.at(kind);
+}
+
+void SyntaxHighlighter::setDeferred(bool deferred) {
+    this->deferred = deferred;
+    deferredFrom = -1;
+}
+
+bool SyntaxHighlighter::isDeferred() const {
+    return deferred;
+}
+
+void SyntaxHighlighter::setPriorityRange(int firstBlock, int lastBlock) {
+    priorityFirst = firstBlock;
+    priorityLast = lastBlock;
+}
+
+void SyntaxHighlighter::clearDeferred() {
+    deferredFrom = -1;
+}
+
+void SyntaxHighlighter::setSuspended(bool suspended) {
+    this->suspended = suspended;
+}
+
+QList<QTextLayout::FormatRange> SyntaxHighlighter::formatRanges(const QVector<HighlightLexer::Token> &tokens) {
+    QList<QTextLayout::FormatRange> ranges;
+    ranges.reserve(tokens.size());
+    for (const HighlightLexer::Token &token : tokens) {
+        QTextLayout::FormatRange range;
+        range.start = token.start;
+        range.length = token.length;
+        range.format = formatFor(token.kind);
+        ranges.append(range);
+    }
+    return ranges;
+}
+
+QTextBlock SyntaxHighlighter::rehighlightBlocks(const QTextBlock &first, const QTextBlock &last) {
+    TRACE_SCOPE("rehighlightBlocks");
+    QTextBlock block = first;
+    int state = first.previous().isValid() ? first.previous().userState() : HighlightLexer::NormalState;
+    bool pastLast = false;
+    for (;;) {
+        tokens.clear();
+        const QString text = block.text();
+        const int nextState = language->tokenize(text, state, tokens);
+        block.layout()->setFormats(formatRanges(tokens));
+        QVector<BlockData::Bracket> brackets;
+        StructureIndex::scan(text, tokens, brackets);
+        StructureIndex::setBrackets(block, brackets);
+
+        const bool stateChanged = block.userState() != nextState;
+        block.setUserState(nextState);
+        pastLast = pastLast || block == last;
+        if ((pastLast && !stateChanged) || !block.next().isValid())
+            return block;
+        state = nextState;
+        block = block.next();
     }
+}
 
-    classFormat.setFontWeight(QFont::Bold);
-    classFormat.setForeground(Qt::darkMagenta);
-    rule.pattern = QRegularExpression("\\bQ[A-Za-z]+\\b");
-    rule.format = classFormat;
-    highlightingRules.append(rule);
-
-    singleLineCommentFormat.setForeground(Qt::red);
-    rule.pattern = QRegularExpression("//[^\n]*");
-    rule.format = singleLineCommentFormat;
-    highlightingRules.append(rule);
-
-    multiLineCommentFormat.setForeground(Qt::red);
-
-    quotationFormat.setForeground(Qt::darkGreen);
-    rule.pattern = QRegularExpression("\".*\"");
-    rule.format = quotationFormat;
-    highlightingRules.append(rule);
-
-    functionFormat.setFontItalic(true);
-    functionFormat.setForeground(Qt::blue);
-    rule.pattern = QRegularExpression("\\b[A-Za-z0-9_]+(?=\\()");
-    rule.format = functionFormat;
-    highlightingRules.append(rule);
+void SyntaxHighlighter::keepCurrentFormats() {
+    // Leave the block state alone so QSyntaxHighlighter stops here instead
+    // of cascading through the rest of the document.
+    const QList<QTextLayout::FormatRange> formats = currentBlock().layout()->formats();
+    for (const QTextLayout::FormatRange &range : formats)
+        setFormat(range.start, range.length, range.format);
 }
 
 void SyntaxHighlighter::highlightBlock(const QString &text) {
-    for (const HighlightingRule &rule : qAsConst(highlightingRules)) {
-        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
-        while (matchIterator.hasNext()) {
-            QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
-        }
+    TRACE_SCOPE("highlightBlock");
+    if (suspended) {
+        keepCurrentFormats();
+        return;
     }
-    setCurrentBlockState(0);
-
-    int startIndex = 0;
-    if (previousBlockState() != 1)
-        startIndex = text.indexOf("/*");
-
-    while (startIndex >= 0) {
-        int endIndex = text.indexOf("*/", startIndex);
-        int commentLength;
-        if (endIndex == -1) {
-            setCurrentBlockState(1);
-            commentLength = text.length() - startIndex;
-        } else {
-            commentLength = endIndex - startIndex + 2;
+    if (deferred) {
+        const QTextBlock block = currentBlock();
+        const int blockNumber = block.blockNumber();
+        if (blockNumber < priorityFirst || blockNumber > priorityLast) {
+            keepCurrentFormats();
+            if (deferredFrom < 0 || blockNumber < deferredFrom) {
+                deferredFrom = blockNumber;
+                emit highlightingDeferred(blockNumber);
+            }
+            return;
         }
-        setFormat(startIndex, commentLength, multiLineCommentFormat);
-        startIndex = text.indexOf("/*", startIndex + commentLength);
     }
-}
\ No newline at end of file
+
+    tokens.clear();
+    const int state = language->tokenize(text, previousBlockState(), tokens);
+    for (const HighlightLexer::Token &token : std::as_const(tokens))
+        setFormat(token.start, token.length, formatFor(token.kind));
+    setCurrentBlockState(state);
+
+    QVector<BlockData::Bracket> brackets;
+    StructureIndex::scan(text, tokens, brackets);
+    StructureIndex::setBrackets(currentBlock(), brackets);
+}
@@ -2,32 +2,66 @@
 #define SYNTAXHIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QTextBlock>
 #include <QTextCharFormat>
-#include <QRegularExpression>
+#include <QTextLayout>
+#include <memory>
+#include "highlightlexer.h"
 
 class QTextDocument;
 
+// Applies a HighlightLexer's tokens to one QTextDocument. The formats are a
+// single static table and compiled lexers are shared, so a highlighter per
+// open document costs little more than its QObject. Each lexed block also
+// records its brackets for StructureIndex.
 class SyntaxHighlighter : public QSyntaxHighlighter {
     Q_OBJECT
 public:
     SyntaxHighlighter(QTextDocument * parent = nullptr);
+
+    // Plain text until a language is set; changing it rehighlights.
+    void setLexer(std::shared_ptr<const HighlightLexer> lexer);
+    std::shared_ptr<const HighlightLexer> lexer() const;
+
+    static const QTextCharFormat &formatFor(HighlightLexer::TokenKind kind);
+    // The look of each token kind, shared with BatchExporter.
+    static QTextCharFormat defaultFormat(HighlightLexer::TokenKind kind);
+
+    // In deferred mode only blocks inside the priority range are lexed on
+    // the GUI thread; the rest keep their current formats and are reported
+    // through highlightingDeferred() for BackgroundHighlighter to pick up.
+    void setDeferred(bool deferred);
+    bool isDeferred() const;
+    void setPriorityRange(int firstBlock, int lastBlock);
+    void clearDeferred();
+
+    // While suspended every block keeps the formats and state it has, so a
+    // large edit is not lexed line by line; afterwards the caller
+    // rehighlights the blocks it changed.
+    void setSuspended(bool suspended);
+    // Lexes first to last, and the blocks after them while their start
+    // state changes, without QSyntaxHighlighter's edit per block. Returns
+    // the last block lexed; the caller marks the range dirty once.
+    QTextBlock rehighlightBlocks(const QTextBlock &first, const QTextBlock &last);
+    // Tokens as layout formats, for applying them directly to a block.
+    static QList<QTextLayout::FormatRange> formatRanges(const QVector<HighlightLexer::Token> &tokens);
+
+signals:
+    void highlightingDeferred(int blockNumber);
+
 protected:
     void highlightBlock(const QString &text) override;
 private:
-    void setupHighlightingRules();
-
-    struct HighlightingRule {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-    QVector<HighlightingRule> highlightingRules;
-
-    QTextCharFormat keywordFormat;
-    QTextCharFormat classFormat;
-    QTextCharFormat singleLineCommentFormat;
-    QTextCharFormat multiLineCommentFormat;
-    QTextCharFormat quotationFormat;
-    QTextCharFormat functionFormat;
+    void keepCurrentFormats();
+
+    std::shared_ptr<const HighlightLexer> language;
+    QVector<HighlightLexer::Token> tokens;
+
+    bool deferred = false;
+    bool suspended = false;
+    int priorityFirst = 0;
+    int priorityLast = 0;
+    int deferredFrom = -1;
 };
 
 #endif // SYNTAXHIGHLIGHTER_H
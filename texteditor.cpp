@@ -3,85 +3,236 @@
 #include <QMenuBar>
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QFile>
-#include <QTextStream>
 #include <QAction>
 #include <QPainter>
 #include <QTextBlock>
 #include <QScrollBar>
 #include <QAbstractTextDocumentLayout>
 #include <QVBoxLayout>
+#include <QKeyEvent>
+#include <QAbstractItemView>
+#include <QFileInfo>
+#include <QStatusBar>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QStackedWidget>
+#include <QInputDialog>
+#include <QDockWidget>
+#include <QSaveFile>
+#include <QSettings>
+#include <QTabBar>
+#include <QToolBar>
+#include <QLabel>
+#include <QTimer>
+#include <QCloseEvent>
+#include <algorithm>
+#include <climits>
+#include "documentcompletion.h"
+#include "editjournal.h"
+#include "filefollower.h"
+#include "fileloader.h"
+#include "memoryusage.h"
+#include "structureindex.h"
+#include "traceoverlay.h"
+#include "tracing.h"
+
+// Files above this size are highlighted by BackgroundHighlighter.
+static const qint64 backgroundHighlightThreshold = 1024 * 1024;
+// Files above this size open in LargeFileViewer instead of QTextEdit.
+static const qint64 largeFileThreshold = 128 * 1024 * 1024;
+// Completion candidates offered at once.
+static const int maxCompletions = 50;
+// Characters of the matching line shown next to each search hit.
+static const int hitPreviewLength = 200;
+// Estimated document memory allowed before inactive tabs are hibernated.
+static const int defaultMemoryBudgetMB = 1024;
+static const int memoryCheckInterval = 5000;
+// Lines kept while following a growing file.
+static const int defaultFollowMaxLines = 100000;
+// Lines bracket matching under the cursor looks through before giving up,
+// which bounds the cost of every cursor move next to an unmatched bracket.
+static const int bracketMatchBlocks = 20000;
+// Columns per tab stop, on screen and for the whitespace transforms.
+static const int tabWidth = 4;
+
+namespace {
+
+// A triangle pointing right at a folded line and down at one that can fold.
+void drawFoldMarker(QPainter *painter, const QRectF &cell, bool folded) {
+    const qreal half = qMin(cell.width(), cell.height()) * 0.25;
+    const QPointF center = cell.center();
+    QPolygonF triangle;
+    if (folded)
+        triangle << center + QPointF(-half / 2, -half) << center + QPointF(half, 0) << center + QPointF(-half / 2, half);
+    else
+        triangle << center + QPointF(-half, -half / 2) << center + QPointF(half, -half / 2) << center + QPointF(0, half);
+    painter->drawPolygon(triangle);
+}
+
+} // namespace
 
 TextEditor::TextEditor(QWidget *parent) : QMainWindow(parent) {
-    textEdit = new QTextEdit(this);
-    setCentralWidget(textEdit);
+    editorStack = new QStackedWidget(this);
+    setCentralWidget(editorStack);
+    textEdit = new CodeEdit(this, editorStack);
+    editorStack->addWidget(textEdit);
 
-    // Set tab stop width to 4 spaces
+    // Set tab stop width to tabWidth spaces
     QFontMetrics metrics(textEdit->font());
-    textEdit->setTabStopDistance(4 * metrics.horizontalAdvance(' '));
+    textEdit->setTabStopDistance(tabWidth * metrics.horizontalAdvance(' '));
+
+    // Follows textEdit from document to document as tabs are switched.
+    backgroundHighlighter = new BackgroundHighlighter(textEdit, nullptr);
 
-    highlighter = new SyntaxHighlighter(textEdit->document());
+    largeFileViewer = new LargeFileViewer(editorStack);
+    editorStack->addWidget(largeFileViewer);
 
     lineNumberArea = new LineNumberArea(this);
+    traceOverlay = new TraceOverlay(this);
+    traceOverlay->hide();
+
+    // The tabs sit in a toolbar so the editor stack stays the central widget
+    // the gutter is positioned against.
+    tabBar = new QTabBar(this);
+    tabBar->setTabsClosable(true);
+    tabBar->setMovable(true);
+    tabBar->setExpanding(false);
+    tabBar->setDocumentMode(true);
+    QToolBar *tabToolBar = addToolBar("Tabs");
+    tabToolBar->setMovable(false);
+    tabToolBar->addWidget(tabBar);
+    connect(tabBar, &QTabBar::currentChanged, this, &TextEditor::tabActivated);
+    connect(tabBar, &QTabBar::tabCloseRequested, this, &TextEditor::closeTab);
+    connect(tabBar, &QTabBar::tabMoved, this, [this](int from, int to) { documents.move(from, to); });
+
+    loadProgress = new QProgressBar(this);
+    loadProgress->setRange(0, 1000);
+    loadProgress->setMaximumWidth(200);
+    loadProgress->hide();
+    cancelLoadButton = new QPushButton("Cancel", this);
+    cancelLoadButton->hide();
+    connect(cancelLoadButton, &QPushButton::clicked, this, [this]() {
+        for (EditorDocument *document : std::as_const(documents)) {
+            if (document->loader())
+                document->loader()->cancel();
+        }
+    });
 
-    connect(textEdit->document(), &QTextDocument::blockCountChanged, this, &TextEditor::updateLineNumberAreaWidth);
-    connect(textEdit->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() { updateLineNumberArea(textEdit->rect(), 0); });
+    fileSaver = new FileSaver(this);
+    connect(fileSaver, &FileSaver::progress, this, &TextEditor::loadProgressed);
+    connect(fileSaver, &FileSaver::finished, this, &TextEditor::saveFinished);
+    connect(cancelLoadButton, &QPushButton::clicked, fileSaver, &FileSaver::cancel);
+    statusBar()->addPermanentWidget(loadProgress);
+    statusBar()->addPermanentWidget(cancelLoadButton);
+
+    const QSettings settings("TextEditor", "TextEditor");
+    followMaxLines = settings.value("followMaxLines", defaultFollowMaxLines).toInt();
+    memoryBudget = qint64(settings.value("memoryBudgetMB", defaultMemoryBudgetMB).toInt()) * 1024 * 1024;
+    memoryLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(memoryLabel);
+    memoryTimer = new QTimer(this);
+    memoryTimer->setInterval(memoryCheckInterval);
+    connect(memoryTimer, &QTimer::timeout, this, &TextEditor::enforceMemoryBudget);
+    memoryTimer->start();
+
+    connect(textEdit->verticalScrollBar(), &QScrollBar::valueChanged, lineNumberArea, QOverload<>::of(&QWidget::update));
     connect(textEdit, &QTextEdit::cursorPositionChanged, this, &TextEditor::highlightCurrentLine);
+    connect(largeFileViewer, &LargeFileViewer::viewportChanged, lineNumberArea, QOverload<>::of(&QWidget::update));
+    connect(largeFileViewer, &LargeFileViewer::indexed, this, &TextEditor::largeFileIndexed);
+    connect(largeFileViewer, &LargeFileViewer::contentsChanged, this, [this]() {
+        updateLineNumberAreaWidth(0);
+        if (isViewingLargeFile())
+            updateTab(current);
+    });
+
+    // The gutter sits over the editor, which moves when docks open or resize.
+    editorStack->installEventFilter(this);
+    // Watched until the first screen of the current document is painted.
+    textEdit->viewport()->installEventFilter(this);
+    largeFileViewer->viewport()->installEventFilter(this);
 
     updateLineNumberAreaWidth(0);
     highlightCurrentLine();
 
+    // The find panel, the completer and the Tools menu are created on first
+    // use, so they cost nothing when the editor is started just to look at
+    // a file.
     createMenus();
 
-    // Initialize completer and model
+    activateDocument(addDocument(QString()));
+}
+
+void TextEditor::createFindPanel() {
+    findPanel = new FindPanel(this);
+    findDock = new QDockWidget("Find/Replace", this);
+    findDock->setWidget(findPanel);
+    addDockWidget(Qt::BottomDockWidgetArea, findDock);
+    findDock->hide();
+    searchEngine = new SearchEngine(this);
+    connect(searchEngine, &SearchEngine::hitsFound, findPanel, &FindPanel::addHits);
+    connect(searchEngine, &SearchEngine::finished, this, &TextEditor::searchFinished);
+    connect(findPanel, &FindPanel::findAllRequested, this, &TextEditor::findAll);
+    connect(findPanel, &FindPanel::replaceAllRequested, this, &TextEditor::replaceAll);
+    connect(findPanel, &FindPanel::stopRequested, searchEngine, &SearchEngine::cancel);
+    connect(findPanel, &FindPanel::hitActivated, this, &TextEditor::goToHit);
+}
+
+void TextEditor::createCompleter() {
     model = new QStringListModel(this);
     completer = new QCompleter(model, this);
     completer->setWidget(textEdit);
-    completer->setCompletionMode(QCompleter:PopupCompletion);
-    completer->setCaseSensitivity(Qt:CaseInsensitive);
-
-    // Set up word list for autocompletion
-    QStringList wordList;
-    wordList << "int" << "float" << "double" << "char" << "class" << "public" << "private" << "protected" << "virtual" << "override";
-    model->setStringList(wordList);
+    completer->setCompletionMode(QCompleter::PopupCompletion);
+    completer->setCaseSensitivity(Qt::CaseInsensitive);
 
     connect(completer, QOverload<const QString &>::of(&QCompleter::activated), this, &TextEditor::insertCompletion);
 }
 
-void TextEditor::insertCompletion(const QString &completion) {
-    QTextCursor tc = textEdit->textCursor();
-    int extra = completion.length() - completer->completionPrefix().length();
-    tc.movePosition(QTextCursor::Left);
-    tc.movePosition(QTextCursor::EndOfWord);
-    tc.insertText(completion.right(extra));
-    textEdit->setTextCursor(tc);
+void TextEditor::clearSearch() {
+    if (!searchEngine)
+        return;
+    searchEngine->cancel();
+    findPanel->clearHits();
 }
 
-void TextEditor::keyPressEvent(QKeyEvent *e) {
-    if (completer && completer->popup()->isVisible()) {
-        // The following keys are forwarded by the completer to the widget
-        switch (e->key())
-    }
+bool TextEditor::isSearching() const {
+    return searchEngine && searchEngine->isSearching();
+}
+
+bool TextEditor::isTransforming() const {
+    return bulkTransform && bulkTransform->isRunning();
+}
+
+void TextEditor::updateFollowAction() {
+    if (followAction)
+        followAction->setChecked(isFollowing());
 }
 
 int TextEditor::lineNumberAreaWidth() {
     int digits = 1;
-    int max = qMax(1, textEdit->document()->blockCount());
+    qint64 max = qMax<qint64>(1, isViewingLargeFile() ? largeFileViewer->lineCount() : textEdit->document()->blockCount());
     while (max >= 10) {
         max /= 10;
         ++digits;
     }
 
     int space = 3 + textEdit->fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
+    if (!isViewingLargeFile())
+        space += foldMarkerWidth();
 
     return space + 5; // Add 5 pixels gap
 }
 
+int TextEditor::foldMarkerWidth() const {
+    return textEdit->fontMetrics().height();
+}
+
 void TextEditor::updateLineNumberAreaWidth(int newBlockCount) {
     int leftMargin = lineNumberAreaWidth() + 10;
     textEdit->setContentsMargins(leftMargin, 0, 0, 0);
-    QRect cr = contentsRect();
+    largeFileViewer->setContentsMargins(leftMargin, 0, 0, 0);
+    QRect cr = editorStack->geometry();
     lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
+    traceOverlay->move(cr.left() + leftMargin, cr.top() + 4);
 }
 
 void TextEditor::updateLineNumberArea(const QRect &rect, int dy) {
@@ -96,12 +247,41 @@ void TextEditor::updateLineNumberArea(const QRect &rect, int dy) {
 
 void TextEditor::resizeEvent(QResizeEvent *e) {
     QMainWindow::resizeEvent(e);
-    QRect cr = contentsRect();
+    QRect cr = editorStack->geometry();
     lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
 }
 
+bool TextEditor::eventFilter(QObject *watched, QEvent *event) {
+    if (watched == editorStack && (event->type() == QEvent::Resize || event->type() == QEvent::Move))
+        updateLineNumberAreaWidth(0);
+    if (event->type() == QEvent::Paint && !firstScreenShown
+        && (watched == textEdit->viewport() || watched == largeFileViewer->viewport()) && hasFirstScreen()) {
+        // The filter runs before the paint; report once it is done.
+        firstScreenShown = true;
+        textEdit->viewport()->removeEventFilter(this);
+        largeFileViewer->viewport()->removeEventFilter(this);
+        QTimer::singleShot(0, this, &TextEditor::firstScreenPainted);
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+bool TextEditor::hasFirstScreen() const {
+    if (!current)
+        return false;
+    if (isViewingLargeFile())
+        return !largeFileViewer->isIndexing();
+    // A chunk of a file being loaded fills the screen long before the rest
+    // of the file arrives.
+    return current->document() && (!current->document()->isEmpty() || !isLoading());
+}
+
 void TextEditor::highlightCurrentLine() {
+    TRACE_SCOPE("highlightCurrentLine");
     QList<QTextEdit::ExtraSelection> extraSelections;
+    StructureIndex *structure = current && current->document() == textEdit->document() ? current->structure() : nullptr;
+    // Find, Go to Line and undo can put the cursor inside a fold.
+    if (structure)
+        structure->reveal(textEdit->textCursor().block());
 
     if (!textEdit->isReadOnly()) {
         QTextEdit::ExtraSelection selection;
@@ -115,93 +295,1060 @@ void TextEditor::highlightCurrentLine() {
         extraSelections.append(selection);
     }
 
+    // The bracket after the cursor, or else the one before it, and its
+    // partner; a bracket without one is marked in red.
+    const QTextCursor cursor = textEdit->textCursor();
+    if (structure && !cursor.hasSelection()) {
+        int bracket = cursor.position();
+        int match = -1;
+        bool found = structure->findMatch(bracket, &match, bracketMatchBlocks);
+        if (!found && bracket > 0)
+            found = structure->findMatch(--bracket, &match, bracketMatchBlocks);
+        if (found) {
+            QTextEdit::ExtraSelection selection;
+            selection.format.setBackground(QColor(match >= 0 ? Qt::green : Qt::red).lighter(160));
+            for (int position : {bracket, match}) {
+                if (position < 0)
+                    continue;
+                selection.cursor = QTextCursor(textEdit->document());
+                selection.cursor.setPosition(position);
+                selection.cursor.setPosition(position + 1, QTextCursor::KeepAnchor);
+                extraSelections.append(selection);
+            }
+        }
+    }
+
     textEdit->setExtraSelections(extraSelections);
 }
 
 void TextEditor::lineNumberAreaPaintEvent(QPaintEvent *event) {
+    TRACE_SCOPE("lineNumberAreaPaintEvent");
     QPainter painter(lineNumberArea);
     painter.fillRect(event->rect(), Qt::lightGray);
+    lineNumberGlyphs.setFont(textEdit->font());
+    lineNumberGlyphs.setColor(Qt::black);
+    const int right = lineNumberArea->width();
+
+    if (isViewingLargeFile()) {
+        // Only the lines on screen are numbered, whatever the file size.
+        const int lineHeight = largeFileViewer->lineHeight();
+        const int first = largeFileViewer->firstVisibleLine();
+        const qint64 lineCount = largeFileViewer->lineCount();
+        int top = largeFileViewer->viewport()->mapTo(this, QPoint(0, 0)).y() - lineNumberArea->y();
+        for (qint64 line = first; line < lineCount && top <= event->rect().bottom(); ++line) {
+            if (top + lineHeight >= event->rect().top())
+                lineNumberGlyphs.drawNumber(&painter, right, top, line + 1);
+            top += lineHeight;
+        }
+        return;
+    }
 
-    QTextBlock block = textEdit->document()->begin();
+    // Start from the block at the top of the viewport rather than the start
+    // of the document, and stop after the last block on screen.
+    QAbstractTextDocumentLayout *layout = textEdit->document()->documentLayout();
+    QTextBlock block = textEdit->cursorForPosition(QPoint(0, 0)).block();
     int blockNumber = block.blockNumber();
-    int top = static_cast<int>(textEdit->viewport()->geometry().top());
-    int bottom = top + static_cast<int>(textEdit->document()->documentLayout()->blockBoundingRect(block).height());
+    const int viewportTop = textEdit->viewport()->mapTo(this, QPoint(0, 0)).y() - lineNumberArea->y();
+    const int scroll = textEdit->verticalScrollBar()->value();
+    int top = viewportTop + static_cast<int>(layout->blockBoundingRect(block).top()) - scroll;
+    int bottom = top + static_cast<int>(layout->blockBoundingRect(block).height());
+
+    const StructureIndex *structure = current && current->document() == textEdit->document() ? current->structure() : nullptr;
+    const int markerWidth = foldMarkerWidth();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(Qt::darkGray);
 
+    // Hidden blocks take no height but still count, so the numbers after a
+    // fold stay those of the document.
     while (block.isValid() && top <= event->rect().bottom()) {
         if (block.isVisible() && bottom >= event->rect().top()) {
-            QString number = QString::number(blockNumber + 1);
-            painter.setPen(Qt::black);
-            painter.drawText(0, top, lineNumberArea->width(), textEdit->fontMetrics().height(),
-                             Qt::AlignRight, number);
+            lineNumberGlyphs.drawNumber(&painter, right, top, blockNumber + 1);
+            if (structure && (structure->isFolded(block) || structure->isFoldable(block)))
+                drawFoldMarker(&painter, QRectF(0, top, markerWidth, lineNumberGlyphs.digitHeight()),
+                               structure->isFolded(block));
         }
 
         block = block.next();
         top = bottom;
-        bottom = top + static_cast<int>(textEdit->document()->documentLayout()->blockBoundingRect(block).height());
+        bottom = top + static_cast<int>(layout->blockBoundingRect(block).height());
         ++blockNumber;
     }
 }
 
+void TextEditor::lineNumberAreaMousePressEvent(QMouseEvent *event) {
+    if (isViewingLargeFile() || !current || current->document() != textEdit->document()
+        || event->button() != Qt::LeftButton || event->pos().x() >= foldMarkerWidth())
+        return;
+    const int viewportTop = textEdit->viewport()->mapTo(this, QPoint(0, 0)).y() - lineNumberArea->y();
+    const QTextBlock block = textEdit->cursorForPosition(QPoint(0, event->pos().y() - viewportTop)).block();
+    current->structure()->toggleFold(block);
+    // The cursor does not stay on a line that was just hidden.
+    if (!textEdit->textCursor().block().isVisible()) {
+        QTextCursor cursor(block);
+        cursor.movePosition(QTextCursor::EndOfBlock);
+        textEdit->setTextCursor(cursor);
+    }
+    lineNumberArea->update();
+}
+
+void TextEditor::newFile() {
+    activateDocument(addDocument(QString()));
+}
+
 void TextEditor::openFile() {
+    if (fileSaver->isSaving() || isTransforming()) {
+        statusBar()->showMessage("Wait for the current operation to finish", 5000);
+        return;
+    }
     QString fileName = QFileDialog::getOpenFileName(this, "Open File");
-    if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&file);
-            textEdit->setText(in.readAll());
-            file.close();
+    if (!fileName.isEmpty())
+        loadFile(fileName);
+}
+
+bool TextEditor::loadFile(const QString &fileName) {
+    if (fileSaver->isSaving() || isTransforming())
+        return false;
+
+    // An open file is shown again, and reread if that loses nothing.
+    EditorDocument *document = findDocument(fileName);
+    if (document) {
+        activateDocument(document);
+        if (isModified(document) || (document->loader() && document->loader()->isLoading()))
+            return true;
+        return startLoading(document);
+    }
+
+    const bool large = QFileInfo(fileName).size() > largeFileThreshold;
+    if (large) {
+        // There is a single large file view, so its file gives way.
+        for (EditorDocument *other : std::as_const(documents)) {
+            if (!other->isLarge())
+                continue;
+            if (largeFileViewer->isModified()) {
+                QMessageBox::warning(this, "Error", "Save or close " + other->displayName() + " before opening another large file");
+                return false;
+            }
+            closeDocument(other);
+            break;
+        }
+    }
+
+    // A new empty window is replaced rather than kept beside the file.
+    const bool reuse = !large && current && !current->isLarge() && current->fileName().isEmpty()
+                       && current->document() && current->document()->isEmpty() && !isLoading();
+    if (reuse) {
+        document = current;
+        document->setFileName(fileName);
+    } else {
+        document = addDocument(fileName);
+        activateDocument(document);
+    }
+    if (startLoading(document))
+        return true;
+    if (reuse) {
+        document->setFileName(QString());
+        updateTab(document);
+    } else {
+        closeDocument(document);
+    }
+    return false;
+}
+
+EditorDocument *TextEditor::findDocument(const QString &fileName) const {
+    const QString path = QFileInfo(fileName).absoluteFilePath();
+    for (EditorDocument *document : documents) {
+        if (!document->fileName().isEmpty() && QFileInfo(document->fileName()).absoluteFilePath() == path)
+            return document;
+    }
+    return nullptr;
+}
+
+EditorDocument *TextEditor::addDocument(const QString &fileName) {
+    EditorDocument *document = new EditorDocument(fileName, this);
+    document->setLarge(!fileName.isEmpty() && QFileInfo(fileName).size() > largeFileThreshold);
+    documents.append(document);
+    tabBar->addTab(document->displayName());
+    updateTab(document);
+    return document;
+}
+
+void TextEditor::tabActivated(int index) {
+    EditorDocument *document = documents.value(index);
+    if (!document || document == current)
+        return;
+    // Tabs restored from a session are read on first activation.
+    const bool unopened = document->state() == EditorDocument::Unloaded && !document->fileName().isEmpty()
+                          && (!document->isLarge() || largeFileViewer->fileName() != document->fileName());
+    activateDocument(document);
+    if (unopened && !startLoading(document))
+        closeDocument(document);
+}
+
+void TextEditor::activateDocument(EditorDocument *document) {
+    if (document == current)
+        return;
+    if (current && current->document()) {
+        current->cursorPosition = textEdit->textCursor().position();
+        current->scrollPosition = textEdit->verticalScrollBar()->value();
+    }
+    // Hits, a running transform and the completion popup belong to the
+    // document being left.
+    clearSearch();
+    if (bulkTransform)
+        bulkTransform->cancel();
+    if (completer)
+        completer->popup()->hide();
+
+    current = document;
+    document->lastActivated = ++activationCount;
+    tabBar->setCurrentIndex(documents.indexOf(document));
+
+    if (document->isLarge()) {
+        updateFollowAction();
+        editorStack->setCurrentWidget(largeFileViewer);
+        updateLineNumberAreaWidth(0);
+        lineNumberArea->update();
+        updateTab(document);
+        return;
+    }
+
+    if (!document->document()) {
+        document->load();
+        connect(document->document(), &QTextDocument::modificationChanged, this, [this, document]() {
+            updateTab(document);
+        });
+        connect(document->loader(), &FileLoader::progress, this, &TextEditor::loadProgressed);
+        connect(document->loader(), &FileLoader::finished, this, [this, document](bool completed) {
+            loadFinished(document, completed);
+        });
+        // Like tail -f, the view keeps up with the file while the cursor
+        // sits at its end.
+        connect(document->follower(), &FileFollower::appended, this, [this, document]() {
+            if (document == current && textEdit->textCursor().atEnd())
+                textEdit->ensureCursorVisible();
+        });
+        connect(document->follower(), &FileFollower::restarted, this, [this](const QString &reason) {
+            statusBar()->showMessage(reason + ", following the new contents", 5000);
+        });
+    }
+    QTextDocument *textDocument = document->document();
+    textEdit->setDocument(textDocument);
+    textEdit->setReadOnly(document->loader()->isLoading() || document->follower()->isFollowing());
+    updateFollowAction();
+    disconnect(blockCountConnection);
+    blockCountConnection = connect(textDocument, &QTextDocument::blockCountChanged, this,
+                                   &TextEditor::updateLineNumberAreaWidth);
+    backgroundHighlighter->setHighlighter(document->highlighter());
+    backgroundHighlighter->setEnabled(qMax<qint64>(textDocument->characterCount(), QFileInfo(document->fileName()).size())
+                                      > backgroundHighlightThreshold);
+    editorStack->setCurrentWidget(textEdit);
+
+    QTextCursor cursor(textDocument);
+    cursor.setPosition(qBound(0, document->cursorPosition, textDocument->characterCount() - 1));
+    textEdit->setTextCursor(cursor);
+    textEdit->verticalScrollBar()->setValue(document->scrollPosition);
+    updateLineNumberAreaWidth(0);
+    highlightCurrentLine();
+    lineNumberArea->update();
+    updateTab(document);
+    enforceMemoryBudget();
+}
+
+void TextEditor::closeCurrentTab() {
+    closeTab(documents.indexOf(current));
+}
+
+void TextEditor::closeTab(int index) {
+    EditorDocument *document = documents.value(index);
+    if (!document)
+        return;
+    if (document == savingDocument) {
+        statusBar()->showMessage("Wait for the save to finish", 5000);
+        return;
+    }
+    if (isModified(document)
+        && QMessageBox::question(this, "Close", document->displayName() + " has unsaved changes. Close it anyway?")
+               != QMessageBox::Yes)
+        return;
+    closeDocument(document);
+}
+
+void TextEditor::closeDocument(EditorDocument *document) {
+    if (documents.size() == 1)
+        addDocument(QString());
+    if (document == current) {
+        const int index = documents.indexOf(document);
+        activateDocument(documents.value(index + 1, documents.value(index - 1)));
+    }
+    if (document->isLarge())
+        largeFileViewer->closeFile();
+    if (document->loader())
+        document->loader()->cancel();
+
+    const int index = documents.indexOf(document);
+    documents.removeAt(index);
+    tabBar->removeTab(index);
+    delete document;
+    updateMemoryStatus();
+}
+
+void TextEditor::updateTab(EditorDocument *document) {
+    const int index = documents.indexOf(document);
+    if (index < 0)
+        return;
+    tabBar->setTabText(index, document->displayName() + (isModified(document) ? "*" : ""));
+    static const char *const stateNames[] = {"not loaded", "loaded", "hibernated"};
+    const QString path = document->fileName().isEmpty() ? document->displayName() : document->fileName();
+    tabBar->setTabToolTip(index, QString("%1 (%2)").arg(path, stateNames[document->state()]));
+}
+
+bool TextEditor::startLoading(EditorDocument *document) {
+    const QString fileName = document->fileName();
+    clearSearch();
+
+    if (document->isLarge()) {
+        loadTimer.start();
+        if (largeFileViewer->openFile(fileName)) {
+            statusBar()->showMessage("Indexing " + QFileInfo(fileName).fileName() + "...");
+            return true;
+        }
+        QMessageBox::warning(this, "Error", "Cannot open file: " + largeFileViewer->errorString());
+        return false;
+    }
+
+    // Loading replaces the document; none of that belongs in the journal.
+    document->follower()->stop();
+    updateFollowAction();
+    document->journal()->stop();
+    // Large files get viewport-first highlighting so appending them does
+    // not lex the whole document on the GUI thread.
+    if (document == current)
+        backgroundHighlighter->setEnabled(QFileInfo(fileName).size() > backgroundHighlightThreshold);
+
+    residentBeforeLoad = MemoryUsage::currentResidentBytes();
+    loadTimer.start();
+    // The completion index is rebuilt off the GUI thread once loaded.
+    document->completion()->setSuspended(true);
+    if (document->loader()->load(fileName)) {
+        if (document == current)
+            textEdit->setReadOnly(true);
+        loadProgress->setValue(0);
+        loadProgress->show();
+        cancelLoadButton->show();
+        statusBar()->showMessage("Loading " + QFileInfo(fileName).fileName() + "...");
+        return true;
+    }
+    document->completion()->rebuild();
+    QMessageBox::warning(this, "Error", "Cannot open file: " + document->loader()->errorString());
+    return false;
+}
+
+void TextEditor::loadProgressed(qint64 bytesRead, qint64 totalBytes) {
+    if (totalBytes > 0)
+        loadProgress->setValue(int(bytesRead * 1000 / totalBytes));
+}
+
+void TextEditor::loadFinished(EditorDocument *document, bool completed) {
+    if (document == current) {
+        textEdit->setReadOnly(false);
+        highlightCurrentLine();
+    }
+    loadProgress->hide();
+    cancelLoadButton->hide();
+    if (completed) {
+        document->setFileSize(document->loader()->loadedBytes());
+        startJournal(document);
+    }
+    document->completion()->rebuild();
+    updateTab(document);
+
+    if (!completed) {
+        if (document->loader()->errorString().isEmpty()) {
+            statusBar()->showMessage("Loading cancelled", 5000);
         } else {
-            QMessageBox::warning(this, "Error", "Cannot open file");
+            statusBar()->clearMessage();
+            QMessageBox::warning(this, "Error", "Cannot open file: " + document->loader()->errorString());
+        }
+        emit fileOpened(false);
+        return;
+    }
+
+    // Report peak memory so loads can be checked against the file size.
+    const qint64 mb = 1024 * 1024;
+    statusBar()->showMessage(QString("Loaded in %1 ms, memory %2 MB (was %3 MB, peak %4 MB)")
+                                 .arg(loadTimer.elapsed())
+                                 .arg(MemoryUsage::currentResidentBytes() / mb)
+                                 .arg(residentBeforeLoad / mb)
+                                 .arg(MemoryUsage::peakResidentBytes() / mb));
+    enforceMemoryBudget();
+    emit fileOpened(true);
+}
+
+void TextEditor::startJournal(EditorDocument *document) {
+    const QString fileName = document->fileName();
+    EditJournal *journal = document->journal();
+    bool recover = false;
+    if (EditJournal::hasRecoverableChanges(fileName)) {
+        recover = QMessageBox::question(this, "Recover Changes",
+                                        QFileInfo(fileName).fileName()
+                                            + " has unsaved changes from an earlier session. Recover them?")
+                  == QMessageBox::Yes;
+        if (recover && !journal->replay(fileName)) {
+            QMessageBox::warning(this, "Error", "Cannot recover changes: " + journal->errorString());
+            recover = false;
+        }
+    }
+    if (!journal->start(fileName, recover))
+        statusBar()->showMessage("Cannot record edits: " + journal->errorString(), 5000);
+}
+
+void TextEditor::largeFileIndexed(bool completed) {
+    updateLineNumberAreaWidth(0);
+    lineNumberArea->update();
+    if (completed)
+        statusBar()->showMessage(QString("%1 lines indexed in %2 ms")
+                                     .arg(largeFileViewer->lineCount())
+                                     .arg(loadTimer.elapsed()));
+    emit fileOpened(completed);
+}
+
+void TextEditor::restoreSession(bool activateCurrent) {
+    QSettings settings("TextEditor", "TextEditor");
+    const QStringList files = settings.value("session/files").toStringList();
+    const QString currentFile = settings.value("session/current").toString();
+
+    EditorDocument *untitled = current;
+    EditorDocument *activate = nullptr;
+    bool haveLarge = false;
+    for (const QString &fileName : files) {
+        if (!QFileInfo::exists(fileName) || findDocument(fileName))
+            continue;
+        const bool large = QFileInfo(fileName).size() > largeFileThreshold;
+        if (large && haveLarge)
+            continue;
+        haveLarge = haveLarge || large;
+        // Added without activating, so nothing is read yet.
+        EditorDocument *document = addDocument(fileName);
+        if (fileName == currentFile || !activate)
+            activate = document;
+    }
+    if (!activate || !activateCurrent)
+        return;
+    tabBar->setCurrentIndex(documents.indexOf(activate));
+    if (untitled && untitled->fileName().isEmpty() && !isModified(untitled))
+        closeDocument(untitled);
+}
+
+void TextEditor::closeEvent(QCloseEvent *event) {
+    QStringList files;
+    for (EditorDocument *document : std::as_const(documents)) {
+        if (!document->fileName().isEmpty())
+            files.append(QFileInfo(document->fileName()).absoluteFilePath());
+    }
+    QSettings settings("TextEditor", "TextEditor");
+    settings.setValue("session/files", files);
+    settings.setValue("session/current", current && !current->fileName().isEmpty()
+                                             ? QFileInfo(current->fileName()).absoluteFilePath()
+                                             : QString());
+    QMainWindow::closeEvent(event);
+}
+
+void TextEditor::setFollowing(bool on) {
+    FileFollower *follower = current->follower();
+    if (!on) {
+        if (follower && follower->isFollowing()) {
+            follower->stop();
+            textEdit->setReadOnly(isLoading());
+            // Edits are journaled against the file, so recording resumes
+            // only if the document is still the file; otherwise the next
+            // save or reload starts it.
+            if (!follower->showsWholeFile())
+                statusBar()->showMessage("Stopped following " + current->displayName()
+                                         + "; edits are recorded for recovery once it is saved or reloaded", 5000);
+            else if (!current->journal()->start(current->fileName(), false))
+                statusBar()->showMessage("Cannot record edits: " + current->journal()->errorString(), 5000);
+            else
+                statusBar()->showMessage("Stopped following " + current->displayName(), 5000);
+        }
+        return;
+    }
+
+    QString problem;
+    if (!follower)
+        problem = "Files in the large file view cannot be followed";
+    else if (current->fileName().isEmpty() || isModified(current) || current->fileSize() < 0)
+        problem = "Save the file before following it";
+    else if (isLoading() || fileSaver->isSaving() || isTransforming())
+        problem = "Wait for the current operation to finish";
+    if (problem.isEmpty()) {
+        // Appended lines are not edits, so nothing is journaled meanwhile.
+        current->journal()->stop();
+        follower->setMaxLines(followMaxLines);
+        if (!follower->start(current->fileName(), current->fileSize()))
+            problem = "Cannot follow file: " + follower->errorString();
+    }
+    if (!problem.isEmpty()) {
+        updateFollowAction();
+        statusBar()->showMessage(problem, 5000);
+        return;
+    }
+    textEdit->setReadOnly(true);
+    textEdit->moveCursor(QTextCursor::End);
+    textEdit->ensureCursorVisible();
+    statusBar()->showMessage("Following " + current->displayName(), 5000);
+}
+
+void TextEditor::chooseFollowLineLimit() {
+    bool ok = false;
+    const int lines = QInputDialog::getInt(this, "Follow Line Limit", "Lines kept while following (0 for no limit):",
+                                           followMaxLines, 0, INT_MAX, 10000, &ok);
+    if (!ok)
+        return;
+    followMaxLines = lines;
+    QSettings("TextEditor", "TextEditor").setValue("followMaxLines", lines);
+    for (EditorDocument *document : std::as_const(documents)) {
+        if (document->follower())
+            document->follower()->setMaxLines(lines);
+    }
+}
+
+void TextEditor::setMemoryBudget(qint64 bytes) {
+    memoryBudget = bytes;
+    enforceMemoryBudget();
+}
+
+void TextEditor::chooseMemoryBudget() {
+    bool ok = false;
+    const int mb = QInputDialog::getInt(this, "Memory Budget", "Memory for open documents (MB):",
+                                        int(memoryBudget / (1024 * 1024)), 16, 1024 * 1024, 64, &ok);
+    if (!ok)
+        return;
+    QSettings("TextEditor", "TextEditor").setValue("memoryBudgetMB", mb);
+    setMemoryBudget(qint64(mb) * 1024 * 1024);
+}
+
+void TextEditor::enforceMemoryBudget() {
+    qint64 total = 0;
+    QList<EditorDocument *> candidates;
+    for (EditorDocument *document : std::as_const(documents)) {
+        total += document->memoryEstimate();
+        if (document != current && document != savingDocument && document->state() == EditorDocument::Loaded)
+            candidates.append(document);
+    }
+
+    // Least recently used first.
+    if (total > memoryBudget) {
+        std::sort(candidates.begin(), candidates.end(), [](EditorDocument *a, EditorDocument *b) {
+            return a->lastActivated < b->lastActivated;
+        });
+        for (EditorDocument *document : std::as_const(candidates)) {
+            if (total <= memoryBudget)
+                break;
+            const qint64 before = document->memoryEstimate();
+            if (document->hibernate()) {
+                total -= before - document->memoryEstimate();
+                updateTab(document);
+            }
         }
     }
+    updateMemoryStatus();
+}
+
+void TextEditor::updateMemoryStatus() {
+    int loaded = 0;
+    int hibernated = 0;
+    qint64 bytes = 0;
+    for (EditorDocument *document : std::as_const(documents)) {
+        if (document->state() == EditorDocument::Loaded
+            || (document->isLarge() && largeFileViewer->fileName() == document->fileName()))
+            ++loaded;
+        else if (document->state() == EditorDocument::Hibernated)
+            ++hibernated;
+        bytes += document->memoryEstimate();
+    }
+    const qint64 mb = 1024 * 1024;
+    memoryLabel->setText(QString("%1 tabs (%2 loaded, %3 hibernated), documents ~%4 MB, RSS %5 MB")
+                             .arg(documents.size())
+                             .arg(loaded)
+                             .arg(hibernated)
+                             .arg(bytes / mb)
+                             .arg(MemoryUsage::currentResidentBytes() / mb));
+}
+
+void TextEditor::goToLine() {
+    const int lineCount = int(qMin<qint64>(INT_MAX, isViewingLargeFile() ? largeFileViewer->lineCount()
+                                                                         : textEdit->document()->blockCount()));
+    bool ok = false;
+    const int line = QInputDialog::getInt(this, "Go to Line", "Line:", 1, 1, qMax(1, lineCount), 1, &ok);
+    if (!ok)
+        return;
+
+    if (isViewingLargeFile()) {
+        largeFileViewer->goToLine(line - 1);
+        return;
+    }
+    QTextCursor cursor(textEdit->document()->findBlockByNumber(line - 1));
+    textEdit->setTextCursor(cursor);
+    textEdit->ensureCursorVisible();
+}
+
+bool TextEditor::isViewingLargeFile() const {
+    return editorStack->currentWidget() == largeFileViewer;
+}
+
+bool TextEditor::isLoading() const {
+    return current && current->loader() && current->loader()->isLoading();
+}
+
+bool TextEditor::isFollowing() const {
+    return current && current->follower() && current->follower()->isFollowing();
+}
+
+bool TextEditor::isModified(EditorDocument *document) const {
+    if (document->isLarge())
+        return largeFileViewer->fileName() == document->fileName() && largeFileViewer->isModified();
+    return document->isModified();
 }
 
 void TextEditor::saveFile() {
+    if (isLoading() || fileSaver->isSaving() || isSearching() || isTransforming()) {
+        statusBar()->showMessage("Wait for the current operation to finish", 5000);
+        return;
+    }
+    if (isFollowing()) {
+        statusBar()->showMessage("Stop following the file before saving it", 5000);
+        return;
+    }
     QString fileName = QFileDialog::getSaveFileName(this, "Save File");
-    if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-            QTextStream out(&file);
-            out << textEdit->toPlainText();
-            file.close();
+    if (!fileName.isEmpty())
+        writeFile(fileName);
+}
+
+bool TextEditor::writeFile(const QString &fileName) {
+    if (isLoading() || isFollowing() || fileSaver->isSaving() || isSearching() || isTransforming())
+        return false;
+
+    // The document is read-only while the writer thread drains it, so it
+    // doubles as the snapshot being saved.
+    residentBeforeLoad = MemoryUsage::currentResidentBytes();
+    loadTimer.start();
+    bool started = false;
+    if (isViewingLargeFile()) {
+        const std::shared_ptr<const PieceTable> document = largeFileViewer->pieceTable();
+        if (!document)
+            return false;
+        largeFileViewer->setReadOnly(true);
+        started = fileSaver->save(document, fileName);
+    } else {
+        textEdit->setReadOnly(true);
+        started = fileSaver->save(textEdit->document(), fileName);
+    }
+    savingFileName = fileName;
+    savingDocument = current;
+    if (!started) {
+        savingDocument = nullptr;
+        textEdit->setReadOnly(false);
+        largeFileViewer->setReadOnly(false);
+        QMessageBox::warning(this, "Error", "Cannot save file: " + fileSaver->errorString());
+        return false;
+    }
+    loadProgress->setValue(0);
+    loadProgress->show();
+    cancelLoadButton->show();
+    statusBar()->showMessage("Saving " + QFileInfo(fileName).fileName() + "...");
+    // The document being saved has to stay in the editor until it is done.
+    tabBar->setEnabled(false);
+    return true;
+}
+
+void TextEditor::saveFinished(bool completed) {
+    EditorDocument *document = savingDocument;
+    savingDocument = nullptr;
+    tabBar->setEnabled(true);
+    textEdit->setReadOnly(isTransforming());
+    largeFileViewer->setReadOnly(false);
+    loadProgress->hide();
+    cancelLoadButton->hide();
+
+    if (!completed) {
+        if (fileSaver->errorString().isEmpty()) {
+            statusBar()->showMessage("Saving cancelled", 5000);
         } else {
-            QMessageBox::warning(this, "Error", "Cannot save file");
+            statusBar()->clearMessage();
+            QMessageBox::warning(this, "Error", "Cannot save file: " + fileSaver->errorString());
+        }
+        return;
+    }
+
+    if (document->isLarge()) {
+        largeFileViewer->markSaved();
+    } else {
+        document->document()->setModified(false);
+        document->setFileSize(fileSaver->bytesWritten());
+        // The saved file holds every journaled edit, and is what the
+        // document shows, so recording starts over against it even if it
+        // was off, e.g. after following dropped lines.
+        EditJournal *journal = document->journal();
+        if (!journal->compact(savingFileName))
+            statusBar()->showMessage("Cannot record edits: " + journal->errorString(), 5000);
+        document->setFileName(savingFileName);
+    }
+    updateTab(document);
+
+    const qint64 mb = 1024 * 1024;
+    const qint64 ms = qMax<qint64>(1, loadTimer.elapsed());
+    statusBar()->showMessage(QString("Saved %1 MB in %2 ms (%3 MB/s), memory %4 MB (was %5 MB, peak %6 MB)")
+                                 .arg(fileSaver->bytesWritten() / mb)
+                                 .arg(ms)
+                                 .arg(fileSaver->bytesWritten() * 1000 / ms / mb)
+                                 .arg(MemoryUsage::currentResidentBytes() / mb)
+                                 .arg(residentBeforeLoad / mb)
+                                 .arg(MemoryUsage::peakResidentBytes() / mb));
+}
+
+void TextEditor::cut() {
+    if (isViewingLargeFile())
+        largeFileViewer->cut();
+    else
+        textEdit->cut();
+}
+
+void TextEditor::copy() {
+    if (isViewingLargeFile())
+        largeFileViewer->copy();
+    else
+        textEdit->copy();
+}
+
+void TextEditor::paste() {
+    if (isViewingLargeFile())
+        largeFileViewer->paste();
+    else
+        textEdit->paste();
+}
+
+void TextEditor::undo() {
+    if (isViewingLargeFile())
+        largeFileViewer->undo();
+    else if (!textEdit->isReadOnly())
+        textEdit->undo();
+}
+
+void TextEditor::redo() {
+    if (isViewingLargeFile())
+        largeFileViewer->redo();
+    else if (!textEdit->isReadOnly())
+        textEdit->redo();
+}
+
+void TextEditor::showFind() {
+    if (!findDock)
+        createFindPanel();
+    findDock->show();
+    findPanel->focusFind();
+}
+
+void TextEditor::findAll() {
+    startSearch(false);
+}
+
+void TextEditor::replaceAll() {
+    startSearch(true);
+}
+
+void TextEditor::startSearch(bool replace) {
+    if (isLoading() || fileSaver->isSaving() || largeFileViewer->isIndexing()) {
+        findPanel->setStatus("Wait for the file to finish loading or saving");
+        return;
+    }
+    if (isTransforming()) {
+        findPanel->setStatus("Wait for the whitespace transform to finish");
+        return;
+    }
+    searchEngine->cancel();
+    findPanel->clearHits();
+    replacePending = replace;
+    SearchOptions options = findPanel->options();
+    options.computeReplacements = replace;
+
+    // The document stays read-only while workers are reading it.
+    bool started = false;
+    if (isViewingLargeFile()) {
+        const std::shared_ptr<const PieceTable> document = largeFileViewer->pieceTable();
+        if (!document)
+            return;
+        findPanel->setDescriber([this](const SearchHit &hit) {
+            const std::shared_ptr<const PieceTable> document = largeFileViewer->pieceTable();
+            if (!document)
+                return QString();
+            const qint64 line = document->lineAt(hit.position);
+            return QString("%1: %2").arg(line + 1).arg(document->lineText(line, hitPreviewLength));
+        });
+        largeFileViewer->setReadOnly(true);
+        started = searchEngine->search(document, options);
+    } else {
+        findPanel->setDescriber([this](const SearchHit &hit) {
+            const QTextBlock block = textEdit->document()->findBlock(int(hit.position));
+            return QString("%1: %2").arg(block.blockNumber() + 1).arg(block.text().left(hitPreviewLength));
+        });
+        textEdit->setReadOnly(true);
+        started = searchEngine->search(textEdit->document()->toRawText(), options);
+    }
+
+    if (!started) {
+        replacePending = false;
+        textEdit->setReadOnly(isFollowing());
+        largeFileViewer->setReadOnly(false);
+        findPanel->setStatus(searchEngine->errorString());
+        return;
+    }
+    findPanel->setSearching(true);
+    findPanel->setStatus("Searching...");
+}
+
+void TextEditor::searchFinished(bool completed) {
+    findPanel->setSearching(false);
+    textEdit->setReadOnly(isFollowing() || isTransforming());
+    largeFileViewer->setReadOnly(false);
+
+    const qint64 ms = searchEngine->elapsed();
+    QString status = QString("%1 hits in %2 ms").arg(findPanel->hits().size()).arg(ms);
+    if (ms > 0)
+        status += QString(" (%1 MB/s)").arg(searchEngine->bytesSearched() / 1000 / ms);
+    if (!completed) {
+        replacePending = false;
+        findPanel->setStatus(status + ", stopped");
+        return;
+    }
+    findPanel->setStatus(status);
+    if (replacePending) {
+        replacePending = false;
+        applyReplacements();
+    }
+}
+
+void TextEditor::startTransform(BulkTransform::Operation operation) {
+    if (isViewingLargeFile()) {
+        statusBar()->showMessage("Whitespace transforms are not available in the large file view", 5000);
+        return;
+    }
+    if (!current || !current->document() || textEdit->isReadOnly()) {
+        statusBar()->showMessage("The document cannot be edited now", 5000);
+        return;
+    }
+    if (!bulkTransform) {
+        bulkTransform = new BulkTransform(this);
+        connect(bulkTransform, &BulkTransform::finished, this, &TextEditor::transformFinished);
+    }
+
+    // The document stays read-only while workers rewrite its snapshot.
+    textEdit->setReadOnly(true);
+    transformDocument = current;
+    transformRevision = textEdit->document()->revision();
+    statusBar()->showMessage("Transforming...");
+    bulkTransform->start(textEdit->document()->toRawText(), operation, tabWidth);
+}
+
+void TextEditor::transformFinished(bool completed) {
+    textEdit->setReadOnly(isLoading() || isFollowing());
+    if (!completed) {
+        statusBar()->showMessage("Transform stopped", 5000);
+        return;
+    }
+    // The changes are block numbers into the text the workers read.
+    if (current != transformDocument || !current->document()
+        || current->document()->revision() != transformRevision) {
+        statusBar()->showMessage("The document changed during the transform; nothing was applied", 5000);
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    applyTransform();
+    statusBar()->showMessage(QString("Changed %1 lines in %2 ms (%3 ms to apply)")
+                             .arg(bulkTransform->changedLines())
+                             .arg(bulkTransform->elapsed())
+                             .arg(timer.elapsed()), 5000);
+}
+
+void TextEditor::applyTransform() {
+    const QVector<BulkTransform::Change> changes = bulkTransform->changes();
+    if (changes.isEmpty() || !current || !current->document())
+        return;
+    QTextDocument *document = current->document();
+    SyntaxHighlighter *highlighter = current->highlighter();
+
+    // One edit block makes this a single undo step that the document
+    // reports once. That one report spans everything from the first change
+    // to the last, so the highlighter and the completion index sit it out
+    // instead of reading every line in between.
+    textEdit->setUpdatesEnabled(false);
+    highlighter->setSuspended(true);
+    current->completion()->setSuspended(true);
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    for (int i = int(changes.size()) - 1; i >= 0; --i) {
+        const BulkTransform::Change &change = changes.at(i);
+        const QTextBlock first = document->findBlockByNumber(change.firstBlock);
+        const QTextBlock last = document->findBlockByNumber(change.firstBlock + change.blockCount - 1);
+        cursor.setPosition(first.position());
+        cursor.setPosition(last.position() + last.length() - 1, QTextCursor::KeepAnchor);
+        cursor.insertText(change.text);
+    }
+    cursor.endEditBlock();
+    highlighter->setSuspended(false);
+
+    // Only the changed lines are lexed again, plus whatever follows them
+    // while the state they end in differs, and laid out once more.
+    int dirtyFrom = -1;
+    int dirtyTo = -1;
+    for (const BulkTransform::Change &change : changes) {
+        QTextBlock first = document->findBlockByNumber(change.firstBlock);
+        const QTextBlock last = document->findBlockByNumber(change.firstBlock + change.blockCount - 1);
+        if (last.position() < dirtyTo)
+            continue;
+        if (first.position() < dirtyTo)
+            first = document->findBlock(dirtyTo);
+        const QTextBlock end = highlighter->rehighlightBlocks(first, last);
+        if (dirtyFrom < 0)
+            dirtyFrom = first.position();
+        dirtyTo = end.position() + end.length();
+    }
+    document->markContentsDirty(dirtyFrom, dirtyTo - dirtyFrom);
+    current->completion()->rebuild();
+    textEdit->setUpdatesEnabled(true);
+}
+
+void TextEditor::applyReplacements() {
+    const QVector<SearchHit> hits = findPanel->hits();
+    if (hits.isEmpty())
+        return;
+
+    if (isViewingLargeFile()) {
+        largeFileViewer->replaceAll(hits);
+    } else {
+        // One edit block makes this a single undo step, and the document
+        // only reports the change and relayouts once, when the block ends.
+        textEdit->setUpdatesEnabled(false);
+        QTextCursor cursor(textEdit->document());
+        cursor.beginEditBlock();
+        for (int i = int(hits.size()) - 1; i >= 0; --i) {
+            const SearchHit &hit = hits.at(i);
+            cursor.setPosition(int(hit.position));
+            cursor.setPosition(int(hit.position + hit.length), QTextCursor::KeepAnchor);
+            cursor.insertText(hit.replacement);
         }
+        cursor.endEditBlock();
+        textEdit->setUpdatesEnabled(true);
+    }
+    findPanel->clearHits();
+    findPanel->setStatus(QString("Replaced %1 occurrences").arg(hits.size()));
+}
+
+void TextEditor::goToHit(qint64 position, qint64 length) {
+    if (isViewingLargeFile()) {
+        largeFileViewer->select(position, length);
+        largeFileViewer->setFocus();
+        return;
     }
+    QTextCursor cursor(textEdit->document());
+    cursor.setPosition(int(position));
+    cursor.setPosition(int(position + length), QTextCursor::KeepAnchor);
+    textEdit->setTextCursor(cursor);
+    textEdit->ensureCursorVisible();
+    textEdit->setFocus();
 }
 
 void TextEditor::createMenus() {
     QMenu *fileMenu = menuBar()->addMenu("File");
 
+    QAction *newAction = fileMenu->addAction("New");
+    newAction->setShortcut(QKeySequence::New);
+    connect(newAction, &QAction::triggered, this, &TextEditor::newFile);
+
     QAction *openAction = fileMenu->addAction("Open");
     connect(openAction, &QAction::triggered, this, &TextEditor::openFile);
 
     QAction *saveAction = fileMenu->addAction("Save");
     connect(saveAction, &QAction::triggered, this, &TextEditor::saveFile);
 
+    QAction *closeAction = fileMenu->addAction("Close");
+    closeAction->setShortcut(QKeySequence::Close);
+    connect(closeAction, &QAction::triggered, this, &TextEditor::closeCurrentTab);
+
     QAction *exitAction = fileMenu->addAction("Exit");
     connect(exitAction, &QAction::triggered, this, &QWidget::close);
 
     QMenu *editMenu = menuBar()->addMenu("Edit");
 
     QAction *cutAction = editMenu->addAction("Cut");
-    connect(cutAction, &QAction::triggered, textEdit, &QTextEdit::cut);
+    connect(cutAction, &QAction::triggered, this, &TextEditor::cut);
 
     QAction *copyAction = editMenu->addAction("Copy");
-    connect(copyAction, &QAction::triggered, textEdit, &QTextEdit::copy);
+    connect(copyAction, &QAction::triggered, this, &TextEditor::copy);
 
     QAction *pasteAction = editMenu->addAction("Paste");
-    connect(pasteAction, &QAction::triggered, textEdit, &QTextEdit::paste);
+    connect(pasteAction, &QAction::triggered, this, &TextEditor::paste);
 
     QAction *undoAction = editMenu->addAction("Undo");
-    connect(undoAction, &QAction::triggered, textEdit, &QTextEdit::undo);
+    connect(undoAction, &QAction::triggered, this, &TextEditor::undo);
 
     QAction *redoAction = editMenu->addAction("Redo");
-    connect(redoAction, &QAction::triggered, textEdit, &QTextEdit::redo);
+    connect(redoAction, &QAction::triggered, this, &TextEditor::redo);
+
+    QAction *findAction = editMenu->addAction("Find/Replace...");
+    findAction->setShortcut(QKeySequence::Find);
+    connect(findAction, &QAction::triggered, this, &TextEditor::showFind);
+
+    QAction *goToLineAction = editMenu->addAction("Go to Line...");
+    goToLineAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_G));
+    connect(goToLineAction, &QAction::triggered, this, &TextEditor::goToLine);
+
+    QMenu *whitespaceMenu = editMenu->addMenu("Whitespace");
+    const QList<QPair<QString, BulkTransform::Operation>> transforms = {
+        {"Indent with Spaces", BulkTransform::IndentWithSpaces},
+        {"Indent with Tabs", BulkTransform::IndentWithTabs},
+        {"Convert Tabs to Spaces", BulkTransform::TabsToSpaces},
+        {"Trim Trailing Whitespace", BulkTransform::TrimTrailingWhitespace}
+    };
+    for (const auto &transform : transforms) {
+        const BulkTransform::Operation operation = transform.second;
+        QAction *action = whitespaceMenu->addAction(transform.first);
+        connect(action, &QAction::triggered, this, [this, operation]() { startTransform(operation); });
+    }
+
+    // Filled in when first opened; none of its actions has a shortcut.
+    QMenu *toolsMenu = menuBar()->addMenu("Tools");
+    connect(toolsMenu, &QMenu::aboutToShow, this, [this, toolsMenu]() {
+        if (toolsMenu->isEmpty())
+            createToolsMenu(toolsMenu);
+    });
+}
+
+void TextEditor::createToolsMenu(QMenu *toolsMenu) {
+    QAction *traceAction = toolsMenu->addAction("Record Trace");
+    traceAction->setCheckable(true);
+    connect(traceAction, &QAction::toggled, this, &TextEditor::setTracing);
+
+    QAction *saveTraceAction = toolsMenu->addAction("Save Trace...");
+    connect(saveTraceAction, &QAction::triggered, this, &TextEditor::saveTrace);
+
+    toolsMenu->addSeparator();
+    followAction = toolsMenu->addAction("Follow File");
+    followAction->setCheckable(true);
+    followAction->setChecked(isFollowing());
+    connect(followAction, &QAction::triggered, this, &TextEditor::setFollowing);
+
+    QAction *followLimitAction = toolsMenu->addAction("Follow Line Limit...");
+    connect(followLimitAction, &QAction::triggered, this, &TextEditor::chooseFollowLineLimit);
+
+    toolsMenu->addSeparator();
+    QAction *memoryBudgetAction = toolsMenu->addAction("Memory Budget...");
+    connect(memoryBudgetAction, &QAction::triggered, this, &TextEditor::chooseMemoryBudget);
 }
 
-void TextEditor::insertCompletion(cost QString &completion) {
-    QTextCursor tc = textEdit->textCurosr();
+void TextEditor::insertCompletion(const QString &completion) {
+    QTextCursor tc = textEdit->textCursor();
     int extra = completion.length() - completer->completionPrefix().length();
     tc.movePosition(QTextCursor::Left);
     tc.movePosition(QTextCursor::EndOfWord);
@@ -209,28 +1356,30 @@ void TextEditor::insertCompletion(cost QString &completion) {
     textEdit->setTextCursor(tc);
 }
 
-void TextEditor::keyPressEvent(QKeyEvent *e) {
-    if (completer && completer->popup()->isVisible()) {
-        // The following keys are forwarded by the completer to the widget
-        switch (e->key()) {
-        case Qt::Key_Enter:
-        case Qt::Key_Return:
-        case Qt::Key_Escape:
-        case Qt::Key_Tab:
-        case Qt::Key_Backtab:
-            e->ignore();
-            return; // Let the completer do default behavior
-        default:
-            break;
-        }
+bool TextEditor::isCompletionKey(const QKeyEvent *e) const {
+    if (!completer || !completer->popup()->isVisible())
+        return false;
+    // The following keys are forwarded by the completer to the widget
+    switch (e->key()) {
+    case Qt::Key_Enter:
+    case Qt::Key_Return:
+    case Qt::Key_Escape:
+    case Qt::Key_Tab:
+    case Qt::Key_Backtab:
+        return true;
+    default:
+        return false;
     }
+}
 
-    bool isShortcut = (e->modifiers() & Qt::ControlModifier) && e->key() == Qt::Key_E; // CTRL+E
-    if (!completer || !isShortcut) // Do not process the shortcut when we have a completer
-        QMainWindow::keyPressEvent(e);
+bool TextEditor::isCompletionShortcut(const QKeyEvent *e) {
+    return (e->modifiers() & Qt::ControlModifier) && e->key() == Qt::Key_E; // CTRL+E
+}
 
+void TextEditor::updateCompletion(QKeyEvent *e) {
+    const bool isShortcut = isCompletionShortcut(e);
     const bool ctrlOrShift = e->modifiers() & (Qt::ControlModifier | Qt::ShiftModifier);
-    if (!completer || (ctrlOrShift && e->text().isEmpty()))
+    if ((ctrlOrShift && e->text().isEmpty()) || !current || !current->completion())
         return;
 
     static QString eow("~!@#$%^&*()_+{}|:\"<>?,./;'[]\\-="); // End of word
@@ -239,14 +1388,24 @@ void TextEditor::keyPressEvent(QKeyEvent *e) {
 
     if (!isShortcut && (hasModifier || e->text().isEmpty() || completionPrefix.length() < 3
                         || eow.contains(e->text().right(1)))) {
-        completer->popup()->hide();
+        if (completer)
+            completer->popup()->hide();
         return;
     }
 
+    if (!completer)
+        createCompleter();
     if (completionPrefix != completer->completionPrefix()) {
+        // Only the best few candidates go into the model, so the completer's
+        // own filtering never sees more than maxCompletions rows.
+        model->setStringList(current->completion()->complete(textEdit->textCursor(), completionPrefix, maxCompletions));
         completer->setCompletionPrefix(completionPrefix);
         completer->popup()->setCurrentIndex(completer->completionModel()->index(0, 0));
     }
+    if (completer->completionCount() == 0) {
+        completer->popup()->hide();
+        return;
+    }
     QRect cr = textEdit->cursorRect();
     cr.setWidth(completer->popup()->sizeHintForColumn(0)
                 + completer->popup()->verticalScrollBar()->sizeHint().width());
@@ -257,4 +1416,23 @@ QString TextEditor::textUnderCursor() const {
     QTextCursor tc = textEdit->textCursor();
     tc.select(QTextCursor::WordUnderCursor);
     return tc.selectedText();
-}
\ No newline at end of file
+}
+
+void TextEditor::setTracing(bool on) {
+    Tracing::setEnabled(on);
+    traceOverlay->setVisible(on);
+    traceOverlay->raise();
+}
+
+void TextEditor::saveTrace() {
+    const QString fileName = QFileDialog::getSaveFileName(this, "Save Trace", "trace.json", "Chrome trace (*.json)");
+    if (fileName.isEmpty())
+        return;
+    // Small enough to write in one go; open it in Perfetto or chrome://tracing.
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(Tracing::chromeTrace()) < 0 || !file.commit()) {
+        QMessageBox::warning(this, "Error", "Cannot save trace: " + file.errorString());
+        return;
+    }
+    statusBar()->showMessage("Trace saved to " + QFileInfo(fileName).fileName(), 5000);
+}
@@ -3,11 +3,31 @@
 
 #include <QMainWindow>
 #include <QTextEdit>
-#include <QPlainTextEdit>
 #include <QCompleter>
 #include <QStringListModel>
+#include <QElapsedTimer>
 #include "syntaxhighlighter.h"
+#include "backgroundhighlighter.h"
+#include "bulktransform.h"
+#include "codeedit.h"
+#include "digitatlas.h"
+#include "editordocument.h"
+#include "filesaver.h"
+#include "findpanel.h"
+#include "largefileviewer.h"
 #include "linenumberarea.h"
+#include "searchengine.h"
+
+class QAction;
+class QDockWidget;
+class QLabel;
+class QMenu;
+class QTabBar;
+class QTimer;
+class TraceOverlay;
+class QProgressBar;
+class QStackedWidget;
+class QPushButton;
 
 class TextEditor : public QMainWindow {
     Q_OBJECT
@@ -16,25 +36,133 @@ public:
     explicit TextEditor(QWidget *parent = nullptr);
     int lineNumberAreaWidth();
     void lineNumberAreaPaintEvent(QPaintEvent *event);
+    // A click on a fold marker folds or unfolds that line.
+    void lineNumberAreaMousePressEvent(QMouseEvent *event);
+    bool isCompletionKey(const QKeyEvent *e) const;
+    static bool isCompletionShortcut(const QKeyEvent *e);
+    void updateCompletion(QKeyEvent *e);
+    // Start loading or saving without asking for a name; progress and the
+    // outcome are reported like the menu actions.
+    bool loadFile(const QString &fileName);
+    bool writeFile(const QString &fileName);
+    // Reopens the tabs of the last session; each file is only read once its
+    // tab is first activated. Without activateCurrent the current tab
+    // stays, for files named on the command line.
+    void restoreSession(bool activateCurrent = true);
+    // Inactive documents are hibernated once their estimated total exceeds
+    // this many bytes.
+    void setMemoryBudget(qint64 bytes);
+
+signals:
+    // A file finished loading into a tab, or indexing in the large file view.
+    void fileOpened(bool completed);
+    // Emitted once, after the first paint that shows the current document,
+    // or as much of it as has been read by then.
+    void firstScreenPainted();
 
 protected:
+    void closeEvent(QCloseEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
 
 private slots:
+    void newFile();
     void openFile();
     void saveFile();
+    void closeCurrentTab();
+    void tabActivated(int index);
+    void closeTab(int index);
     void updateLineNumberAreaWidth(int newBlockCount);
     void highlightCurrentLine();
     void updateLineNumberArea(const QRect &, int);
-    void insertComplete(const QString &completion);
+    void insertCompletion(const QString &completion);
+    void loadProgressed(qint64 bytesRead, qint64 totalBytes);
+    void saveFinished(bool completed);
+    void largeFileIndexed(bool completed);
+    void goToLine();
+    void cut();
+    void copy();
+    void paste();
+    void undo();
+    void redo();
+    void showFind();
+    void findAll();
+    void replaceAll();
+    void searchFinished(bool completed);
+    void goToHit(qint64 position, qint64 length);
+    void transformFinished(bool completed);
+    void setTracing(bool on);
+    void saveTrace();
+    void setFollowing(bool on);
+    void chooseFollowLineLimit();
+    void chooseMemoryBudget();
+    void enforceMemoryBudget();
 
 private:
-    QPlainTextEdit *textEdit;
-    SyntaxHighlighter *highlighter;
+    QStackedWidget *editorStack;
+    QTextEdit *textEdit;
+    LargeFileViewer *largeFileViewer;
+    BackgroundHighlighter *backgroundHighlighter;
+    QTabBar *tabBar;
+    QList<EditorDocument *> documents;
+    EditorDocument *current = nullptr;
+    EditorDocument *savingDocument = nullptr;
+    QMetaObject::Connection blockCountConnection;
+    qint64 activationCount = 0;
+    QAction *followAction = nullptr;
+    int followMaxLines;
+    qint64 memoryBudget;
+    QTimer *memoryTimer;
+    QLabel *memoryLabel;
+    FileSaver *fileSaver;
+    QProgressBar *loadProgress;
+    QPushButton *cancelLoadButton;
+    QElapsedTimer loadTimer;
+    qint64 residentBeforeLoad = 0;
+    QDockWidget *findDock = nullptr;
+    FindPanel *findPanel = nullptr;
+    SearchEngine *searchEngine = nullptr;
+    bool replacePending = false;
+    BulkTransform *bulkTransform = nullptr;
+    // The document a running transform read, as it was then; the result is
+    // dropped if either has changed by the time it is done.
+    EditorDocument *transformDocument = nullptr;
+    int transformRevision = -1;
     QWidget *lineNumberArea;
-    QCompleter *completer;
-    QStringListModel *model;
+    TraceOverlay *traceOverlay;
+    DigitAtlas lineNumberGlyphs;
+    QCompleter *completer = nullptr;
+    QString savingFileName;
+    QStringListModel *model = nullptr;
+    bool firstScreenShown = false;
     void createMenus();
+    void createToolsMenu(QMenu *toolsMenu);
+    void createFindPanel();
+    void createCompleter();
+    void clearSearch();
+    bool isSearching() const;
+    bool isTransforming() const;
+    void updateFollowAction();
+    bool hasFirstScreen() const;
+    int foldMarkerWidth() const;
+    bool isViewingLargeFile() const;
+    bool isLoading() const;
+    bool isFollowing() const;
+    bool isModified(EditorDocument *document) const;
+    EditorDocument *findDocument(const QString &fileName) const;
+    EditorDocument *addDocument(const QString &fileName);
+    void activateDocument(EditorDocument *document);
+    void closeDocument(EditorDocument *document);
+    void updateTab(EditorDocument *document);
+    void updateMemoryStatus();
+    bool startLoading(EditorDocument *document);
+    void loadFinished(EditorDocument *document, bool completed);
+    QString textUnderCursor() const;
+    void startSearch(bool replace);
+    void applyReplacements();
+    void startTransform(BulkTransform::Operation operation);
+    void applyTransform();
+    void startJournal(EditorDocument *document);
 };
 
-#endif // TEXTEDITOR_H
\ No newline at end of file
+#endif // TEXTEDITOR_H
@@ -0,0 +1,848 @@
+#include <QtTest>
+#include <QAction>
+#include <QDateTime>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QScrollBar>
+#include <QSignalSpy>
+#include <QTextBlock>
+#include <QTemporaryDir>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextEdit>
+#include <QThread>
+#include "batchexporter.h"
+#include "bulktransform.h"
+#include "completionindex.h"
+#include "editjournal.h"
+#include "filefollower.h"
+#include "filesaver.h"
+#include "highlightlexer.h"
+#include "languages.h"
+#include "largefileviewer.h"
+#include "linenumberarea.h"
+#include "literalsearch.h"
+#include "memoryusage.h"
+#include "searchengine.h"
+#include "structureindex.h"
+#include "syntaxhighlighter.h"
+#include "texteditor.h"
+#include <climits>
+#include <iterator>
+
+// Generated corpus sizes. The 500 MB files take the LargeFileViewer path and
+// are only generated and measured when TEXTEDITOR_BENCH_LARGE is set.
+static const qint64 smallCorpusSize = 64 * 1024;
+static const qint64 mediumCorpusSize = 10 * 1024 * 1024;
+// Further QTextEdit-sized files, for figures meant to stay flat with size.
+static const qint64 gutterCorpusSizes[] = {1024 * 1024, mediumCorpusSize, 50 * 1024 * 1024};
+static const qint64 largeCorpusSize = 500 * 1024 * 1024;
+static const int operationTimeout = 10 * 60 * 1000;
+static const int completionPrefixes = 256;
+static const int exportFileCount = 64;
+// Tabs open at once in the manyTabs benchmark.
+static const int tabCount = 50;
+// Lines a "service" writes to the followed log, in bursts.
+static const int followLineCount = 200000;
+static const int followBurstLines = 1000;
+// Lines FileFollower keeps in the followAppend benchmark.
+static const int followMaxLines = 50000;
+static const double mb = 1024.0 * 1024.0;
+
+namespace {
+
+const char *const nouns[] = {"Buffer", "Cursor", "Layout", "Index", "Token", "Block", "Range", "Viewport",
+                             "Gutter", "Journal", "Piece", "Match", "Lexer", "Glyph", "Chunk", "Record"};
+const char *const levels[] = {"INFO ", "INFO ", "INFO ", "DEBUG", "WARN ", "ERROR"};
+const char *const paths[] = {"/api/v1/items/", "/api/v1/users/", "/static/js/", "/health/", "/api/v2/search/"};
+
+QByteArray identifier(QRandomGenerator &random) {
+    // A few thousand distinct identifiers, as in a real code base.
+    return QByteArray(nouns[random.bounded(int(std::size(nouns)))]) + QByteArray::number(random.bounded(512));
+}
+
+void appendCpp(QByteArray &out, QRandomGenerator &random) {
+    const QByteArray name = identifier(random);
+    out += "/* Recomputes the " + name.toLower() + " totals.\n"
+           " * Returns the number of entries that changed. */\n";
+    out += "static int update" + name + "(const std::vector<int> &values, const QString &label) {\n";
+    out += "    int total = 0; // entries changed so far\n";
+    const int statements = random.bounded(4, 12);
+    for (int i = 0; i < statements; ++i) {
+        out += "    if (values[" + QByteArray::number(i) + "] > " + QByteArray::number(random.bounded(1000))
+               + ")\n        total += compute" + identifier(random) + "(values, \"" + identifier(random) + "\");\n";
+    }
+    out += "    return total;\n}\n\n";
+}
+
+void appendLog(QByteArray &out, QRandomGenerator &random, qint64 line) {
+    const qint64 ms = line * 37;
+    out += QDateTime::fromMSecsSinceEpoch(1700000000000 + ms).toUTC().toString("yyyy-MM-dd hh:mm:ss.zzz").toLatin1();
+    out += ' ';
+    out += levels[random.bounded(int(std::size(levels)))];
+    out += " [worker-" + QByteArray::number(random.bounded(16)) + "] GET ";
+    out += paths[random.bounded(int(std::size(paths)))] + QByteArray::number(random.bounded(100000));
+    out += " 200 in " + QByteArray::number(random.bounded(1, 500)) + " ms\n";
+}
+
+// Returns the path of a corpus file, generating it on first use. Files are
+// deterministic and kept between runs so results stay comparable.
+QString corpusFile(const QString &kind, qint64 size) {
+    QString directory = qEnvironmentVariable("TEXTEDITOR_BENCH_CORPUS");
+    if (directory.isEmpty())
+        directory = QDir::temp().filePath("TextEditor_bench_corpus");
+    QDir().mkpath(directory);
+    const QString fileName = QDir(directory).filePath(QString("%1-%2.%3")
+                                                           .arg(kind)
+                                                           .arg(size)
+                                                           .arg(kind == "cpp" ? "cpp" : "log"));
+    if (QFileInfo(fileName).size() >= size)
+        return fileName;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return QString();
+    QRandomGenerator random(quint32(size));
+    QByteArray chunk;
+    qint64 written = 0;
+    qint64 line = 0;
+    while (written < size) {
+        chunk.clear();
+        while (chunk.size() < 1024 * 1024 && written + chunk.size() < size) {
+            if (kind == "cpp")
+                appendCpp(chunk, random);
+            else
+                appendLog(chunk, random, line++);
+        }
+        if (file.write(chunk) != chunk.size())
+            return QString();
+        written += chunk.size();
+    }
+    return fileName;
+}
+
+QString readCorpus(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+    return QString::fromUtf8(file.readAll());
+}
+
+bool largeCorpusEnabled() {
+    return qEnvironmentVariableIsSet("TEXTEDITOR_BENCH_LARGE");
+}
+
+// The gutter has no meta-object of its own, so findChild() cannot tell it
+// apart from other widgets.
+LineNumberArea *gutterOf(TextEditor &editor) {
+    const QList<QWidget *> widgets = editor.findChildren<QWidget *>();
+    for (QWidget *widget : widgets) {
+        if (LineNumberArea *area = dynamic_cast<LineNumberArea *>(widget))
+            return area;
+    }
+    return nullptr;
+}
+
+// Opens fileName in editor and waits until it is loaded or indexed.
+bool loadInto(TextEditor &editor, const QString &fileName) {
+    QSignalSpy opened(&editor, &TextEditor::fileOpened);
+    if (!editor.loadFile(fileName))
+        return false;
+    QElapsedTimer timer;
+    timer.start();
+    while (opened.isEmpty() && timer.elapsed() < operationTimeout)
+        QTest::qWait(1);
+    return !opened.isEmpty() && opened.first().first().toBool();
+}
+
+// The highlighter before HighlightLexer: one QRegularExpression per rule,
+// each run over the whole line with globalMatch(), and a scan for /* */.
+// Kept so the lexer benchmark can show what replacing it gained.
+class RegexRuleBaseline {
+public:
+    RegexRuleBaseline() {
+        const char *const keywords[] = {"char", "class", "const", "double", "enum", "explicit", "friend", "inline",
+                                        "int", "long", "namespace", "operator", "private", "protected", "public",
+                                        "short", "signals", "signed", "slots", "static", "struct", "template",
+                                        "typedef", "typename", "union", "unsigned", "virtual", "void", "volatile"};
+        for (const char *keyword : keywords)
+            rules.append(QRegularExpression(QString("\\b%1\\b").arg(keyword)));
+        rules.append(QRegularExpression("\\bQ[A-Za-z]+\\b"));
+        rules.append(QRegularExpression("//[^\n]*"));
+        rules.append(QRegularExpression("\".*\""));
+        rules.append(QRegularExpression("\\b[A-Za-z0-9_]+(?=\\()"));
+        for (QRegularExpression &rule : rules)
+            rule.optimize();
+    }
+
+    // Returns the state for the next line and adds the formats it would
+    // have set to ranges.
+    int highlight(const QString &text, int state, qint64 &ranges) const {
+        for (const QRegularExpression &rule : rules) {
+            QRegularExpressionMatchIterator it = rule.globalMatch(text);
+            while (it.hasNext()) {
+                it.next();
+                ++ranges;
+            }
+        }
+        int next = 0;
+        int start = state == 1 ? 0 : int(text.indexOf("/*"));
+        while (start >= 0) {
+            const int end = int(text.indexOf("*/", start));
+            const int length = end < 0 ? int(text.size()) - start : end - start + 2;
+            if (end < 0)
+                next = 1;
+            ++ranges;
+            start = int(text.indexOf("/*", start + length));
+        }
+        return next;
+    }
+
+private:
+    QVector<QRegularExpression> rules;
+};
+
+} // namespace
+
+// Throughput and latency of the editor's hot paths on a generated corpus.
+// Besides the usual QtTest output, every figure is written to a JSON file
+// (TEXTEDITOR_BENCH_JSON, default TextEditor_bench.json) so runs can be
+// compared with each other.
+class TextEditorBench : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void lexer_data();
+    void lexer();
+    void languageLoad_data();
+    void languageLoad();
+    void highlightBlock_data();
+    void highlightBlock();
+    void structure_data();
+    void structure();
+    void coldStart_data();
+    void coldStart();
+    void openFile_data();
+    void openFile();
+    void saveFile_data();
+    void saveFile();
+    void manyTabs();
+    void gutterPaint_data();
+    void gutterPaint();
+    void completion_data();
+    void completion();
+    void search_data();
+    void search();
+    void bulkTransform_data();
+    void bulkTransform();
+    void journalRecord();
+    void followAppend();
+    void batchExport_data();
+    void batchExport();
+
+private:
+    void addCorpusRows(bool includeSmall, bool includeLarge);
+    void report(const QString &metric, double value, const QString &unit);
+
+    QJsonArray results;
+    QTemporaryDir outputDirectory;
+};
+
+void TextEditorBench::initTestCase() {
+    QVERIFY(outputDirectory.isValid());
+    QVERIFY(!corpusFile("cpp", smallCorpusSize).isEmpty());
+    QVERIFY(!corpusFile("cpp", mediumCorpusSize).isEmpty());
+    QVERIFY(!corpusFile("log", mediumCorpusSize).isEmpty());
+    if (largeCorpusEnabled()) {
+        QVERIFY(!corpusFile("cpp", largeCorpusSize).isEmpty());
+        QVERIFY(!corpusFile("log", largeCorpusSize).isEmpty());
+    }
+}
+
+void TextEditorBench::cleanupTestCase() {
+    QJsonObject root;
+    root["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["qt"] = QString(qVersion());
+    root["literalKernel"] = QString(LiteralSearch::kernelName());
+    root["results"] = results;
+
+    QString fileName = qEnvironmentVariable("TEXTEDITOR_BENCH_JSON");
+    if (fileName.isEmpty())
+        fileName = "TextEditor_bench.json";
+    QFile file(fileName);
+    QVERIFY2(file.open(QIODevice::WriteOnly | QIODevice::Truncate), qPrintable(file.errorString()));
+    file.write(QJsonDocument(root).toJson());
+}
+
+void TextEditorBench::addCorpusRows(bool includeSmall, bool includeLarge) {
+    QTest::addColumn<QString>("fileName");
+    if (includeSmall)
+        QTest::newRow("cpp-64KB") << corpusFile("cpp", smallCorpusSize);
+    QTest::newRow("cpp-10MB") << corpusFile("cpp", mediumCorpusSize);
+    QTest::newRow("log-10MB") << corpusFile("log", mediumCorpusSize);
+    if (includeLarge && largeCorpusEnabled()) {
+        QTest::newRow("cpp-500MB") << corpusFile("cpp", largeCorpusSize);
+        QTest::newRow("log-500MB") << corpusFile("log", largeCorpusSize);
+    }
+}
+
+void TextEditorBench::report(const QString &metric, double value, const QString &unit) {
+    QJsonObject result;
+    result["benchmark"] = QString(QTest::currentTestFunction());
+    result["row"] = QString(QTest::currentDataTag() ? QTest::currentDataTag() : "");
+    result["metric"] = metric;
+    result["value"] = value;
+    result["unit"] = unit;
+    results.append(result);
+    qInfo().noquote() << QString("%1 %2: %3 %4").arg(result["row"].toString(), metric).arg(value, 0, 'f', 3).arg(unit);
+}
+
+void TextEditorBench::lexer_data() {
+    addCorpusRows(true, false);
+}
+
+void TextEditorBench::lexer() {
+    QFETCH(QString, fileName);
+    const QString text = readCorpus(fileName);
+    const QList<QStringView> lines = QStringView(text).split(u'\n');
+    const std::shared_ptr<const HighlightLexer> lexer = Languages::forFile(fileName);
+    QVector<HighlightLexer::Token> tokens;
+
+    qint64 passes = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        int state = HighlightLexer::NormalState;
+        for (const QStringView &line : lines) {
+            tokens.clear();
+            state = lexer->tokenize(line, state, tokens);
+        }
+        ++passes;
+    }
+    const double throughput = text.size() * 2.0 * passes / mb / (timer.nsecsElapsed() / 1e9);
+    report("throughput", throughput, "MB/s");
+
+    // The same lines through the 33 rules the lexer replaced, once: the
+    // baseline is slow enough that one pass is a stable figure.
+    const QStringList baselineLines = text.split(QLatin1Char('\n'));
+    const RegexRuleBaseline baseline;
+    qint64 ranges = 0;
+    timer.restart();
+    int state = 0;
+    for (const QString &line : baselineLines)
+        state = baseline.highlight(line, state, ranges);
+    const double baselineThroughput = text.size() * 2.0 / mb / (timer.nsecsElapsed() / 1e9);
+    QVERIFY(ranges > 0 || text.isEmpty());
+    report("baselineThroughput", baselineThroughput, "MB/s");
+    report("speedup", throughput / baselineThroughput, "x");
+}
+
+void TextEditorBench::languageLoad_data() {
+    QTest::addColumn<QString>("definition");
+    const QFileInfoList definitions = QDir(":/languages").entryInfoList({"*.json"}, QDir::Files, QDir::Name);
+    for (const QFileInfo &info : definitions)
+        QTest::newRow(qPrintable(info.completeBaseName())) << info.filePath();
+}
+
+void TextEditorBench::languageLoad() {
+    // What the on-disk cache saves at startup: compiling a definition
+    // against reading back its compiled form.
+    QFETCH(QString, definition);
+    QFile file(definition);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray json = file.readAll();
+    QString error;
+    const std::shared_ptr<const HighlightLexer> compiled = HighlightLexer::compile(json, &error);
+    QVERIFY2(compiled, qPrintable(error));
+    QByteArray serialized;
+    {
+        QDataStream stream(&serialized, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_15);
+        compiled->write(stream);
+    }
+
+    const int rounds = 20;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < rounds; ++i)
+        QVERIFY(HighlightLexer::compile(json, &error));
+    const double compileMs = timer.nsecsElapsed() / 1e6 / rounds;
+    timer.restart();
+    for (int i = 0; i < rounds; ++i) {
+        QDataStream stream(serialized);
+        stream.setVersion(QDataStream::Qt_5_15);
+        QVERIFY(HighlightLexer::read(stream));
+    }
+    const double readMs = timer.nsecsElapsed() / 1e6 / rounds;
+    report("compile", compileMs, "ms");
+    report("cached", readMs, "ms");
+    report("cacheBytes", serialized.size(), "bytes");
+}
+
+void TextEditorBench::highlightBlock_data() {
+    addCorpusRows(true, false);
+}
+
+void TextEditorBench::highlightBlock() {
+    QFETCH(QString, fileName);
+    QTextDocument document;
+    document.setPlainText(readCorpus(fileName));
+    SyntaxHighlighter highlighter(&document);
+    highlighter.setLexer(Languages::forFile(fileName));
+
+    qint64 passes = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        highlighter.rehighlight();
+        ++passes;
+    }
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    report("throughput", document.characterCount() * 2.0 * passes / mb / seconds, "MB/s");
+    report("blocks", document.blockCount() * passes / seconds, "blocks/s");
+}
+
+void TextEditorBench::structure_data() {
+    QTest::addColumn<QString>("fileName");
+    QTest::newRow("cpp-64KB") << corpusFile("cpp", smallCorpusSize);
+    QTest::newRow("cpp-10MB") << corpusFile("cpp", mediumCorpusSize);
+}
+
+void TextEditorBench::structure() {
+    QFETCH(QString, fileName);
+    QTextDocument document;
+    document.setPlainText(readCorpus(fileName));
+    SyntaxHighlighter highlighter(&document);
+    highlighter.setLexer(Languages::forFile(fileName));
+    StructureIndex structure(&document);
+
+    // Every function body; the corpus opens them at the end of a line.
+    QVector<QTextBlock> foldable;
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+        if (structure.isFoldable(block))
+            foldable.append(block);
+    }
+    QVERIFY(!foldable.isEmpty());
+
+    qint64 matches = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        for (const QTextBlock &block : std::as_const(foldable)) {
+            int match = -1;
+            QVERIFY(structure.findMatch(block.position() + block.length() - 2, &match) && match >= 0);
+        }
+        matches += foldable.size();
+    }
+    report("match", timer.nsecsElapsed() / 1e3 / qMax<qint64>(1, matches), "us");
+
+    timer.restart();
+    for (const QTextBlock &block : std::as_const(foldable))
+        QVERIFY(structure.fold(block));
+    report("foldAll", timer.nsecsElapsed() / 1e6, "ms");
+    timer.restart();
+    structure.unfoldAll();
+    report("unfoldAll", timer.nsecsElapsed() / 1e6, "ms");
+
+    // An unmatched brace at the top is the worst case for a cursor next to
+    // it: the search runs to the end of the document.
+    QTextCursor(&document).insertText("{\n");
+    int match = 0;
+    timer.restart();
+    QVERIFY(structure.findMatch(0, &match) && match < 0);
+    report("unmatched", timer.nsecsElapsed() / 1e3, "us");
+}
+
+void TextEditorBench::coldStart_data() {
+    addCorpusRows(true, true);
+}
+
+void TextEditorBench::coldStart() {
+    // What main() does for a file on the command line, up to the first
+    // screen of it being painted. The process start itself is measured by
+    // "TextEditor --startup-time FILE".
+    QFETCH(QString, fileName);
+    bool painted = false;
+    qint64 ms = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE {
+        TextEditor editor;
+        QSignalSpy firstScreen(&editor, &TextEditor::firstScreenPainted);
+        QVERIFY(editor.loadFile(fileName));
+        editor.resize(800, 600);
+        editor.show();
+        painted = firstScreen.wait(operationTimeout);
+        ms = timer.elapsed();
+    }
+    QVERIFY(painted);
+    report("firstPaint", ms, "ms");
+}
+
+void TextEditorBench::openFile_data() {
+    addCorpusRows(true, true);
+}
+
+void TextEditorBench::openFile() {
+    QFETCH(QString, fileName);
+    TextEditor editor;
+    const qint64 residentBefore = MemoryUsage::currentResidentBytes();
+    const bool peakIsReset = MemoryUsage::resetPeakResidentBytes();
+
+    bool loaded = false;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE {
+        loaded = loadInto(editor, fileName);
+    }
+    const qint64 ms = qMax<qint64>(1, timer.elapsed());
+    QVERIFY(loaded);
+    report("time", ms, "ms");
+    report("throughput", QFileInfo(fileName).size() / mb * 1000.0 / ms, "MB/s");
+    report("residentGrowth", (MemoryUsage::currentResidentBytes() - residentBefore) / mb, "MB");
+    report(peakIsReset ? "peakResident" : "processPeakResident", MemoryUsage::peakResidentBytes() / mb, "MB");
+}
+
+void TextEditorBench::saveFile_data() {
+    addCorpusRows(true, true);
+}
+
+void TextEditorBench::saveFile() {
+    QFETCH(QString, fileName);
+    TextEditor editor;
+    QVERIFY(loadInto(editor, fileName));
+    const QString target = outputDirectory.filePath(QFileInfo(fileName).fileName());
+    QSignalSpy saved(editor.findChild<FileSaver *>(), &FileSaver::finished);
+    const qint64 residentBefore = MemoryUsage::currentResidentBytes();
+    const bool peakIsReset = MemoryUsage::resetPeakResidentBytes();
+
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE {
+        QVERIFY(editor.writeFile(target));
+        QVERIFY(saved.wait(operationTimeout));
+    }
+    const qint64 ms = qMax<qint64>(1, timer.elapsed());
+    QVERIFY(saved.first().first().toBool());
+    const qint64 bytes = QFileInfo(target).size();
+    QFile::remove(target);
+    report("time", ms, "ms");
+    report("throughput", bytes / mb * 1000.0 / ms, "MB/s");
+    report("residentGrowth", (MemoryUsage::currentResidentBytes() - residentBefore) / mb, "MB");
+    report(peakIsReset ? "peakResident" : "processPeakResident", MemoryUsage::peakResidentBytes() / mb, "MB");
+}
+
+void TextEditorBench::manyTabs() {
+    // Memory with many medium files open, then after every inactive tab has
+    // been hibernated.
+    const QString source = corpusFile("cpp", mediumCorpusSize / 10);
+    TextEditor editor;
+    editor.setMemoryBudget(LLONG_MAX);
+    const qint64 residentBefore = MemoryUsage::currentResidentBytes();
+
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < tabCount; ++i) {
+            const QString fileName = outputDirectory.filePath(QString("tabs/tab%1.cpp").arg(i));
+            if (!QFileInfo::exists(fileName)) {
+                QDir().mkpath(QFileInfo(fileName).absolutePath());
+                QVERIFY(QFile::copy(source, fileName));
+            }
+            QVERIFY(loadInto(editor, fileName));
+        }
+    }
+    report("time", timer.elapsed(), "ms");
+    report("residentGrowth", (MemoryUsage::currentResidentBytes() - residentBefore) / mb, "MB");
+
+    editor.setMemoryBudget(0);
+    report("residentGrowthHibernated", (MemoryUsage::currentResidentBytes() - residentBefore) / mb, "MB");
+}
+
+void TextEditorBench::gutterPaint_data() {
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<bool>("atBottom");
+    // Painting must not depend on the line count: the bottom of files of
+    // growing size in the QTextEdit path should all cost the same.
+    const QString medium = corpusFile("cpp", mediumCorpusSize);
+    QTest::newRow("cpp-10MB-top") << medium << false;
+    for (qint64 size : gutterCorpusSizes)
+        QTest::newRow(qPrintable(QString("cpp-%1MB-bottom").arg(size / (1024 * 1024)))) << corpusFile("cpp", size) << true;
+    if (largeCorpusEnabled()) {
+        const QString large = corpusFile("cpp", largeCorpusSize);
+        QTest::newRow("cpp-500MB-top") << large << false;
+        QTest::newRow("cpp-500MB-bottom") << large << true;
+    }
+}
+
+void TextEditorBench::gutterPaint() {
+    QFETCH(QString, fileName);
+    QFETCH(bool, atBottom);
+    TextEditor editor;
+    editor.resize(800, 600);
+    editor.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&editor));
+    QVERIFY(loadInto(editor, fileName));
+
+    LargeFileViewer *viewer = editor.findChild<LargeFileViewer *>();
+    if (atBottom) {
+        if (viewer->isVisible())
+            viewer->goToLine(int(qMin<qint64>(INT_MAX, viewer->lineCount() - 1)));
+        else
+            editor.findChild<QTextEdit *>()->verticalScrollBar()->setValue(
+                editor.findChild<QTextEdit *>()->verticalScrollBar()->maximum());
+    }
+    QWidget *gutter = gutterOf(editor);
+    QVERIFY(gutter);
+    gutter->repaint();
+
+    qint64 paints = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        gutter->repaint();
+        ++paints;
+    }
+    report("paint", timer.nsecsElapsed() / 1e3 / qMax<qint64>(1, paints), "us");
+}
+
+void TextEditorBench::completion_data() {
+    addCorpusRows(false, false);
+}
+
+void TextEditorBench::completion() {
+    QFETCH(QString, fileName);
+    const QString text = readCorpus(fileName);
+    QVector<QStringView> words;
+    CompletionIndex::identifiers(text, words);
+    CompletionIndex index;
+    for (const QStringView &word : std::as_const(words))
+        index.acquire(word);
+    index.addPinned(Languages::forFile(fileName)->keywordList());
+
+    // Prefixes of one to four characters taken from words spread through
+    // the corpus, the way they are typed.
+    QStringList prefixes;
+    for (int i = 0; i < completionPrefixes && !words.isEmpty(); ++i) {
+        const QStringView word = words.at(qsizetype(i) * words.size() / completionPrefixes);
+        prefixes << word.left(1 + i % 4).toString();
+    }
+    const QHash<quint32, int> nearby;
+
+    qint64 lookups = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        for (const QString &prefix : std::as_const(prefixes))
+            index.complete(prefix, nearby, 50, 50);
+        lookups += prefixes.size();
+    }
+    report("words", index.wordCount(), "words");
+    report("lookup", timer.nsecsElapsed() / 1e3 / qMax<qint64>(1, lookups), "us");
+}
+
+void TextEditorBench::search_data() {
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<bool>("regularExpression");
+    QTest::addColumn<QString>("pattern");
+    const QString medium = corpusFile("cpp", mediumCorpusSize);
+    QTest::newRow("cpp-10MB-literal") << medium << false << QString("computeJournal1");
+    QTest::newRow("cpp-10MB-regex") << medium << true << QString("compute\\w+\\(values, \"Gutter");
+    if (largeCorpusEnabled()) {
+        const QString large = corpusFile("cpp", largeCorpusSize);
+        QTest::newRow("cpp-500MB-literal") << large << false << QString("computeJournal1");
+        QTest::newRow("cpp-500MB-regex") << large << true << QString("compute\\w+\\(values, \"Gutter");
+    }
+}
+
+void TextEditorBench::search() {
+    QFETCH(QString, fileName);
+    QFETCH(bool, regularExpression);
+    QFETCH(QString, pattern);
+
+    // Large files are searched in the piece table the viewer edits.
+    TextEditor editor;
+    std::shared_ptr<const PieceTable> pieces;
+    QString text;
+    if (QFileInfo(fileName).size() >= largeCorpusSize) {
+        QVERIFY(loadInto(editor, fileName));
+        pieces = editor.findChild<LargeFileViewer *>()->pieceTable();
+        QVERIFY(pieces);
+    } else {
+        text = readCorpus(fileName);
+    }
+
+    SearchOptions options;
+    options.pattern = pattern;
+    options.regularExpression = regularExpression;
+    SearchEngine engine;
+    QSignalSpy finished(&engine, &SearchEngine::finished);
+
+    qint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        finished.clear();
+        QVERIFY(pieces ? engine.search(pieces, options) : engine.search(text, options));
+        QVERIFY(finished.wait(operationTimeout));
+        bytes += engine.bytesSearched();
+    }
+    report("throughput", bytes / (1024.0 * mb) / (timer.nsecsElapsed() / 1e9), "GB/s");
+}
+
+void TextEditorBench::bulkTransform_data() {
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<QString>("action");
+    const QString medium = corpusFile("cpp", mediumCorpusSize);
+    // The corpus is indented with spaces: the first rewrites most lines,
+    // the second only scans them.
+    QTest::newRow("cpp-10MB-indentWithTabs") << medium << QString("Indent with Tabs");
+    QTest::newRow("cpp-10MB-trimTrailing") << medium << QString("Trim Trailing Whitespace");
+}
+
+void TextEditorBench::bulkTransform() {
+    QFETCH(QString, fileName);
+    QFETCH(QString, action);
+    TextEditor editor;
+    QVERIFY(loadInto(editor, fileName));
+    QAction *transform = nullptr;
+    for (QAction *candidate : editor.findChildren<QAction *>()) {
+        if (candidate->text() == action)
+            transform = candidate;
+    }
+    QVERIFY(transform);
+    QTextDocument *document = editor.findChild<QTextEdit *>()->document();
+    const int undoStepsBefore = document->availableUndoSteps();
+
+    qint64 ms = 0;
+    qint64 computeMs = 0;
+    int lines = 0;
+    QBENCHMARK_ONCE {
+        QElapsedTimer timer;
+        timer.start();
+        transform->trigger();
+        BulkTransform *engine = editor.findChild<BulkTransform *>();
+        QVERIFY(engine);
+        // The editor applies the result in its own slot, which runs before
+        // the spy records the signal.
+        QSignalSpy finished(engine, &BulkTransform::finished);
+        QVERIFY(finished.wait(operationTimeout));
+        ms = qMax<qint64>(1, timer.elapsed());
+        QVERIFY(finished.first().first().toBool());
+        computeMs = engine->elapsed();
+        lines = engine->changedLines();
+    }
+    QCOMPARE(document->availableUndoSteps(), undoStepsBefore + (lines > 0 ? 1 : 0));
+    report("changedLines", lines, "lines");
+    report("compute", computeMs, "ms");
+    report("time", ms, "ms");
+    report("throughput", document->characterCount() * 2.0 / mb * 1000.0 / ms, "MB/s");
+}
+
+void TextEditorBench::journalRecord() {
+    // One typed character at a time; the journal times its own share.
+    const QString source = corpusFile("cpp", smallCorpusSize);
+    const QString fileName = outputDirectory.filePath("journaled.cpp");
+    QFile::remove(fileName);
+    QVERIFY(QFile::copy(source, fileName));
+    QTextDocument document;
+    document.setPlainText(readCorpus(fileName));
+    EditJournal journal(&document);
+    QVERIFY(journal.start(fileName, false));
+
+    QTextCursor cursor(&document);
+    cursor.setPosition(document.characterCount() / 2);
+    QBENCHMARK {
+        cursor.insertText("x");
+    }
+    journal.flush();
+    QVERIFY(journal.errorString().isEmpty());
+    report("records", journal.recordCount(), "records");
+    report("perRecord", journal.averageRecordNanoseconds() / 1e3, "us");
+    journal.stop();
+    QFile::remove(EditJournal::journalFileName(fileName));
+}
+
+void TextEditorBench::followAppend() {
+    // A log written in bursts faster than the follower reads it; the cap
+    // keeps the document from growing with it.
+    const QString fileName = outputDirectory.filePath("followed.log");
+    QFile log(fileName);
+    QVERIFY(log.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QTextDocument document;
+    SyntaxHighlighter highlighter(&document);
+    FileFollower follower(&document);
+    follower.setMaxLines(followMaxLines);
+    QVERIFY(follower.start(fileName, 0));
+    QSignalSpy appended(&follower, &FileFollower::appended);
+
+    QRandomGenerator random(7);
+    qint64 lines = 0;
+    qint64 reads = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE {
+        for (int written = 0; written < followLineCount; written += followBurstLines) {
+            QByteArray burst;
+            for (int i = 0; i < followBurstLines; ++i)
+                appendLog(burst, random, written + i);
+            QVERIFY(log.write(burst) == burst.size());
+            log.flush();
+            QCoreApplication::processEvents();
+        }
+        while (lines < followLineCount && timer.elapsed() < operationTimeout) {
+            QTest::qWait(1);
+            for (; reads < appended.size(); ++reads)
+                lines += appended.at(int(reads)).first().toInt();
+        }
+    }
+    const qint64 ms = qMax<qint64>(1, timer.elapsed());
+    QCOMPARE(lines, qint64(followLineCount));
+    QVERIFY(document.blockCount() <= followMaxLines + 1);
+    report("throughput", followLineCount * 1000.0 / ms, "lines/s");
+    report("reads", reads, "reads");
+    follower.stop();
+}
+
+void TextEditorBench::batchExport_data() {
+    QTest::addColumn<int>("jobs");
+    QTest::newRow("1-thread") << 1;
+    if (QThread::idealThreadCount() > 1)
+        QTest::newRow(qPrintable(QString("%1-threads").arg(QThread::idealThreadCount()))) << QThread::idealThreadCount();
+}
+
+void TextEditorBench::batchExport() {
+    // Many medium files, the shape of a code review; compare the rows to
+    // see how the export scales with threads.
+    QFETCH(int, jobs);
+    const QString source = corpusFile("cpp", mediumCorpusSize / 4);
+    QStringList files;
+    for (int i = 0; i < exportFileCount; ++i) {
+        const QString fileName = outputDirectory.filePath(QString("export/input%1.cpp").arg(i));
+        if (!QFileInfo::exists(fileName)) {
+            QDir().mkpath(QFileInfo(fileName).absolutePath());
+            QVERIFY(QFile::copy(source, fileName));
+        }
+        files << fileName;
+    }
+
+    BatchExporter exporter(BatchExporter::Html, outputDirectory.filePath("export-output"));
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE {
+        QCOMPARE(exporter.exportFiles(files, jobs), 0);
+    }
+    const qint64 ms = qMax<qint64>(1, timer.elapsed());
+    report("throughput", exportFileCount * QFileInfo(source).size() / mb * 1000.0 / ms, "MB/s");
+}
+
+QTEST_MAIN(TextEditorBench)
+
+#include "texteditorbench.moc"
@@ -0,0 +1,570 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextCursor>
+#include <QTextDocument>
+#include "editjournal.h"
+#include "highlightlexer.h"
+#include "lineindex.h"
+#include "piecetable.h"
+#include "regexdfa.h"
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+// Random edits per seed in the piece table test. The model is compared in
+// full after each one, which stays cheap as the documents stay small.
+static const int pieceTableOperations = 2000;
+
+namespace {
+
+const QByteArray journalBase = "alpha\nbeta\ngamma\ndelta\n";
+
+const char *const insertions[] = {"a", "xy", "word ", "\n", "\r\n", "two\nlines\n", "\xc3\xa9", ""};
+
+// What PieceTable should hold, as a plain byte array with a snapshot per
+// undo step. Typing coalesces the way PieceTable::insert() does.
+struct PieceTableModel {
+    QByteArray text;
+    std::vector<QByteArray> undoStack;
+    std::vector<QByteArray> redoStack;
+    qint64 lastInsertEnd = -1;
+
+    void commit() {
+        undoStack.push_back(text);
+        redoStack.clear();
+    }
+
+    void insert(qint64 offset, const QByteArray &inserted) {
+        if (inserted.isEmpty())
+            return;
+        if (offset == lastInsertEnd && !inserted.contains('\n') && !undoStack.empty())
+            redoStack.clear();
+        else
+            commit();
+        text.insert(offset, inserted);
+        lastInsertEnd = offset + inserted.size();
+    }
+
+    void remove(qint64 offset, qint64 length) {
+        commit();
+        text.remove(offset, length);
+        lastInsertEnd = -1;
+    }
+
+    void replace(const std::vector<PieceTable::Edit> &edits) {
+        commit();
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit)
+            text.replace(edit->offset, edit->length, edit->text);
+        lastInsertEnd = -1;
+    }
+
+    void undo() {
+        if (undoStack.empty())
+            return;
+        redoStack.push_back(text);
+        text = undoStack.back();
+        undoStack.pop_back();
+        lastInsertEnd = -1;
+    }
+
+    void redo() {
+        if (redoStack.empty())
+            return;
+        undoStack.push_back(text);
+        text = redoStack.back();
+        redoStack.pop_back();
+        lastInsertEnd = -1;
+    }
+};
+
+QByteArray randomInsertion(QRandomGenerator &random) {
+    return insertions[random.bounded(int(std::size(insertions)))];
+}
+
+// Compares every query PieceTable answers with the same answer worked out
+// on the model's bytes.
+bool matchesModel(const PieceTable &table, const PieceTableModel &model, QString *mismatch) {
+    const QByteArray &text = model.text;
+    if (table.size() != text.size() || table.text(0, table.size()) != text) {
+        *mismatch = "text";
+        return false;
+    }
+    if (table.canUndo() != !model.undoStack.empty() || table.canRedo() != !model.redoStack.empty()) {
+        *mismatch = "undo state";
+        return false;
+    }
+    const qint64 lines = text.count('\n') + 1;
+    if (table.lineCount() != lines) {
+        *mismatch = QString("lineCount %1, expected %2").arg(table.lineCount()).arg(lines);
+        return false;
+    }
+    qint64 start = 0;
+    for (qint64 line = 0; line < lines; ++line) {
+        const qint64 newline = text.indexOf('\n', start);
+        qint64 end = newline < 0 ? text.size() : newline;
+        if (end > start && text.at(end - 1) == '\r')
+            --end;
+        if (table.lineStart(line) != start || table.lineEnd(line) != end) {
+            *mismatch = QString("line %1 spans %2-%3, expected %4-%5")
+                            .arg(line).arg(table.lineStart(line)).arg(table.lineEnd(line)).arg(start).arg(end);
+            return false;
+        }
+        start = newline + 1;
+    }
+    qint64 line = 0;
+    for (qint64 offset = 0; offset <= text.size(); ++offset) {
+        if (table.lineAt(offset) != line) {
+            *mismatch = QString("lineAt(%1) %2, expected %3").arg(offset).arg(table.lineAt(offset)).arg(line);
+            return false;
+        }
+        if (offset < text.size() && text.at(offset) == '\n')
+            ++line;
+    }
+    return true;
+}
+
+bool writeFile(const QString &fileName, const QByteArray &contents) {
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(contents) == contents.size();
+}
+
+// Replays the journal of fileName over a fresh copy of its contents; a null
+// string if replay() fails.
+QString replayed(const QString &fileName, const QByteArray &contents) {
+    QTextDocument document(QString::fromUtf8(contents));
+    EditJournal journal(&document);
+    if (!journal.replay(fileName))
+        return QString();
+    return document.toPlainText();
+}
+
+// Records two flushed batches of edits to journalBase and returns the
+// document's text after each, and the journal's size after the first.
+bool recordTwoBatches(const QString &fileName, QString *afterFirst, QString *afterSecond, qint64 *firstBatchEnd) {
+    QTextDocument document(QString::fromUtf8(journalBase));
+    EditJournal journal(&document);
+    if (!journal.start(fileName, false))
+        return false;
+    QTextCursor cursor(&document);
+    cursor.insertText("new ");
+    cursor.setPosition(10);
+    cursor.setPosition(14, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText("one\ntwo");
+    journal.flush();
+    *afterFirst = document.toPlainText();
+    *firstBatchEnd = QFileInfo(EditJournal::journalFileName(fileName)).size();
+
+    cursor.setPosition(3);
+    cursor.setPosition(20, QTextCursor::KeepAnchor);
+    cursor.insertText(QString::fromUtf8("\xc3\xa9t\xc3\xa9\n"));
+    cursor.setPosition(0);
+    cursor.deleteChar();
+    journal.flush();
+    *afterSecond = document.toPlainText();
+    journal.stop();
+    return true;
+}
+
+QByteArray serialized(const RegexDfa &dfa) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_15);
+    dfa.write(stream);
+    return data;
+}
+
+bool readDfa(const QByteArray &data, RegexDfa *dfa) {
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_15);
+    return dfa->read(stream);
+}
+
+std::shared_ptr<const HighlightLexer> readLexer(const QByteArray &data) {
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_15);
+    return HighlightLexer::read(stream);
+}
+
+bool sameTokens(const QVector<HighlightLexer::Token> &a, const QVector<HighlightLexer::Token> &b) {
+    if (a.size() != b.size())
+        return false;
+    for (int i = 0; i < a.size(); ++i) {
+        if (a.at(i).start != b.at(i).start || a.at(i).length != b.at(i).length || a.at(i).kind != b.at(i).kind)
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// Correctness of the editor's data structures and on-disk formats.
+class TextEditorTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void pieceTable_data();
+    void pieceTable();
+    void journalReplay();
+    void journalDamagedBatch_data();
+    void journalDamagedBatch();
+    void journalBaseChanged();
+    void regexDfaMatch_data();
+    void regexDfaMatch();
+    void regexDfaFind();
+    void regexDfaCache_data();
+    void regexDfaCache();
+    void regexDfaTruncatedCache();
+    void lexerCache();
+};
+
+void TextEditorTests::pieceTable_data() {
+    QTest::addColumn<QByteArray>("original");
+    QTest::addColumn<quint32>("seed");
+
+    QTest::newRow("unix") << QByteArray("first line\nsecond\n\nfourth line, no newline") << 1u;
+    QTest::newRow("crlf") << QByteArray("first line\r\nsecond\r\n\r\n") << 2u;
+    QTest::newRow("one-byte") << QByteArray("x") << 3u;
+}
+
+void TextEditorTests::pieceTable() {
+    QFETCH(QByteArray, original);
+    QFETCH(quint32, seed);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString fileName = directory.filePath("original.txt");
+    QVERIFY(writeFile(fileName, original));
+    auto index = std::make_shared<LineIndex>();
+    QVERIFY2(index->open(fileName), qPrintable(index->errorString()));
+    const std::atomic<bool> cancelled(false);
+    QVERIFY(index->build(cancelled));
+
+    PieceTable table(index);
+    PieceTableModel model;
+    model.text = original;
+    QString mismatch;
+    QVERIFY2(matchesModel(table, model, &mismatch), qPrintable(mismatch));
+
+    QRandomGenerator random(seed);
+    for (int step = 0; step < pieceTableOperations; ++step) {
+        const qint64 size = model.text.size();
+        const int operation = random.bounded(10);
+        QByteArray description;
+        if (operation < 4) {
+            // Half the inserts continue where the last one ended.
+            qint64 offset = random.bounded(size + 1);
+            if (random.bounded(2) && model.lastInsertEnd >= 0)
+                offset = model.lastInsertEnd;
+            const QByteArray inserted = randomInsertion(random);
+            table.insert(offset, inserted);
+            model.insert(offset, inserted);
+            description = "insert " + inserted.toPercentEncoding() + " at " + QByteArray::number(offset);
+        } else if (operation < 6 && size > 0) {
+            const qint64 offset = random.bounded(size);
+            const qint64 length = 1 + random.bounded(qMin<qint64>(size - offset, 16));
+            table.remove(offset, length);
+            model.remove(offset, length);
+            description = "remove " + QByteArray::number(length) + " at " + QByteArray::number(offset);
+        } else if (operation < 7) {
+            std::vector<PieceTable::Edit> edits;
+            qint64 offset = 0;
+            for (int i = random.bounded(1, 4); i > 0 && offset <= size; --i) {
+                offset += random.bounded(qMin<qint64>(size - offset, 64) + 1);
+                const qint64 length = random.bounded(qMin<qint64>(size - offset, 8) + 1);
+                edits.push_back({offset, length, randomInsertion(random)});
+                offset += length + 1;
+            }
+            table.replace(edits);
+            model.replace(edits);
+            description = "replace " + QByteArray::number(qsizetype(edits.size())) + " ranges";
+        } else if (operation < 9) {
+            table.undo();
+            model.undo();
+            description = "undo";
+        } else {
+            table.redo();
+            model.redo();
+            description = "redo";
+        }
+        if (!matchesModel(table, model, &mismatch))
+            QFAIL(qPrintable(QString("step %1 (%2): %3").arg(step).arg(QString(description)).arg(mismatch)));
+    }
+}
+
+void TextEditorTests::journalReplay() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString fileName = directory.filePath("journaled.txt");
+    QVERIFY(writeFile(fileName, journalBase));
+    QVERIFY(!EditJournal::hasRecoverableChanges(fileName));
+
+    QString afterFirst, afterSecond;
+    qint64 firstBatchEnd = 0;
+    QVERIFY(recordTwoBatches(fileName, &afterFirst, &afterSecond, &firstBatchEnd));
+    QVERIFY(afterSecond != afterFirst);
+    QVERIFY(EditJournal::hasRecoverableChanges(fileName));
+    QCOMPARE(replayed(fileName, journalBase), afterSecond);
+}
+
+void TextEditorTests::journalDamagedBatch_data() {
+    QTest::addColumn<QString>("damage");
+
+    QTest::newRow("torn-payload") << QString("torn-payload");
+    QTest::newRow("torn-header") << QString("torn-header");
+    QTest::newRow("bad-checksum") << QString("bad-checksum");
+}
+
+// A damaged last batch is dropped whole, and recording continues from the
+// state the intact batches leave.
+void TextEditorTests::journalDamagedBatch() {
+    QFETCH(QString, damage);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString fileName = directory.filePath("journaled.txt");
+    QVERIFY(writeFile(fileName, journalBase));
+    QString afterFirst, afterSecond;
+    qint64 firstBatchEnd = 0;
+    QVERIFY(recordTwoBatches(fileName, &afterFirst, &afterSecond, &firstBatchEnd));
+
+    QFile journalFile(EditJournal::journalFileName(fileName));
+    QVERIFY(journalFile.open(QIODevice::ReadWrite));
+    QByteArray data = journalFile.readAll();
+    QVERIFY(data.size() > firstBatchEnd + 6);
+    if (damage == "torn-payload") {
+        data.chop(1);
+    } else if (damage == "torn-header") {
+        // Half of the second batch's length and checksum.
+        data.truncate(firstBatchEnd + 3);
+    } else {
+        data[data.size() - 1] ^= 0x01;
+    }
+    QVERIFY(journalFile.resize(0) && journalFile.seek(0));
+    QCOMPARE(journalFile.write(data), data.size());
+    journalFile.close();
+
+    QVERIFY(EditJournal::hasRecoverableChanges(fileName));
+    QCOMPARE(replayed(fileName, journalBase), afterFirst);
+
+    QTextDocument document(QString::fromUtf8(journalBase));
+    {
+        EditJournal journal(&document);
+        QVERIFY(journal.replay(fileName));
+        QCOMPARE(document.toPlainText(), afterFirst);
+        QVERIFY(journal.start(fileName, true));
+        QTextCursor cursor(&document);
+        cursor.movePosition(QTextCursor::End);
+        cursor.insertText("\nafter recovery");
+        journal.stop();
+    }
+    QCOMPARE(replayed(fileName, journalBase), document.toPlainText());
+}
+
+// A journal is never replayed over a different version of its file.
+void TextEditorTests::journalBaseChanged() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString fileName = directory.filePath("journaled.txt");
+    QVERIFY(writeFile(fileName, journalBase));
+    QString afterFirst, afterSecond;
+    qint64 firstBatchEnd = 0;
+    QVERIFY(recordTwoBatches(fileName, &afterFirst, &afterSecond, &firstBatchEnd));
+
+    const QByteArray changed = journalBase + "epsilon\n";
+    QVERIFY(writeFile(fileName, changed));
+    QVERIFY(!EditJournal::hasRecoverableChanges(fileName));
+    QVERIFY(replayed(fileName, changed).isNull());
+}
+
+void TextEditorTests::regexDfaMatch_data() {
+    QTest::addColumn<QStringList>("patterns");
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("from");
+    QTest::addColumn<int>("pattern");
+    QTest::addColumn<int>("end");
+
+    const QStringList keywordFirst = {"if", "[a-z]+"};
+    QTest::newRow("longest-match") << keywordFirst << QString("iffy") << 0 << 1 << 4;
+    QTest::newRow("first-rule-wins") << keywordFirst << QString("if (x)") << 0 << 0 << 2;
+    QTest::newRow("first-rule-wins-reversed") << QStringList{"[a-z]+", "if"} << QString("if") << 0 << 0 << 2;
+    QTest::newRow("tie-after-longer") << QStringList{"a", "ab", "abc?"} << QString("abd") << 0 << 1 << 2;
+    QTest::newRow("back-to-last-accept") << QStringList{"ab", "abcd"} << QString("abcx") << 0 << 0 << 2;
+    QTest::newRow("from") << QStringList{"\\d+"} << QString("ab12c") << 2 << 0 << 4;
+    QTest::newRow("no-match") << QStringList{"\\d+"} << QString("abc") << 0 << -1 << -1;
+}
+
+void TextEditorTests::regexDfaMatch() {
+    QFETCH(QStringList, patterns);
+    QFETCH(QString, text);
+    QFETCH(int, from);
+    QFETCH(int, pattern);
+    QFETCH(int, end);
+
+    RegexDfa dfa;
+    QString error;
+    QVERIFY2(dfa.compile(patterns, &error), qPrintable(error));
+    int matchEnd = -1;
+    QCOMPARE(dfa.match(text.constData(), int(text.size()), from, &matchEnd), pattern);
+    QCOMPARE(matchEnd, end);
+}
+
+void TextEditorTests::regexDfaFind() {
+    RegexDfa dfa;
+    QString error;
+    QVERIFY2(dfa.compile({"\\d+", "[a-z]+"}, &error), qPrintable(error));
+    const QString text = "  42x";
+    int end = -1;
+    int pattern = -1;
+    QCOMPARE(dfa.find(text.constData(), int(text.size()), 0, &end, &pattern), 2);
+    QCOMPARE(end, 4);
+    QCOMPARE(pattern, 0);
+    QCOMPARE(dfa.find(text.constData(), int(text.size()), 5, &end), -1);
+}
+
+void TextEditorTests::regexDfaCache_data() {
+    QTest::addColumn<QString>("damage");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("intact") << QString() << true;
+    QTest::newRow("transition") << QString("transition") << false;
+    QTest::newRow("ascii-class") << QString("ascii-class") << false;
+    QTest::newRow("range-class") << QString("range-class") << false;
+    QTest::newRow("accepting") << QString("accepting") << false;
+    QTest::newRow("class-count") << QString("class-count") << false;
+}
+
+// Rewrites the fields of a written automaton with one value out of range; a
+// damaged cache must be rejected rather than index out of bounds.
+void TextEditorTests::regexDfaCache() {
+    QFETCH(QString, damage);
+    QFETCH(bool, valid);
+
+    RegexDfa original;
+    QString error;
+    QVERIFY2(original.compile({"if", "[a-z]+", "\\d+"}, &error), qPrintable(error));
+
+    qint32 patterns = 0;
+    qint32 classes = 0;
+    QVector<int> asciiClasses;
+    QVector<quint16> rangeStarts;
+    QVector<int> rangeClasses;
+    QVector<int> transitions;
+    QVector<int> accepting;
+    {
+        QDataStream stream(serialized(original));
+        stream.setVersion(QDataStream::Qt_5_15);
+        stream >> patterns >> classes >> asciiClasses >> rangeStarts >> rangeClasses >> transitions >> accepting;
+        QCOMPARE(stream.status(), QDataStream::Ok);
+        QVERIFY(stream.atEnd());
+    }
+    if (damage == "transition")
+        transitions[transitions.size() / 2] = int(accepting.size());
+    else if (damage == "ascii-class")
+        asciiClasses['a'] = classes;
+    else if (damage == "range-class")
+        rangeClasses.last() = -1;
+    else if (damage == "accepting")
+        accepting.last() = patterns;
+    else if (damage == "class-count")
+        ++classes;
+
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_15);
+        stream << patterns << classes << asciiClasses << rangeStarts << rangeClasses << transitions << accepting;
+    }
+    RegexDfa dfa;
+    QCOMPARE(readDfa(data, &dfa), valid);
+    const QString text = "iffy 42";
+    int end = -1;
+    if (valid) {
+        QCOMPARE(data, serialized(original));
+        QCOMPARE(dfa.patternCount(), original.patternCount());
+        QCOMPARE(dfa.match(text.constData(), int(text.size()), 0, &end), 1);
+        QCOMPARE(end, 4);
+        QCOMPARE(dfa.match(text.constData(), int(text.size()), 5, &end), 2);
+        QCOMPARE(end, 7);
+    } else {
+        // A rejected automaton matches nothing.
+        QCOMPARE(dfa.match(text.constData(), int(text.size()), 0, &end), -1);
+    }
+}
+
+void TextEditorTests::regexDfaTruncatedCache() {
+    RegexDfa original;
+    QString error;
+    QVERIFY2(original.compile({"if", "[a-z]+", "\\d+"}, &error), qPrintable(error));
+    const QByteArray data = serialized(original);
+    for (qsizetype length = 0; length < data.size(); ++length) {
+        RegexDfa dfa;
+        if (readDfa(data.left(length), &dfa))
+            QFAIL(qPrintable(QString("read %1 of %2 bytes").arg(length).arg(data.size())));
+    }
+}
+
+// The language cache holds a written HighlightLexer, which must read back
+// the same and refuse a cut-off or damaged copy.
+void TextEditorTests::lexerCache() {
+    QFile definition(":/languages/cpp.json");
+    QVERIFY(definition.open(QIODevice::ReadOnly));
+    QString error;
+    const std::shared_ptr<const HighlightLexer> lexer = HighlightLexer::compile(definition.readAll(), &error);
+    QVERIFY2(lexer, qPrintable(error));
+
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_15);
+        lexer->write(stream);
+    }
+    const std::shared_ptr<const HighlightLexer> copy = readLexer(data);
+    QVERIFY(copy);
+    QCOMPARE(copy->name(), lexer->name());
+    const QStringList lines = {"static int count = 0x1f; // total", "QString name = \"a\\\"b\"; /* open",
+                               "still a comment */ return name.size();"};
+    int state = HighlightLexer::NormalState;
+    int copyState = HighlightLexer::NormalState;
+    for (const QString &line : lines) {
+        QVector<HighlightLexer::Token> tokens;
+        QVector<HighlightLexer::Token> copyTokens;
+        state = lexer->tokenize(line, state, tokens);
+        copyState = copy->tokenize(line, copyState, copyTokens);
+        QVERIFY(!tokens.isEmpty());
+        QVERIFY(sameTokens(tokens, copyTokens));
+        QCOMPARE(copyState, state);
+    }
+
+    const qsizetype step = qMax<qsizetype>(1, data.size() / 256);
+    for (qsizetype length = 0; length < data.size(); length += step) {
+        if (readLexer(data.left(length)))
+            QFAIL(qPrintable(QString("read %1 of %2 bytes").arg(length).arg(data.size())));
+    }
+    QVERIFY(!readLexer(data.left(data.size() - 1)));
+
+    // The first rule's kind follows the strings and the rule count.
+    QByteArray strings;
+    {
+        QDataStream stream(&strings, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_15);
+        stream << lexer->name() << lexer->extensions() << lexer->firstLinePattern() << lexer->keywordList();
+    }
+    QVERIFY(data.startsWith(strings));
+    QByteArray badKind;
+    {
+        QDataStream stream(&badKind, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_15);
+        stream << qint32(HighlightLexer::tokenKindCount);
+    }
+    QByteArray damaged = data;
+    damaged.replace(strings.size() + 4, badKind.size(), badKind);
+    QVERIFY(!readLexer(damaged));
+}
+
+QTEST_MAIN(TextEditorTests)
+
+#include "texteditortests.moc"
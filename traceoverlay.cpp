@@ -0,0 +1,38 @@
+#include "traceoverlay.h"
+#include "tracing.h"
+
+static const int refreshInterval = 500;
+
+TraceOverlay::TraceOverlay(QWidget *parent) : QLabel(parent) {
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setStyleSheet("background: rgba(0, 0, 0, 160); color: white; padding: 4px;");
+    refreshTimer.setInterval(refreshInterval);
+    connect(&refreshTimer, &QTimer::timeout, this, &TraceOverlay::refresh);
+    refresh();
+}
+
+void TraceOverlay::showEvent(QShowEvent *event) {
+    QLabel::showEvent(event);
+    refresh();
+    refreshTimer.start();
+}
+
+void TraceOverlay::hideEvent(QHideEvent *event) {
+    QLabel::hideEvent(event);
+    refreshTimer.stop();
+}
+
+void TraceOverlay::refresh() {
+    const Tracing::LatencySummary latency = Tracing::inputLatency();
+    if (latency.samples == 0) {
+        setText("Key to paint: no samples yet");
+    } else {
+        setText(QString("Key to paint (%1): p50 %2 ms, p90 %3 ms, p99 %4 ms, max %5 ms")
+                    .arg(latency.samples)
+                    .arg(latency.p50, 0, 'f', 1)
+                    .arg(latency.p90, 0, 'f', 1)
+                    .arg(latency.p99, 0, 'f', 1)
+                    .arg(latency.max, 0, 'f', 1));
+    }
+    adjustSize();
+}
@@ -0,0 +1,25 @@
+#ifndef TRACEOVERLAY_H
+#define TRACEOVERLAY_H
+
+#include <QLabel>
+#include <QTimer>
+
+// Small read-out of keystroke-to-paint latency percentiles, shown over the
+// editor while tracing is on.
+class TraceOverlay : public QLabel {
+    Q_OBJECT
+public:
+    explicit TraceOverlay(QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    void refresh();
+
+private:
+    QTimer refreshTimer;
+};
+
+#endif // TRACEOVERLAY_H
@@ -0,0 +1,187 @@
+#include "tracing.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Events kept per thread; a power of two so the index wraps with a mask.
+static const quint64 ringCapacity = 1 << 14;
+// Latency samples kept for the percentiles.
+static const size_t maxLatencySamples = 1024;
+
+namespace {
+
+// Fields are atomics only so that a dump may read a ring while its thread is
+// writing; every access is relaxed and compiles to a plain move.
+struct Event {
+    std::atomic<const char *> name{nullptr};
+    std::atomic<qint64> start{0};
+    std::atomic<qint64> end{0};
+};
+
+struct Ring {
+    Event events[ringCapacity];
+    // Written by the owning thread only.
+    std::atomic<quint64> head{0};
+    std::atomic<bool> inUse{true};
+    int id = 0;
+    QByteArray threadName;
+};
+
+QMutex ringsMutex;
+std::vector<std::unique_ptr<Ring>> rings;
+
+// Hands the thread's ring back when the thread exits. Pool threads come and
+// go, so a later thread takes the ring over instead of allocating another.
+struct RingOwner {
+    Ring *ring = nullptr;
+    ~RingOwner() {
+        if (ring)
+            ring->inUse.store(false, std::memory_order_release);
+    }
+};
+
+thread_local RingOwner owner;
+
+Ring *threadRing() {
+    if (owner.ring)
+        return owner.ring;
+    QMutexLocker locker(&ringsMutex);
+    for (const std::unique_ptr<Ring> &ring : rings) {
+        if (!ring->inUse.load(std::memory_order_acquire)) {
+            ring->inUse.store(true, std::memory_order_relaxed);
+            owner.ring = ring.get();
+            return owner.ring;
+        }
+    }
+    rings.push_back(std::make_unique<Ring>());
+    Ring *ring = rings.back().get();
+    ring->id = int(rings.size());
+    const bool gui = QCoreApplication::instance() && QThread::currentThread() == QCoreApplication::instance()->thread();
+    ring->threadName = gui ? QByteArray("GUI") : "Worker " + QByteArray::number(ring->id);
+    owner.ring = ring;
+    return ring;
+}
+
+// GUI thread only.
+qint64 pendingInput = 0;
+std::vector<qint64> latencies;
+size_t nextLatency = 0;
+
+void appendMicroseconds(QByteArray &out, qint64 nanoseconds) {
+    out += QByteArray::number(nanoseconds / 1000);
+    out += '.';
+    out += QByteArray::number(nanoseconds % 1000).rightJustified(3, '0');
+}
+
+} // namespace
+
+namespace Tracing {
+
+std::atomic<bool> enabled{false};
+
+void setEnabled(bool on) {
+    enabled.store(on, std::memory_order_relaxed);
+    pendingInput = 0;
+}
+
+qint64 now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void record(const char *name, qint64 start, qint64 end) {
+    Ring *ring = threadRing();
+    const quint64 index = ring->head.load(std::memory_order_relaxed);
+    Event &event = ring->events[index & (ringCapacity - 1)];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    ring->head.store(index + 1, std::memory_order_release);
+}
+
+void inputReceived() {
+    // The oldest unpainted key press is the one the user has waited on.
+    if (isEnabled() && !pendingInput)
+        pendingInput = now();
+}
+
+void inputPainted() {
+    if (!pendingInput)
+        return;
+    const qint64 painted = now();
+    record("input to paint", pendingInput, painted);
+    if (latencies.size() < maxLatencySamples)
+        latencies.push_back(painted - pendingInput);
+    else
+        latencies[nextLatency] = painted - pendingInput;
+    nextLatency = (nextLatency + 1) % maxLatencySamples;
+    pendingInput = 0;
+}
+
+LatencySummary inputLatency() {
+    LatencySummary summary;
+    if (latencies.empty())
+        return summary;
+    std::vector<qint64> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    const auto percentile = [&sorted](double p) {
+        return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))] / 1e6;
+    };
+    summary.samples = int(sorted.size());
+    summary.p50 = percentile(0.50);
+    summary.p90 = percentile(0.90);
+    summary.p99 = percentile(0.99);
+    summary.max = sorted.back() / 1e6;
+    return summary;
+}
+
+QByteArray chromeTrace() {
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    QMutexLocker locker(&ringsMutex);
+    for (const std::unique_ptr<Ring> &ring : rings) {
+        const QByteArray tid = QByteArray::number(ring->id);
+        out += first ? "" : ",";
+        first = false;
+        out += "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\""
+               + ring->threadName + "\"}}";
+
+        // Copy first, then drop whatever the thread overwrote meanwhile,
+        // including the slot it may be halfway through.
+        const quint64 head = ring->head.load(std::memory_order_acquire);
+        const quint64 from = head > ringCapacity ? head - ringCapacity : 0;
+        struct Copy {
+            const char *name;
+            qint64 start;
+            qint64 end;
+        };
+        std::vector<Copy> copies;
+        copies.reserve(size_t(head - from));
+        for (quint64 i = from; i < head; ++i) {
+            const Event &event = ring->events[i & (ringCapacity - 1)];
+            copies.push_back({event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed),
+                              event.end.load(std::memory_order_relaxed)});
+        }
+        const quint64 after = ring->head.load(std::memory_order_acquire);
+        const quint64 valid = after + 1 > ringCapacity ? after + 1 - ringCapacity : 0;
+
+        for (quint64 i = std::max(from, valid); i < head; ++i) {
+            const Copy &event = copies[size_t(i - from)];
+            out += ",\n{\"name\":\"";
+            out += event.name;
+            out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+            appendMicroseconds(out, event.start);
+            out += ",\"dur\":";
+            appendMicroseconds(out, event.end - event.start);
+            out += '}';
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+} // namespace Tracing
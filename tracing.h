@@ -0,0 +1,59 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <atomic>
+
+// Scoped timing of the editor's hot paths, exported as Chrome/Perfetto trace
+// JSON. Off by default: a disabled scope costs one relaxed atomic load. When
+// enabled, each thread records into its own fixed-size ring, so recording
+// takes no lock and keeps only the most recent events.
+namespace Tracing {
+extern std::atomic<bool> enabled;
+
+inline bool isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+void setEnabled(bool on);
+// Monotonic time in nanoseconds.
+qint64 now();
+void record(const char *name, qint64 start, qint64 end);
+
+// Keystroke-to-paint latency, GUI thread only: a key press starts a sample
+// and the next paint of the editor that received it completes it.
+void inputReceived();
+void inputPainted();
+
+struct LatencySummary {
+    int samples = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0; // Milliseconds, like the percentiles.
+};
+LatencySummary inputLatency();
+
+// Everything currently held in the rings, as a Chrome trace document.
+QByteArray chromeTrace();
+
+// Records the time from construction to destruction under name, which must
+// be a string literal or otherwise outlive the trace.
+class Scope {
+public:
+    explicit Scope(const char *name) : name(name), start(isEnabled() ? now() : 0) {}
+    ~Scope() {
+        if (start)
+            record(name, start, now());
+    }
+
+private:
+    Q_DISABLE_COPY(Scope)
+    const char *name;
+    qint64 start;
+};
+}
+
+#define TRACE_SCOPE(name) Tracing::Scope traceScope(name)
+
+#endif // TRACING_H
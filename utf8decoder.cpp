@@ -0,0 +1,65 @@
+#include "utf8decoder.h"
+
+int Utf8Decoder::decodeCharacter(const char *data, qsizetype size, char32_t *code) {
+    static const char32_t minimum[] = {0, 0, 0x80, 0x800, 0x10000};
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    const uchar b = bytes[0];
+    int length = 0;
+    char32_t value = 0;
+    if (b < 0x80) {
+        *code = b;
+        return 1;
+    } else if ((b & 0xe0) == 0xc0) {
+        length = 2;
+        value = b & 0x1f;
+    } else if ((b & 0xf0) == 0xe0) {
+        length = 3;
+        value = b & 0x0f;
+    } else if ((b & 0xf8) == 0xf0) {
+        length = 4;
+        value = b & 0x07;
+    }
+
+    bool valid = length > 0 && length <= size;
+    for (int k = 1; valid && k < length; ++k) {
+        valid = (bytes[k] & 0xc0) == 0x80;
+        value = (value << 6) | (bytes[k] & 0x3f);
+    }
+    // Overlong forms, surrogates and values past U+10FFFF.
+    if (valid && (value < minimum[length] || (value >= 0xd800 && value <= 0xdfff) || value > 0x10ffff))
+        valid = false;
+    if (!valid) {
+        *code = QChar::ReplacementCharacter;
+        return 1;
+    }
+    *code = value;
+    return length;
+}
+
+QString Utf8Decoder::decode(const QByteArray &bytes, QVector<int> *byteOffsets) {
+    const int size = int(bytes.size());
+    QString text;
+    text.reserve(size);
+    if (byteOffsets) {
+        byteOffsets->clear();
+        byteOffsets->reserve(size + 1);
+    }
+    for (int i = 0; i < size;) {
+        char32_t code;
+        const int length = decodeCharacter(bytes.constData() + i, size - i, &code);
+        if (QChar::requiresSurrogates(code)) {
+            text.append(QChar(QChar::highSurrogate(code)));
+            text.append(QChar(QChar::lowSurrogate(code)));
+        } else {
+            text.append(QChar(char16_t(code)));
+        }
+        if (byteOffsets) {
+            for (int unit = unitsFor(code); unit > 0; --unit)
+                byteOffsets->append(i);
+        }
+        i += length;
+    }
+    if (byteOffsets)
+        byteOffsets->append(size);
+    return text;
+}
@@ -0,0 +1,25 @@
+#ifndef UTF8DECODER_H
+#define UTF8DECODER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// UTF-8 decoding for views that edit the file's bytes directly. Every byte
+// that is not part of a valid sequence becomes one U+FFFD, so a position in
+// the decoded text always maps back to the byte it came from; re-encoding
+// the text cannot do that once the file holds invalid UTF-8.
+namespace Utf8Decoder {
+// Decodes the character starting at data; size must be positive. Returns
+// the number of bytes it takes.
+int decodeCharacter(const char *data, qsizetype size, char32_t *code);
+// UTF-16 units the character takes in a QString.
+inline int unitsFor(char32_t code) {
+    return QChar::requiresSurrogates(code) ? 2 : 1;
+}
+// byteOffsets receives the byte each UTF-16 unit's character starts at,
+// both units of a surrogate pair sharing one, followed by bytes.size().
+QString decode(const QByteArray &bytes, QVector<int> *byteOffsets = nullptr);
+}
+
+#endif // UTF8DECODER_H